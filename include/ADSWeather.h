@@ -21,46 +21,243 @@
 #define ADSWeather_h
 
 #include "Arduino.h"
+#include "Deadline.h"
+#include <utility>
+
+// Pull-up resistor (Ohm) between the vane input and the ADC reference
+#define VANE_PULLUP 10000UL
+// Number of positions of the vane, every position has its own resistance
+#define VANE_POSITIONS 16
+
+// Resistance (Ohm) of every vane position sorted from low to high, and the bin (in 22.5 degree steps from North)
+// each of them belongs to.
+constexpr unsigned long VANE_RESISTANCE[VANE_POSITIONS] = {
+        688, 891, 1000, 1410, 2200, 3140, 3900, 6570, 8200, 14120, 16000, 21880, 33000, 42120, 64900, 120000};
+constexpr unsigned char VANE_BIN[VANE_POSITIONS] = {5, 3, 4, 7, 6, 9, 8, 1, 2, 11, 10, 15, 0, 13, 14, 12};
+
+//Upper limits of the ADC readings for the vane positions, midway between the expected readings of neighbouring
+//positions. A reading above threshold[i] belongs to a position after i in VANE_RESISTANCE.
+struct VaneThresholds
+{
+    unsigned int threshold[VANE_POSITIONS - 1];
+};
+
+//Calculates the thresholds for an ADC resolution (bits) and a pull-up resistor (Ohm), usable at compile time.
+constexpr VaneThresholds makeVaneThresholds(unsigned char bits, unsigned long pullup)
+{
+    VaneThresholds table = {};
+    double maximum = (double) ((1UL << bits) - 1);
+    for (unsigned char i = 0; i < VANE_POSITIONS - 1; i++)
+    {
+        double low = maximum * VANE_RESISTANCE[i] / (VANE_RESISTANCE[i] + pullup);
+        double high = maximum * VANE_RESISTANCE[i + 1] / (VANE_RESISTANCE[i + 1] + pullup);
+        table.threshold[i] = (unsigned int) ((low + high) / 2);
+    }
+    return table;
+}
+
+// Scale of the fixed point direction vectors, every vane sample adds the unit vector of its bin times this
+#define VANE_VECTOR_ONE 16384
+// Cosine of every bin (22.5 degree steps from North) times VANE_VECTOR_ONE, the sine of bin i is the cosine of i - 4
+constexpr int16_t VANE_COS[VANE_POSITIONS] = {
+        16384, 15137, 11585, 6270, 0, -6270, -11585, -15137, -16384, -15137, -11585, -6270, 0, 6270, 11585, 15137};
+#define VANE_SIN(bin) VANE_COS[((bin) - 4) & 0x0F]
+
+//How the direction is calculated from the vane samples
+enum VaneAveraging
+{
+    VANE_AVERAGING_CONSENSUS,   //Weighted mean of the densest 5 bins, 22.5 degree steps
+    VANE_AVERAGING_VECTOR       //Direction of the sum of the unit vectors of all samples, 1 degree steps
+};
+
+constexpr VaneThresholds VANE_THRESHOLDS_10BIT = makeVaneThresholds(10, VANE_PULLUP);
+constexpr VaneThresholds VANE_THRESHOLDS_12BIT = makeVaneThresholds(12, VANE_PULLUP);
+
+// Longest gust window in calculation intervals (seconds), the rolling maximum needs one entry per second in the worst
+// case
+#ifndef GUST_WINDOW_MAX
+#define GUST_WINDOW_MAX 60
+#endif
+// Speeds averaged for a WMO gust (3 s running mean)
+#define GUST_WMO_SAMPLES 3
+
+// Period measurement is used up to this many pulses per calculation interval (48 km/h), above that counting is exact
+// enough and the capture interrupt is switched off
+#ifndef PERIOD_MAX_PULSES
+#define PERIOD_MAX_PULSES 20
+#endif
+// Calculation intervals without a pulse after which the last edge is no longer used as reference
+#define PERIOD_TIMEOUT 30
+
+// Stations that can exist at the same time, every one gets its own anemometer interrupt
+#ifndef ADS_WEATHER_MAX_STATIONS
+#define ADS_WEATHER_MAX_STATIONS 2
+#endif
+
+typedef void (*ADSWeatherIsr)();
+
+// Rain per tip of the gauge bucket (mm), 0.011 inch for the Argent Data Systems gauge
+#ifndef RAIN_MM_PER_TIP
+#define RAIN_MM_PER_TIP 0.2794f
+#endif
+// Minimum time (ms) between two tips, the reed contact bounces when the bucket flips
+#ifndef RAIN_DEBOUNCE_TIME
+#define RAIN_DEBOUNCE_TIME 100
+#endif
 
 
 class ADSWeather
 {
 public:
     ADSWeather(int windDirPin, int windSpdPin);
+    ADSWeather(int rainPin, int windDirPin, int windSpdPin);
+    ~ADSWeather();
+    ADSWeather(const ADSWeather &) = delete;
+    ADSWeather &operator=(const ADSWeather &) = delete;
 
     int getWindDirection();
+    float getWindSteadiness();
+    int getWindDirDeviation();
+    void getWindVector(long &x, long &y, unsigned int &samples);
+    void setVaneAveraging(VaneAveraging mode);
     int getWindSpeed();
+    int getWindSpeedX10();
     int getWindGust();
+    int getWindGustX10();
+    int getWindGustMax();
+
+    void setGustWindow(unsigned int seconds, bool wmo = false);
+
+    bool attachRainGauge(int mode = FALLING);
+    ADSWeatherIsr rainGaugeIsr();
+    bool setRainClock(unsigned char hour, unsigned char day);
+    unsigned int getRainTips();
+    unsigned long getRainTotalTips();
+    float getRain();
+    float getRainHour();
+    float getRainDay();
+    float getRainLastHour();
+    float getRainLastDay();
+    float getRainTotal();
+
+    bool attachAnemometer(int mode = FALLING);
+    ADSWeatherIsr anemometerIsr();
+    bool useHardwareCounter(bool glitchFilter = true);
+    bool hardwareCounter();
+    void setPeriodMode(bool enable);
 
     void update();
+    void sampleVane();
+    void addVaneSample(unsigned int windVane);
+    void calculate();
+
+    void setVaneResolution(unsigned char bits, unsigned long pullup = VANE_PULLUP);
+    void setVaneCalibration(const VaneThresholds &thresholds);
+    const VaneThresholds &getVaneCalibration();
+    unsigned char decodeVane(unsigned int windVane);
 
     static void countAnemometer();
+    static void captureEdge();
 
 
 private:
+    int _rainPin;               //-1 without rain gauge
     int _windDirPin;
     int _windSpdPin;
+    unsigned char _slot;        //Entry in _station, selects the interrupt trampoline
+
+    static ADSWeather *_station[ADS_WEATHER_MAX_STATIONS];
+
+    //Anemometer interrupt backend, written by the ISR of this station only
+    volatile unsigned int _pulseCount;
+    volatile unsigned long _pulseFirst;     //micros() of the first edge since the last read
+    volatile unsigned long _pulseLast;      //micros() of the last accepted edge, also for the debounce
+
+    //Rain gauge, the ISR only counts the tips, calculate() and setRainClock() sum them up
+    volatile unsigned int _tipCount;
+    volatile unsigned long _tipLast;        //millis() of the last accepted tip
+    unsigned int _rainTips;                 //Tips in the last calculation interval
+    unsigned long _rainTotal;
+    unsigned int _rainHour;
+    unsigned int _rainDay;
+    unsigned int _rainLastHour;
+    unsigned int _rainLastDay;
+    unsigned char _rainClockHour;           //Hour and day of setRainClock(), 0xFF before the first call
+    unsigned char _rainClockDay;
 
 
     int _windDir;
-    int _windSpd;
-    unsigned int _windSpdMax;
+    int _windSpd;               //0.1 km/h
+    unsigned int _windSpdMax;   //0.1 km/h
 
-    unsigned long _nextCalc;
-    unsigned long _timer;
+    PeriodicTimer _calcTimer;    //Calculation interval of update()
 
     unsigned int _vaneSample[50]; //50 samples from the sensor for consensus averaging
+    unsigned char _vaneSampleBin[50]; //Bin of every sample, to take it out of the histogram when it is replaced
     unsigned int _vaneSampleIdx;
+    unsigned int _vaneSampleCount;
     unsigned int _windDirBin[16];
+    unsigned int _windDirWindow[16]; //Sum of the 5 bins starting at every bin
+    long _windDirX;             //Sum of the unit vectors of the samples (VANE_VECTOR_ONE), North is +x, East +y
+    long _windDirY;
+    VaneAveraging _vaneAveraging;
+    VaneThresholds _vaneThresholds;
 
-    unsigned int _gust[30]; //Array of 50 wind speed values to calculate maximum gust speed.
-    unsigned int _gustIdx;
+    //Rolling maximum of the speeds in the gust window: a deque of decreasing speeds with the number of the calculation
+    //interval they were measured in. The front is the gust.
+    unsigned int _gust[GUST_WINDOW_MAX];
+    unsigned long _gustTime[GUST_WINDOW_MAX];
+    unsigned int _gustHead;
+    unsigned int _gustCount;
+    unsigned long _gustClock;   //Number of the current calculation interval
+    unsigned int _gustWindow;
+
+    bool _gustWmo;
+    unsigned int _gustMean[GUST_WMO_SAMPLES]; //Last speeds for the WMO running mean
+    unsigned char _gustMeanIdx;
+
+    bool _hwCounter;        //Pulses are counted by TC3 instead of countAnemometer()
+    uint16_t _hwCount;      //TC3 count at the last calculation
+
+    //Period measurement: the edges of the last interval with their first and last timestamp
+    bool _periodMode;
+    bool _capture;          //Timestamps come from the TCC0 capture instead of micros()
+    bool _captureIrq;       //Capture interrupt enabled (off at high pulse rates)
+    volatile unsigned int _captureCount;
+    volatile unsigned long _captureFirst;
+    volatile unsigned long _captureLast;
+    unsigned int _edgeCount;
+    unsigned long _edgeFirst;
+    unsigned long _edgeLast;
+    unsigned long _edgeNow;
+    unsigned long _edgeRate;    //Timestamp ticks per second
+    unsigned long _edgeMask;    //Timestamps wrap at this mask
+    unsigned long _edgeRef;     //Last edge of an earlier interval, start of the first period in this one
+    bool _edgeRefValid;
+    unsigned int _edgeRefAge;
+    long _periodSpd;        //Last speed calculated from a period
 
     int _readWindDir();
     int _readWindSpd();
+    unsigned int _readPulses();
+    long _periodSpeed(unsigned int pulses);
+    void _startCapture();
+    void _enableCapture(bool enable);
+    void _updateGust(unsigned int spd);
+
 
+    void _changeBin(unsigned char bin, bool add);
+    void _rebuildBins();
 
-    void _setBin(unsigned int windVane);
+    void _anemometerEdge();
+    void _rainTip();
+    void _readRain();
+    template <unsigned char SLOT>
+    static void _anemometerIsr();
+    template <unsigned char SLOT>
+    static void _rainIsr();
+    template <size_t... SLOTS>
+    static ADSWeatherIsr _slotIsr(unsigned char slot, bool rain, std::index_sequence<SLOTS...>);
 
 };
 
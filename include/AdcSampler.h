@@ -0,0 +1,64 @@
+/**********************************************************
+** @file		AdcSampler.h
+**
+** Background sampling of the wind vane and the turbine
+** voltage. TC5 triggers one ADC conversion at a fixed rate
+** through the event system, the ADC scans over the two
+** inputs and the DMAC stores the results alternately in two
+** blocks. While the DMAC fills one block the other one can
+** be read with read(). The two analog pins must be on
+** neighbouring ADC inputs (A1 = AIN10, A2 = AIN11 on the
+** MKR Zero). Every result can be the hardware average of
+** up to 16 conversions (averaging = log2 of the count, up to
+** ADC_SAMPLER_MAX_AVERAGING), the result stays 12 bit.
+** While the sampler runs analogRead() must not
+** be used. Without PLATFORM_SAMD21 begin() returns false and
+** the caller has to fall back to analogRead().
+**
+
+*/
+
+#ifndef AdcSampler_h
+#define AdcSampler_h
+
+#include "Arduino.h"
+
+// Sample pairs (vane + voltage) in one block
+#ifndef ADC_SAMPLER_BLOCK
+#define ADC_SAMPLER_BLOCK 10
+#endif
+// Largest averaging that keeps 12 bit results, the ADC only divides the accumulated sum by up to 16
+#define ADC_SAMPLER_MAX_AVERAGING 4
+
+
+class AdcSampler
+{
+public:
+    AdcSampler();
+
+    bool begin(int vanePin, int voltagePin, unsigned int rate, unsigned char averaging = 0);
+    void end();
+    bool running();
+
+    bool available();
+    unsigned int read(unsigned int *vane, unsigned int *voltage);
+    unsigned int latestVoltage();
+
+    unsigned long getBlocks();
+    unsigned long getOverruns();
+
+    static void blockComplete(unsigned char flags);
+
+private:
+    bool _running;
+    unsigned char _next;    // Block the DMAC completes next
+    volatile unsigned char _ready; // Completed block, 0xFF if none is waiting
+    volatile unsigned long _blocks;
+    volatile unsigned long _overruns;
+
+    uint16_t _buffer[2][ADC_SAMPLER_BLOCK * 2];
+    unsigned int _latestVoltage;
+};
+
+
+#endif
@@ -0,0 +1,119 @@
+/**********************************************************
+** @file		Aggregator.h
+**
+** Statistics of the wind and the harvested power over
+** longer periods (tiers, e.g. 1 min and 10 min), so the log
+** can carry summaries instead of or besides the rows of
+** every second. Fed once per calculation interval (second)
+** with the speed, gust, vane histogram and rain of
+** ADSWeather and the MPPT power, every tier keeps only
+** running sums in constant memory:
+**  speed and power  mean and standard deviation (Welford),
+**                   the turbulence intensity is sd / mean
+**  gust             highest gust of the period
+**  direction        vector mean of the vane samples, every
+**                   sample adds the unit vector of its bin,
+**                   so North is the mean of 350 and 10 degrees,
+**                   and the steadiness, the length of the mean
+**                   vector (see ADSWeather::getWindSteadiness())
+**  energy, rain     sums
+** The running periods can be saved in a flash snapshot (see
+** Checkpoint.h) and continue after a reset.
+** The tiers are aligned to the clock, a 10 min tier closes
+** when the epoch is a multiple of 600. A period that started
+** after a reset or was cut by setting the clock has less
+** samples than seconds.
+**
+
+*/
+
+#ifndef Aggregator_h
+#define Aggregator_h
+
+#include "Arduino.h"
+
+class Checkpoint;
+
+// Largest number of tiers
+#ifndef AGGREGATOR_MAX_TIERS
+#define AGGREGATOR_MAX_TIERS 4
+#endif
+
+//Mean and variance of a series in one pass, numerically stable also for long series of similar values.
+struct RunningStats
+{
+    unsigned long count;
+    float mean;
+    float m2;           // Sum of the squared deviations from the mean
+
+    void clear();
+    void add(float x);
+    float stdDev() const;
+};
+
+//Statistics of one completed period of a tier.
+struct AggregateSummary
+{
+    unsigned int period;        // Seconds of the tier
+    unsigned long epoch;        // End of the period
+    unsigned int samples;       // Seconds with a measurement
+    float speedMean;            // km/h
+    float speedStdDev;          // km/h
+    float gustMax;              // km/h
+    int direction;              // Degrees, -1 without vane samples
+    float steadiness;           // 1 if all vane samples point the same way, towards 0 the more they scatter
+    float powerMean;            // W
+    float powerStdDev;          // W
+    float powerMax;             // Highest mean power of a second, W
+    float energy;               // Wh
+    unsigned int rainTips;
+};
+
+
+class Aggregator
+{
+public:
+    Aggregator();
+
+    bool addTier(unsigned int seconds);
+    unsigned char tiers();
+
+    void addPower(float power);
+    void addSecond(unsigned long epoch, int windSpeedX10, int windGustX10, long dirX, long dirY,
+                   unsigned int dirSamples, unsigned int rainTips);
+
+    bool getSummary(unsigned char tier, AggregateSummary &summary);
+
+    bool load(Checkpoint &checkpoint);
+    bool save(Checkpoint &checkpoint);
+
+private:
+    struct Tier
+    {
+        unsigned int period;
+        unsigned long block;        // epoch / period of the running period
+        RunningStats speed;
+        RunningStats power;
+        unsigned int gustMax;       // 0.1 km/h
+        float powerMax;
+        int64_t dirX;               // Sum of the vane vectors of ADSWeather::getWindVector()
+        int64_t dirY;
+        unsigned long dirSamples;
+        float energy;               // Ws
+        unsigned int rainTips;
+        bool ready;                 // summary is complete and not yet fetched
+        AggregateSummary summary;
+    };
+
+    Tier _tier[AGGREGATOR_MAX_TIERS];
+    unsigned char _tiers;
+    float _powerSum;            // MPPT steps since the last second
+    unsigned int _powerCount;
+    float _powerLast;
+
+    void _clear(Tier &tier);
+    void _close(Tier &tier, unsigned long epoch);
+};
+
+
+#endif
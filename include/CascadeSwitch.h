@@ -0,0 +1,67 @@
+/**********************************************************
+** @file		CascadeSwitch.h
+**
+** Drives the eight MOSFETs of the resistor cascade. On the
+** SAMD21 the SET and CLR masks of every port group are taken
+** from two 16 entry tables (one per nibble of the pattern)
+** that are built in begin(), and written through the single
+** cycle IOBUS:
+**  CASCADE_SWITCH_ATOMIC            one OUTTGL write per port
+**                                   group, all MOSFETs of the
+**                                   group switch at once
+**  CASCADE_SWITCH_BREAK_BEFORE_MAKE OUTCLR of the MOSFETs that
+**                                   turn off, then OUTSET of
+**                                   the ones that turn on; in
+**                                   between the cascade only
+**                                   has a higher resistance
+** Only pins of the cascade are touched, other pins of the
+** same group keep their level. Pins in different groups are
+** switched one group after the other (all MOSFETs of the MKR
+** Zero are on PORTA). Other platforms use digitalWrite().
+**
+
+*/
+
+#ifndef CascadeSwitch_h
+#define CascadeSwitch_h
+
+#include "Arduino.h"
+#include "Platform.h"
+
+#define CASCADE_SWITCH_PINS 8
+// Port groups the pins can be spread over
+#define CASCADE_SWITCH_GROUPS 2
+
+enum CascadeSwitchMode
+{
+    CASCADE_SWITCH_ATOMIC,
+    CASCADE_SWITCH_BREAK_BEFORE_MAKE
+};
+
+
+class CascadeSwitch
+{
+public:
+    CascadeSwitch();
+
+    void begin(const char *pins, CascadeSwitchMode mode = CASCADE_SWITCH_ATOMIC);
+    void setMode(CascadeSwitchMode mode);
+    void write(uint8_t pattern);
+    uint8_t read();
+
+private:
+    const char *_pins;
+    CascadeSwitchMode _mode;
+    uint8_t _pattern;
+
+#ifdef PLATFORM_SAMD21
+    uint8_t _groups;
+    uint8_t _group[CASCADE_SWITCH_GROUPS];      // Port group number
+    uint32_t _all[CASCADE_SWITCH_GROUPS];       // All cascade pins of the group
+    uint32_t _low[CASCADE_SWITCH_GROUPS][16];   // Pins of the group for bits 0..3 of the pattern
+    uint32_t _high[CASCADE_SWITCH_GROUPS][16];  // Pins of the group for bits 4..7 of the pattern
+#endif
+};
+
+
+#endif
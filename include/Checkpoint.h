@@ -0,0 +1,104 @@
+/**********************************************************
+** @file		Checkpoint.h
+**
+** Snapshot of the state of the sketch in the internal flash,
+** so a reset (watchdog, brown-out, button) continues from the
+** last snapshot instead of starting over. The SAMD21G18 has
+** no RWW EEPROM section, so an area of the main flash is
+** reserved, CHECKPOINT_SLOTS slots of CHECKPOINT_SLOT_ROWS
+** rows (256 bytes) each. The slots are used in turn, which
+** spreads the erase cycles: every snapshot erases the rows it
+** needs of the oldest slot, writes the data page by page and
+** last a trailer with sequence number and CRC. A snapshot that was
+** cut by a reset has no valid trailer, the one before it
+** stays the newest.
+** The data is written and read in pieces by the modules (see
+** LoadCache::save(), Aggregator::save()), in the same order.
+**  start()           starts over in the next slot
+**  write(data, len)  appends
+**  finish()          makes it the newest snapshot
+**  begin(layout)     finds the newest snapshot after a reset
+**  read(data, len)   reads it in the order it was written
+** Writing or erasing the flash stalls the CPU and the
+** interrupts for about 6 ms per row and 3 ms per page, the
+** rows of a slot are erased as the data reaches them. The
+** area is part of the firmware image, uploading a new one
+** erases it. Other platforms keep the area in RAM, which is
+** enough for the simulation.
+**
+
+*/
+
+#ifndef Checkpoint_h
+#define Checkpoint_h
+
+#include "Arduino.h"
+#include "Platform.h"
+
+#define CHECKPOINT_MAGIC "WTCP"
+
+// Page and row size of the SAMD21 flash, a row is the smallest unit that can be erased
+#define CHECKPOINT_PAGE_SIZE 64
+#define CHECKPOINT_ROW_SIZE 256
+
+// Number of slots and rows per slot, 8 slots of 2 kB by default
+#ifndef CHECKPOINT_SLOTS
+#define CHECKPOINT_SLOTS 8
+#endif
+#ifndef CHECKPOINT_SLOT_ROWS
+#define CHECKPOINT_SLOT_ROWS 8
+#endif
+#define CHECKPOINT_SLOT_SIZE (CHECKPOINT_SLOT_ROWS * CHECKPOINT_ROW_SIZE)
+// Data per snapshot, the last page of a slot holds the trailer
+#define CHECKPOINT_DATA_MAX (CHECKPOINT_SLOT_SIZE - CHECKPOINT_PAGE_SIZE)
+
+struct __attribute__((packed)) CheckpointTrailer
+{
+    char magic[4];          // CHECKPOINT_MAGIC
+    uint16_t layout;        // Layout version of the data, given by the sketch
+    uint16_t size;          // Bytes of data
+    uint32_t sequence;      // Counts the snapshots, the highest valid one is the newest
+    uint16_t crc;           // CRC16 of data and the trailer fields before it
+};
+
+
+class Checkpoint
+{
+public:
+    Checkpoint();
+
+    bool begin(uint16_t layout);
+    bool read(void *data, unsigned int len);
+
+    void start();
+    bool write(const void *data, unsigned int len);
+    bool finish();
+
+    unsigned long getSequence();
+    unsigned long getSaved();
+
+private:
+    uint16_t _layout;
+    int _newest;                // Slot of the newest valid snapshot, -1 if there is none
+    uint32_t _sequence;         // Sequence number of the newest snapshot
+    unsigned long _saved;       // Snapshots written since begin()
+
+    unsigned int _readOffset;
+    unsigned int _readSize;
+
+    int _writeSlot;             // -1 outside of start() ... finish()
+    unsigned int _writeOffset;
+    unsigned int _erasedRows;   // Rows of the slot erased from the start, the trailer row is erased by start()
+    uint16_t _writeCrc;
+    uint8_t _page[CHECKPOINT_PAGE_SIZE];
+
+    bool _valid(unsigned int slot, CheckpointTrailer &trailer);
+    void _writePage(unsigned int slot, unsigned int offset);
+
+    static const volatile uint8_t *_slot(unsigned int slot);
+    static void _eraseRow(const volatile uint8_t *row);
+    static void _programPage(const volatile uint8_t *page, const uint8_t *data);
+};
+
+
+#endif
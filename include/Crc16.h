@@ -0,0 +1,36 @@
+/**********************************************************
+** @file		Crc16.h
+**
+** CRC-16/CCITT-FALSE (polynomial 0x1021, start 0xFFFF, no
+** reflection, no final xor), bitwise without a table. Several
+** buffers can be chained by passing the CRC of the previous
+** one as start value.
+**
+
+*/
+
+#ifndef Crc16_h
+#define Crc16_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_START 0xFFFF
+
+//Returns the CRC of len bytes, continued from crc.
+inline uint16_t crc16(const void *data, size_t len, uint16_t crc = CRC16_START)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    while (len--)
+    {
+        crc ^= (uint16_t) (*bytes++) << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x8000 ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+#endif
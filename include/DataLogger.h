@@ -0,0 +1,133 @@
+/**********************************************************
+** @file		DataLogger.h
+**
+** Buffered SD-Card logger. The log file is kept open and
+** records are collected in a RAM ring buffer. The buffer is
+** written to the card in whole 512 byte sectors (aligned to
+** the file offset) once one of the flush conditions is met:
+**  - a number of records has been buffered,
+**  - a time span has passed since the last flush or
+**  - the buffer is close to full.
+** Bytes that do not fill a complete sector stay in RAM until
+** the next flush, a forced flush (forceFlush()) or a
+** brown-out is detected (enableBrownoutFlush()). The
+** interrupt flushes at once if the card is free, otherwise
+** when the SdCardLock of the code on the card ends. At most
+** LOG_BUFFER_SIZE bytes can be lost on a sudden power loss.
+** A file can be created with its final size allocated in one
+** contiguous piece, so the appends never walk or extend the
+** FAT chain, and with an index beside it: after every flush a
+** LogIndexEntry (see LogFormat.h) with the written size and
+** the time of the newest record, which lets a reader pick a
+** time range without scanning the file. close() cuts the
+** file to the written size, recover() does the same after a
+** reset for a file that wasn't closed.
+** With setDirectWrites() the sectors of a contiguous file on
+** FAT16/FAT32 go through SdDmaWriter instead of SdFat: a flush only starts
+** the DMA transfers and update() moves on sector by sector,
+** the ring buffer doubles as queue of the transfers. Nothing
+** waits for the card, a record that doesn't fit into a full
+** buffer is dropped (getDropped()) instead. A forced flush
+** also writes the incomplete sector, it is written again when
+** it is complete. The card is released for other files at
+** the end of every flush or with release().
+**
+
+*/
+
+#ifndef DataLogger_h
+#define DataLogger_h
+
+#include "Arduino.h"
+#include "SdCard.h"
+#include "SdDmaWriter.h"
+
+#define LOG_SECTOR_SIZE 512
+
+// Size of the RAM buffer in sectors, at least two so a new record always fits while a sector waits to be written.
+#ifndef LOG_BUFFER_SECTORS
+#define LOG_BUFFER_SECTORS 4
+#endif
+#define LOG_BUFFER_SIZE (LOG_SECTOR_SIZE * LOG_BUFFER_SECTORS)
+
+// BOD33 level for the brown-out warning, 44 equals roughly 2.97V on the SAMD21.
+#ifndef LOG_BROWNOUT_LEVEL
+#define LOG_BROWNOUT_LEVEL 44
+#endif
+// BOD33 level the detector resets the MCU at after the warning, the level the bootloader configures.
+#define LOG_BROWNOUT_RESET_LEVEL 39
+
+
+class DataLogger
+{
+public:
+    DataLogger();
+
+    bool begin(const char *fileName, const char *indexName = nullptr, unsigned long size = 0);
+    void close();
+    void setFlushPolicy(unsigned int maxRecords, unsigned long maxAge);
+    void setDirectWrites(bool enabled);
+    bool enableBrownoutFlush();
+
+    bool log(const char *record);
+    bool write(const void *data, unsigned int len);
+    void mark(unsigned long epoch);
+    void update();
+    void flush();
+    void forceFlush();
+    void release();
+
+    unsigned int buffered();
+    bool full();
+    bool direct();
+    unsigned long getOverruns();
+    unsigned long getDropped();
+    unsigned int getQueueMax();
+    unsigned long getWriteErrors();
+
+    static bool recover(const char *fileName, const char *indexName);
+    static void brownoutDetected();
+
+private:
+    FsFile _file;
+    FsFile _indexFile;
+    bool _open;
+    bool _indexed;
+
+    char _buffer[LOG_BUFFER_SIZE];
+    unsigned int _head;     // Next free byte in the ring
+    unsigned int _used;     // Bytes waiting to be written
+
+    unsigned long _filePos; // Bytes written to the file, to keep the writes sector aligned
+    unsigned long _size;    // Allocated size of the file, 0 for no limit
+    unsigned long _epoch;   // Time of the newest record, given by mark()
+    unsigned long _indexPos; // Written size of the last index entry
+
+    unsigned int _maxRecords;
+    unsigned long _maxAge;
+    unsigned int _records;  // Records since the last flush
+    unsigned long _lastFlush;
+
+    unsigned long _overruns; // Flushes forced by a full buffer
+    unsigned long _dropped; // Records that didn't fit while the sectors were on their way (direct writes)
+    unsigned int _queueMax; // Most complete sectors waiting at once
+
+    SdDmaWriter _writer;
+    bool _directWrites;     // Requested by setDirectWrites()
+    bool _direct;           // The open file is written through _writer
+    uint32_t _sector;       // First sector of the file
+    unsigned long _target;  // A flush writes up to here
+    unsigned long _written; // Bytes the card confirmed, _filePos plus the incomplete sector
+    unsigned int _inFlight; // Bytes of the sector in transfer, 0 if there is none
+    unsigned long _targetEpoch; // Newest record before _target, for the index
+
+    bool _append(const char *data, unsigned int len, bool newline);
+    void _put(const char *data, unsigned int len);
+    void _write(unsigned int len);
+    void _sync();
+    void _writeDirect(unsigned long target, bool wait);
+    void _index(unsigned long epoch, unsigned long offset);
+};
+
+
+#endif
@@ -0,0 +1,117 @@
+/**********************************************************
+** @file		Deadline.h
+**
+** Wrap-safe time comparisons and a drift-free periodic timer
+** for millis(), micros() or any other free running unsigned
+** long counter. Times are never compared directly (a > b
+** breaks when millis() wraps after 49.7 days), only their
+** difference is, interpreted as signed. This is correct as
+** long as the two times are less than half the counter range
+** (24.8 days for millis()) apart.
+** PeriodicTimer advances its deadline by the period (next =
+** deadline + period, not now + period), so the phase does
+** not drift with the lateness of the caller. If the caller
+** was late by whole periods the missed ones are skipped and
+** counted instead of firing in a burst.
+**
+
+*/
+
+#ifndef Deadline_h
+#define Deadline_h
+
+//Returns true if now is at or after the deadline.
+inline bool timeReached(unsigned long now, unsigned long deadline)
+{
+    return (long) (now - deadline) >= 0;
+}
+
+//Returns the time passed from then to now.
+inline unsigned long timeSince(unsigned long now, unsigned long then)
+{
+    return now - then;
+}
+
+
+class PeriodicTimer
+{
+public:
+    PeriodicTimer(unsigned long period = 0)
+    {
+        _period = period;
+        _deadline = 0;
+        _missed = 0;
+        _late = 0;
+    }
+
+    //Sets the first deadline offset after now.
+    void start(unsigned long now, unsigned long offset = 0)
+    {
+        _deadline = now + offset;
+    }
+
+    //Moves the deadline by ticks, e.g. to make a deadline set relative to 0 relative to a start time.
+    void shift(unsigned long ticks)
+    {
+        _deadline += ticks;
+    }
+
+    //Returns true once per period when the deadline has been reached and advances it.
+    bool expired(unsigned long now)
+    {
+        unsigned long late = now - _deadline;
+        if ((long) late < 0)
+        {
+            return false;
+        }
+        _late = late;
+        if (_period == 0)
+        {
+            return true;
+        }
+        if (late >= _period)
+        {
+            unsigned long missed = late / _period;
+            _missed += missed;
+            _deadline += missed * _period;
+        }
+        _deadline += _period;
+        return true;
+    }
+
+    void setPeriod(unsigned long period)
+    {
+        _period = period;
+    }
+
+    unsigned long getPeriod() const
+    {
+        return _period;
+    }
+
+    unsigned long getDeadline() const
+    {
+        return _deadline;
+    }
+
+    //Returns the number of periods that were skipped because the caller was late by a whole period.
+    unsigned long getMissed() const
+    {
+        return _missed;
+    }
+
+    //Returns how late the last expiry was noticed.
+    unsigned long getLate() const
+    {
+        return _late;
+    }
+
+private:
+    unsigned long _period;
+    unsigned long _deadline;
+    unsigned long _missed;
+    unsigned long _late;
+};
+
+
+#endif
@@ -0,0 +1,38 @@
+/**********************************************************
+** @file		DmaController.h
+**
+** Shared access to the SAMD21 DMAC. The descriptor and
+** write-back memory for all channels in Platform.h is owned
+** here, and the DMAC interrupt is dispatched to a callback
+** per channel. Only available if PLATFORM_SAMD21 is set.
+**
+
+*/
+
+#ifndef DmaController_h
+#define DmaController_h
+
+#include "Arduino.h"
+#include "Platform.h"
+
+#ifdef PLATFORM_SAMD21
+
+typedef void (*DmaCallback)(unsigned char flags);
+
+
+class DmaController
+{
+public:
+    static void begin();
+    static DmacDescriptor *descriptor(unsigned char channel);
+    static void configure(unsigned char channel, unsigned char trigger, DmaCallback callback);
+    static void enable(unsigned char channel);
+    static void disable(unsigned char channel);
+    static bool busy(unsigned char channel);
+
+    static void handleInterrupt();
+};
+
+#endif
+
+#endif
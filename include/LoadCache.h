@@ -0,0 +1,93 @@
+/**********************************************************
+** @file		LoadCache.h
+**
+** Learned optimal load of the turbine per wind speed. The
+** wind speed is split into buckets of LOAD_CACHE_WIDTH, for
+** every bucket the state with the highest power seen so far
+** is kept. The stored power decays with every update, so a
+** state measured in a lucky gust is replaced after a while
+** by what the turbine really delivers. When the wind moves to
+** another bucket the MPPT can jump to the cached state and
+** only has to refine locally.
+** The cache can be saved to and loaded from the SD-Card or a
+** flash snapshot (see Checkpoint.h), one with a wrong
+** layout, state order or checksum is ignored.
+**
+
+*/
+
+#ifndef LoadCache_h
+#define LoadCache_h
+
+#include "Arduino.h"
+#include "SdCard.h"
+#include "LoadCascade.h"
+
+class Checkpoint;
+
+#define LOAD_CACHE_MAGIC "WTLC"
+#define LOAD_CACHE_VERSION 1
+
+// Number of buckets, faster wind ends up in the last one
+#ifndef LOAD_CACHE_BUCKETS
+#define LOAD_CACHE_BUCKETS 64
+#endif
+// Width of a bucket in 0.1 km/h
+#ifndef LOAD_CACHE_WIDTH
+#define LOAD_CACHE_WIDTH 10
+#endif
+// The wind has to leave the current bucket by this much (0.1 km/h) before a new bucket is entered
+#ifndef LOAD_CACHE_HYSTERESIS
+#define LOAD_CACHE_HYSTERESIS 3
+#endif
+// Factor the stored power decays with per update of its bucket, 0.999 halves it in ~700 updates
+#ifndef LOAD_CACHE_DECAY
+#define LOAD_CACHE_DECAY 0.999f
+#endif
+
+
+struct __attribute__((packed)) LoadCacheEntry
+{
+    float power;        // Decayed best power (W), 0 if the bucket is empty
+    uint8_t state;      // State the power was measured with
+};
+
+struct __attribute__((packed)) LoadCacheHeader
+{
+    char magic[4];      // LOAD_CACHE_MAGIC
+    uint8_t version;    // LOAD_CACHE_VERSION
+    uint8_t buckets;    // LOAD_CACHE_BUCKETS
+    uint8_t width;      // LOAD_CACHE_WIDTH
+    uint8_t order;      // LOAD_ORDER the states belong to
+    uint16_t checksum;  // Sum of all entry bytes
+};
+
+
+class LoadCache
+{
+public:
+    LoadCache();
+
+    void clear();
+    void update(int windSpeedX10, int state, float power);
+    int lookup(int windSpeedX10);
+    bool enter(int windSpeedX10);
+
+    bool load(const char *fileName);
+    bool save(const char *fileName);
+    bool load(Checkpoint &checkpoint);
+    bool save(Checkpoint &checkpoint);
+    bool dirty();
+
+    static int bucket(int windSpeedX10);
+
+private:
+    LoadCacheEntry _entry[LOAD_CACHE_BUCKETS];
+    int _bucket;        // Bucket the wind is in, -1 before the first enter()
+    bool _dirty;        // Changed since the last load or save
+
+    uint16_t _checksum();
+};
+
+
+#endif
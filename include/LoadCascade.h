@@ -0,0 +1,156 @@
+/**********************************************************
+** @file		LoadCascade.h
+**
+** Model of the resistor cascade. Eight resistors are in
+** series, every one can be bridged by a MOSFET. Bit i of the
+** MOSFET pattern switches MOSFET i on. The resistance and
+** conductance of all 256 patterns are calculated at compile
+** time from the resistor values and the Rds(on) of the
+** MOSFETs (a bridged stage is Rds(on) parallel to its
+** resistor). The nominal values are powers of two; measured
+** values of a board can be set with build flags, e.g.
+**   build_flags = -DLOAD_R1=1.03 -DLOAD_R8=127.2
+** The MPPT works on states 0..255, LOAD_ORDER selects which
+** pattern a state switches (pattern()):
+**  LOAD_ORDER_BINARY  the state is the pattern. With ideal
+**                     resistors the resistance falls with
+**                     the state, but a step can toggle all
+**                     MOSFETs (127 -> 128)
+**  LOAD_ORDER_SORTED  the patterns sorted by falling
+**                     resistance, always monotonic, also with
+**                     measured resistor values
+**  LOAD_ORDER_GRAY    reflected Gray code, neighbouring states
+**                     differ in one MOSFET. With binary
+**                     weighted resistors the resistance is
+**                     not monotonic: toggling MOSFET i always
+**                     changes it by R(i+1), so 127 -> 128 still
+**                     jumps by 128 Ohm and the power over the
+**                     state has local maxima
+** One MOSFET per step and a monotonic resistance exclude each
+** other for a binary weighted cascade. The binary and sorted
+** orders toggle two MOSFETs per step on average and the
+** switching itself is glitch-free (CascadeSwitch), so they
+** are the orders for the hill climb. State 0 is the highest
+** resistance in every order, state 255 the lowest in the
+** binary and sorted order.
+**
+
+*/
+
+#ifndef LoadCascade_h
+#define LoadCascade_h
+
+#include "Arduino.h"
+
+#define LOAD_STAGES 8
+#define LOAD_STATES 256
+
+// Resistance (Ohm) of the stages, nominal 2^i
+#ifndef LOAD_R1
+#define LOAD_R1 1.0
+#endif
+#ifndef LOAD_R2
+#define LOAD_R2 2.0
+#endif
+#ifndef LOAD_R3
+#define LOAD_R3 4.0
+#endif
+#ifndef LOAD_R4
+#define LOAD_R4 8.0
+#endif
+#ifndef LOAD_R5
+#define LOAD_R5 16.0
+#endif
+#ifndef LOAD_R6
+#define LOAD_R6 32.0
+#endif
+#ifndef LOAD_R7
+#define LOAD_R7 64.0
+#endif
+#ifndef LOAD_R8
+#define LOAD_R8 128.0
+#endif
+#define LOAD_ORDER_BINARY 0
+#define LOAD_ORDER_SORTED 1
+#define LOAD_ORDER_GRAY 2
+// Order of the states, set with a build flag, e.g. -DLOAD_ORDER=LOAD_ORDER_GRAY
+#ifndef LOAD_ORDER
+#define LOAD_ORDER LOAD_ORDER_BINARY
+#endif
+
+// Resistance (Ohm) of a MOSFET that is switched on
+#ifndef LOAD_RDS_ON
+#define LOAD_RDS_ON 0.02
+#endif
+
+struct LoadTable
+{
+    uint8_t pattern[LOAD_STATES];
+    float resistance[LOAD_STATES];
+    float conductance[LOAD_STATES];
+};
+
+//Calculates MOSFET pattern, resistance and conductance of every state, usable at compile time.
+constexpr LoadTable makeLoadTable(const double (&resistor)[LOAD_STAGES], double rdsOn, int order)
+{
+    double patternResistance[LOAD_STATES] = {};
+    for (unsigned int pattern = 0; pattern < LOAD_STATES; pattern++)
+    {
+        double resistance = 0;
+        for (unsigned char i = 0; i < LOAD_STAGES; i++)
+        {
+            if (pattern & (1U << i))
+            {
+                resistance += resistor[i] * rdsOn / (resistor[i] + rdsOn);
+            }
+            else
+            {
+                resistance += resistor[i];
+            }
+        }
+        patternResistance[pattern] = resistance;
+    }
+
+    LoadTable table = {};
+    for (unsigned int state = 0; state < LOAD_STATES; state++)
+    {
+        unsigned int pattern = state;
+        if (order == LOAD_ORDER_GRAY)
+        {
+            pattern = state ^ (state >> 1);
+        }
+        else if (order == LOAD_ORDER_SORTED)
+        {
+            // Insertion sort by falling resistance, equal resistances keep the binary order.
+            unsigned int i = state;
+            while (i > 0 && patternResistance[table.pattern[i - 1]] < patternResistance[pattern])
+            {
+                table.pattern[i] = table.pattern[i - 1];
+                i--;
+            }
+            table.pattern[i] = pattern;
+            continue;
+        }
+        table.pattern[state] = pattern;
+    }
+    for (unsigned int state = 0; state < LOAD_STATES; state++)
+    {
+        double resistance = patternResistance[table.pattern[state]];
+        table.resistance[state] = (float) resistance;
+        table.conductance[state] = (float) (1.0 / resistance);
+    }
+    return table;
+}
+
+
+class LoadCascade
+{
+public:
+    static uint8_t pattern(int state);
+    static float resistance(int state);
+    static float conductance(int state);
+    static float power(float voltage, int state);
+};
+
+
+#endif
@@ -0,0 +1,65 @@
+/**********************************************************
+** @file		LogFormat.h
+**
+** Layout of the binary datalog. A file is a sequence of
+** fixed size LogRecords. Every file starts with a LogHeader
+** that carries the format version and the calibration
+** constants needed to convert the raw values, so a file
+** stays readable when the jumper or the firmware changes.
+** Both structs are little endian and packed, the header is
+** shared with the host decoder in tools/log2csv.cpp.
+** Version 2 appended the rain gauge: rainPerTip to the
+** header and the tips of the interval to the record. New
+** fields are only ever appended, so an older file is read by
+** zeroing the structs and reading the sizes of its version.
+** Every log file, CSV or binary, has an index beside it, a
+** sequence of LogIndexEntries appended at every flush.
+**
+
+*/
+
+#ifndef LogFormat_h
+#define LogFormat_h
+
+#include <stdint.h>
+
+#define LOG_MAGIC "WTLG"
+#define LOG_VERSION 2
+
+// Sizes of the structs in version 1, before the rain gauge
+#define LOG_HEADER_SIZE_V1 20
+#define LOG_RECORD_SIZE_V1 17
+
+struct __attribute__((packed)) LogHeader
+{
+    char magic[4];          // LOG_MAGIC, without terminating zero
+    uint16_t version;       // LOG_VERSION
+    uint16_t recordSize;    // sizeof(LogRecord)
+    float voltageDivider;   // VOLTAGE_DIVIDER of the measurement jumper
+    float adcReference;     // ADC reference voltage
+    uint16_t adcMax;        // Highest ADC reading (4095 for 12 bit)
+    uint16_t interval;      // ms between two records
+    float rainPerTip;       // mm of rain per tip of the gauge (version 2)
+};
+
+struct __attribute__((packed)) LogRecord
+{
+    uint32_t epoch;         // RTC seconds since 1.1.1970
+    uint16_t windSpeed;     // 0.1 km/h
+    uint16_t windGust;      // 0.1 km/h
+    uint16_t windDirection; // Degrees
+    uint32_t power;         // Microwatt
+    uint8_t state;          // MOSFET state of the cascade
+    uint16_t voltage;       // Raw ADC reading of the measurement pin
+    uint16_t rain;          // Tips of the rain gauge in the interval (version 2)
+};
+
+// Every record that starts before offset is from epoch or earlier, every record logged after the entry from epoch or
+// later. The records older than epoch are complete before the offset of the next entry.
+struct __attribute__((packed)) LogIndexEntry
+{
+    uint32_t epoch;         // RTC seconds of the newest record at the flush
+    uint32_t offset;        // Bytes of the file written at the flush
+};
+
+#endif
@@ -0,0 +1,123 @@
+/**********************************************************
+** @file		Mppt.h
+**
+** Maximum power point tracking on the resistor cascade. All
+** strategies share the interface of MpptBase and work on the
+** cascade state (0 = highest, 255 = lowest resistance):
+**  PerturbObserve          climb by one state, turn around
+**                          when the power drops (the classic
+**                          hill climb of the sketch)
+**  AdaptiveStep            perturb and observe with a step
+**                          proportional to dP/dstate
+**  IncrementalConductance  compares dI/dU with -I/U of the
+**                          last two operating points
+** A strategy is picked at compile time (MPPT_STRATEGY in the
+** sketch). Independent of the strategy windUpdate() can move
+** the state to an estimate from the wind speed when it
+** changes by more than MPPT_GUESS_DELTA.
+** With setNoise() the strategies get a deadband: changes of
+** the power (or voltage) within MPPT_NOISE_SIGMA standard
+** deviations of the difference of two measurements keep the
+** state instead of stepping on noise.
+**
+
+*/
+
+#ifndef Mppt_h
+#define Mppt_h
+
+#include "Arduino.h"
+
+#define MPPT_STATE_MIN 0
+#define MPPT_STATE_MAX 255
+
+// Largest step of the adaptive strategies
+#ifndef MPPT_MAX_STEP
+#define MPPT_MAX_STEP 32
+#endif
+// Step of the adaptive strategy per relative power change per state
+#ifndef MPPT_ADAPTIVE_GAIN
+#define MPPT_ADAPTIVE_GAIN 200.0f
+#endif
+// Relative tolerance for dI/dU == -I/U of the incremental conductance
+#ifndef MPPT_INC_TOLERANCE
+#define MPPT_INC_TOLERANCE 0.02f
+#endif
+// The optimal load of the generator falls with the rotor speed, R = MPPT_GUESS_K / wind speed (Ohm * km/h). Fit this
+// from the logs of the turbine.
+#ifndef MPPT_GUESS_K
+#define MPPT_GUESS_K 200.0f
+#endif
+// Change of the wind speed (0.1 km/h) that makes windUpdate() jump to a new estimate
+#ifndef MPPT_GUESS_DELTA
+#define MPPT_GUESS_DELTA 30
+#endif
+// Width of the deadband in standard deviations of the difference of two measurements
+#ifndef MPPT_NOISE_SIGMA
+#define MPPT_NOISE_SIGMA 2.0f
+#endif
+
+
+class MpptBase
+{
+public:
+    MpptBase();
+
+    void begin(int state, bool risingRes = true);
+    int getState();
+    bool getRisingRes();
+    void jumpTo(int state);
+    bool windUpdate(int windSpeedX10);
+    void setNoise(float voltageNoise);
+
+    static int guessState(int windSpeedX10);
+
+    unsigned long getSteps();
+    unsigned long getMoves();
+    unsigned long getHolds();
+
+protected:
+    int _state;
+    bool _risingRes;        //Searching towards higher resistance (lower state)
+    bool _first;            //No previous operating point to compare with
+    float _oldPower;
+    float _oldVoltage;
+    int _oldState;
+    int _guessWind;         //Wind speed of the last estimate
+    float _voltageNoise;    //Standard error of a voltage measurement, 0 disables the deadband
+
+    unsigned long _steps;
+    unsigned long _moves;
+    unsigned long _holds;
+
+    int _move(int delta);
+    int _probe();
+    void _remember(float power, float voltage);
+    int _hold();
+    float _voltageDeadband();
+    bool _significant(float power, float voltage);
+};
+
+
+class PerturbObserve : public MpptBase
+{
+public:
+    int step(float power, float voltage);
+};
+
+
+class AdaptiveStep : public MpptBase
+{
+public:
+    int step(float power, float voltage);
+};
+
+
+class IncrementalConductance : public MpptBase
+{
+public:
+    int step(float power, float voltage);
+};
+
+
+#endif
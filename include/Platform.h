@@ -0,0 +1,36 @@
+/**********************************************************
+** @file		Platform.h
+**
+** Selects the register level backends. Everything that
+** talks to SAMD21 peripherals directly is only compiled if
+** PLATFORM_SAMD21 is defined, other targets fall back to the
+** plain Arduino API.
+**
+
+*/
+
+#ifndef Platform_h
+#define Platform_h
+
+#if defined(ARDUINO_ARCH_SAMD) && !defined(__SAMD51__)
+#define PLATFORM_SAMD21
+#endif
+
+// Peripherals claimed by the register level backends
+//  TC3     ADSWeather hardware anemometer counter
+//  TCC0    ADSWeather anemometer edge timestamps (period measurement)
+//  TC4     Scheduler tick
+//  TC5     AdcSampler conversion trigger
+//  NVMCTRL Checkpoint snapshots in the flash
+//  SERCOM4 SD-Card (SPI1 of the MKR Zero), SdDmaWriter feeds it by DMA besides SdFat
+
+// DMAC channels
+#define DMA_CHANNEL_ADC 0
+#define DMA_CHANNEL_SD 1
+#define DMA_CHANNELS 2
+
+// Event system channels
+#define EVSYS_CHANNEL_ADC 0
+#define EVSYS_CHANNEL_ANEMOMETER 1
+
+#endif
@@ -0,0 +1,70 @@
+/**********************************************************
+** @file		PowerCurve.h
+**
+** Power curve of the turbine measured on the device, in
+** wind speed bins of 0.5 m/s centred on multiples of 0.5 m/s
+** like IEC 61400-12 (bin 2 holds 0.75 to 1.25 m/s). Every
+** MPPT step adds its power and State to the bin of the wind
+** speed of the last calculation, every bin keeps the count,
+** mean and highest power and the mean State, in constant
+** memory and time. Besides the curve the harvested energy
+** and the measured time are integrated, so the capacity
+** factor is energy / (rated power * time). The wind speed of
+** a bin is the speed of the anemometer, the air density is
+** not normalized.
+** The curve can be saved in a flash snapshot (see
+** Checkpoint.h) and continues after a reset.
+**
+
+*/
+
+#ifndef PowerCurve_h
+#define PowerCurve_h
+
+#include "Arduino.h"
+
+class Checkpoint;
+
+// Width of a bin in 0.1 km/h, 18 is 0.5 m/s
+#define POWER_CURVE_BIN_WIDTH 18
+// Number of bins, up to 19.75 m/s, faster wind ends up in the last one
+#ifndef POWER_CURVE_BINS
+#define POWER_CURVE_BINS 40
+#endif
+
+struct __attribute__((packed)) PowerCurveBin
+{
+    uint32_t count;         // MPPT steps in the bin
+    float powerMean;        // W
+    float powerMax;         // W
+    float stateMean;        // Mean State of the cascade
+};
+
+
+class PowerCurve
+{
+public:
+    PowerCurve();
+
+    void clear();
+    void add(int windSpeedX10, float power, int state, unsigned int ms);
+
+    bool getBin(unsigned char bin, PowerCurveBin &out);
+    float getEnergy();
+    float getHours();
+    float getCapacityFactor(float ratedPower);
+
+    bool load(Checkpoint &checkpoint);
+    bool save(Checkpoint &checkpoint);
+
+    static unsigned char bin(int windSpeedX10);
+    static float binSpeed(unsigned char bin);
+
+private:
+    PowerCurveBin _bin[POWER_CURVE_BINS];
+    uint64_t _energy;       // mJ
+    uint64_t _time;         // ms
+};
+
+
+#endif
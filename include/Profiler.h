@@ -0,0 +1,144 @@
+/**********************************************************
+** @file		Profiler.h
+**
+** Cycle counts of the sections of the sketch, the period of
+** loop() and the latency of the anemometer capture interrupt.
+** Everything is compiled only with the build flag -D
+** PROFILING (it has to reach every file, a #define in
+** main.cpp does not), without it the PROFILE_ macros are
+** empty and no code or RAM is used.
+**  PROFILE_SCOPE(section)  counts the cycles until the end of
+**                          the enclosing block: min, max and
+**                          mean per section
+**  PROFILE_LOOP()          at the start of loop(), histogram
+**                          of the time between two calls in
+**                          powers of two of a microsecond
+**  PROFILE_LATENCY(cycles) from an ISR, worst case and mean
+**                          of the latency it measured
+** The cycles are read from SysTick on the SAMD21 (the 1 ms
+** interrupt of the core plus the down counter, 48 per us),
+** the cost of reading the counter is measured in begin() and
+** subtracted. The latency of the anemometer edge is measured
+** by ADSWeather in the TCC0 capture interrupt, capture value
+** against counter, so only with the hardware counter and
+** period mode and in steps of 256 cycles.
+** report() formats the results line by line, the sketch
+** writes them to Serial or into the log.
+**
+
+*/
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#ifdef PROFILING
+
+#include "Arduino.h"
+#include "Platform.h"
+#include "RecordFormatter.h"
+
+// Largest number of sections
+#ifndef PROFILER_SECTIONS
+#define PROFILER_SECTIONS 8
+#endif
+// Bins of the loop period histogram, bin i counts periods from 2^i to 2^(i+1) us, the last one everything above
+#define PROFILER_HISTOGRAM_BINS 16
+// Bins per line of the report
+#define PROFILER_BINS_PER_LINE 8
+
+#define PROFILE_SCOPE(section) ProfileScope _profileScope(section)
+#define PROFILE_LOOP() Profiler::loop()
+#define PROFILE_LATENCY(cycles) Profiler::latency(cycles)
+
+
+struct ProfileStats
+{
+    unsigned long count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+
+class Profiler
+{
+public:
+    static void begin(const char *const *names, unsigned char count);
+    static void reset();
+
+    static inline uint32_t cycles();
+    static void add(unsigned char section, uint32_t cycles);
+    static void loop();
+    static void latency(uint32_t cycles);
+
+    static const ProfileStats &getStats(unsigned char section);
+    static bool report(unsigned char line, RecordFormatter &out);
+
+private:
+    static const char *const *_names;
+    static unsigned char _count;
+    static uint32_t _overhead;          // Cycles of an empty scope
+    static ProfileStats _stats[PROFILER_SECTIONS];
+    static unsigned long _histogram[PROFILER_HISTOGRAM_BINS];
+    static uint32_t _lastLoop;
+    static bool _looped;                // _lastLoop is valid
+    static volatile unsigned long _latencyCount;
+    static volatile uint32_t _latencyMax;
+    static volatile uint64_t _latencyTotal;
+};
+
+
+//Returns the cycle counter, wraps after 89 s at 48 MHz. On the SAMD21 it is the millisecond count of the core times
+//the SysTick period plus the elapsed part of the current period. A tick that is pending but not yet counted is added,
+//so the result never runs backwards.
+inline uint32_t Profiler::cycles()
+{
+#ifdef PLATFORM_SAMD21
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t ms = millis();
+    uint32_t value = SysTick->VAL;
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+    {
+        value = SysTick->VAL;
+        ms++;
+    }
+    __set_PRIMASK(primask);
+    uint32_t load = SysTick->LOAD;
+    return ms * (load + 1) + (load - value);
+#else
+    return micros() * (F_CPU / 1000000UL);
+#endif
+}
+
+
+//Counts the cycles from its construction to the end of the block.
+class ProfileScope
+{
+public:
+    ProfileScope(unsigned char section)
+    {
+        _section = section;
+        _start = Profiler::cycles();
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::add(_section, Profiler::cycles() - _start);
+    }
+
+private:
+    unsigned char _section;
+    uint32_t _start;
+};
+
+#else
+
+#define PROFILE_SCOPE(section)
+#define PROFILE_LOOP()
+#define PROFILE_LATENCY(cycles)
+
+#endif
+
+
+#endif
@@ -0,0 +1,47 @@
+/**********************************************************
+** @file		RecordFormatter.h
+**
+** Formats log records into a fixed buffer without any
+** dynamic allocation. Every emitter has a fixed upper bound
+** of digits, so the cost of one record is bounded by
+** RECORD_MAX_LENGTH characters. Output that does not fit is
+** cut off and reported by overflowed().
+**
+
+*/
+
+#ifndef RecordFormatter_h
+#define RecordFormatter_h
+
+#include "Arduino.h"
+
+#ifndef RECORD_MAX_LENGTH
+#define RECORD_MAX_LENGTH 96
+#endif
+
+
+class RecordFormatter
+{
+public:
+    RecordFormatter();
+
+    void clear();
+
+    void appendChar(char c);
+    void appendString(const char *s);
+    void appendInt(long value);
+    void appendUInt(unsigned long value);
+    void appendFixed(float value, unsigned char decimals = 2);
+
+    const char *c_str();
+    unsigned int length();
+    bool overflowed();
+
+private:
+    char _buffer[RECORD_MAX_LENGTH + 1];
+    unsigned int _length;
+    bool _overflow;
+};
+
+
+#endif
@@ -0,0 +1,82 @@
+/**********************************************************
+** @file		Scheduler.h
+**
+** Small cooperative scheduler for the periodic jobs of the
+** sketch. The time base is a 1 kHz tick from TC4 on the
+** SAMD21 (millis() on other targets). Tasks are run from
+** run() in the order they were added, so a task added
+** earlier has priority when several are due at once.
+** Every task has a PeriodicTimer (Deadline.h): deadlines
+** advance by the period (next = deadline + period) and are
+** compared wrap-safe. If a task could not be run for a whole
+** period (for example behind a slow SD write) the missed
+** slots are skipped and counted as overruns, so the task
+** keeps its phase instead of running in a burst.
+** With setIdleSleep() run() puts the CPU to sleep (WFI) when
+** no task is due. The SAMD21 sleeps in IDLE0, only the CPU
+** clock stops: the tick, the DMAC, the ADC, TCC0, the EIC and
+** the RTC keep running and every interrupt wakes the CPU, so
+** no sample is lost. Standby would stop GCLK0 and with it the
+** tick and the ADC trigger. The wake statistics count how
+** often a task ran right after a sleep and how long the CPU
+** slept.
+**
+
+*/
+
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include "Arduino.h"
+#include "Deadline.h"
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 10
+#endif
+
+typedef void (*TaskFunction)();
+
+struct Task
+{
+    const char *name;
+    TaskFunction function;
+    PeriodicTimer timer;     // Period and next run in ticks (ms), getMissed() counts the skipped slots
+    unsigned long runs;
+    unsigned long wakes;     // Runs directly after the CPU slept
+    unsigned long maxLate;   // Worst lateness in ticks
+};
+
+
+class Scheduler
+{
+public:
+    Scheduler();
+
+    void begin();
+    int addTask(const char *name, TaskFunction function, unsigned long period, unsigned long offset = 0);
+    void run();
+    void setIdleSleep(bool enable);
+
+    unsigned long now();
+    unsigned char taskCount();
+    const Task &getTask(unsigned char id);
+    unsigned long getSleeps();
+    unsigned long getSleepTime();
+
+    static void tick();
+
+private:
+    Task _tasks[SCHEDULER_MAX_TASKS];
+    unsigned char _count;
+
+    bool _idleSleep;
+    bool _woken;                // The CPU slept since the last pass over the tasks
+    unsigned long _sleeps;
+    unsigned long _sleepTime;   // Microseconds spent in sleep
+
+    bool _due();
+    void _sleep();
+};
+
+
+#endif
@@ -0,0 +1,54 @@
+/**********************************************************
+** @file		SdCard.h
+**
+** The SD-Card of the board, shared by the datalog and the
+** load cache. SdFat is used instead of the Arduino SD
+** library for the contiguous preallocation of the log files
+** (see DataLogger.h).
+** Code that uses SdFat holds an SdCardLock for the time it
+** needs the card. An interrupt that wants the card, the
+** brown-out flush of the log, hands its work to whenFree(),
+** which runs it at once if nobody holds a lock and otherwise
+** at the end of the outermost one. SdFat shares one cache
+** sector and the SPI transaction between all files, so it
+** must never be entered again from an interrupt.
+**
+
+*/
+
+#ifndef SdCard_h
+#define SdCard_h
+
+#include "Arduino.h"
+#include "Platform.h"
+#include <SdFat.h>
+
+// SPI clock of the card, the MKR Zero has it on its own SPI bus
+#ifndef SD_CARD_SPI_MHZ
+#define SD_CARD_SPI_MHZ 12
+#endif
+
+#ifdef PLATFORM_SAMD21
+// SERCOM of the SPI bus of the card and its DMA trigger, for the sector writes of SdDmaWriter
+#define SD_CARD_SERCOM SERCOM4
+#define SD_CARD_DMAC_ID_TX SERCOM4_DMAC_ID_TX
+#endif
+
+extern SdFat sd;
+
+//Marks the card as in use from its construction to the end of the block, locks can be nested.
+class SdCardLock
+{
+public:
+    SdCardLock();
+    ~SdCardLock();
+
+    static bool locked();
+    static void whenFree(void (*task)());
+
+private:
+    static volatile unsigned char _users;
+    static void (*volatile _deferred)();
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**********************************************************
+** @file		SdDmaWriter.h
+**
+** Writes whole sectors of a contiguous file straight to the
+** SD-Card without waiting. SdFat opens a multi block write
+** (CMD25) at the first sector, then every sector is handed
+** to the DMAC, which feeds the SERCOM of the card while the
+** CPU continues. ready() polls the transfer and afterwards
+** the busy signal of the card one byte at a time, it never
+** waits. The caller keeps the sector untouched until ready()
+** confirms it, so with a ring of several sectors the next
+** one is filled while the previous one is on its way.
+**  start(sector)  opens the multi block write
+**  ready()        true when the next sector can be written
+**  write(data)    starts the transfer of one sector
+**  stop()         waits for the last sector and releases the
+**                 card for SdFat
+** No other file may be written between start() and stop().
+** A sector the card rejects ends the write, failed() tells
+** the caller to fall back to SdFat. So does a sector the
+** card doesn't confirm in time: a card that stays busy or
+** was pulled out fails after SD_DMA_TIMEOUT ms or
+** SD_DMA_TIMEOUT_POLLS calls of ready(), the count also ends
+** the wait inside an interrupt, where millis() stands still.
+** The waits for the SERCOM are bounded the same way. Without PLATFORM_SAMD21
+** the sector goes through writeData() of SdFat, which waits
+** for the transfer but not for the programming, the busy
+** card is polled the same way (on the host the card of
+** SimHal).
+**
+
+*/
+
+#ifndef SdDmaWriter_h
+#define SdDmaWriter_h
+
+#include "Arduino.h"
+#include "Platform.h"
+
+#define SD_DMA_SECTOR_SIZE 512
+
+// A sector that isn't confirmed within this time or this many calls of ready() fails, the 250 ms the SD spec allows
+// for the programming plus the transfer. A poll of the busy card takes about 1.5 us.
+#ifndef SD_DMA_TIMEOUT
+#define SD_DMA_TIMEOUT 300
+#endif
+#ifndef SD_DMA_TIMEOUT_POLLS
+#define SD_DMA_TIMEOUT_POLLS 200000UL
+#endif
+// Reads of a SERCOM flag before a byte on the SPI bus counts as lost, a byte takes well below 100 of them
+#define SD_DMA_SPI_POLLS 1000
+
+
+class SdDmaWriter
+{
+public:
+    SdDmaWriter();
+
+    bool begin();
+    bool start(uint32_t sector);
+    bool ready();
+    bool write(const uint8_t *data);
+    bool stop();
+
+    bool active();
+    bool failed();
+
+    unsigned long getSectors();
+    unsigned long getErrors();
+
+private:
+    enum State
+    {
+        WRITER_IDLE,        // No multi block write open
+        WRITER_READY,       // Card waits for the next sector
+        WRITER_SENDING,     // DMAC transfers a sector
+        WRITER_BUSY         // Card programs the sector
+    };
+
+    bool _enabled;
+    State _state;
+    bool _failed;
+    unsigned long _sectors;     // Accepted by the card
+    unsigned long _errors;      // Rejected sectors
+    const uint8_t *_data;       // Sector of the transfer, for SdFat's writeData()
+    unsigned long _since;       // millis() when the sector was handed over
+    unsigned long _polls;       // Calls of ready() since then
+
+    bool _finishTransfer();
+    void _timeout();
+    static bool _sending();
+    static bool _cardBusy();
+    static uint8_t _transfer(uint8_t data);
+};
+
+
+#endif
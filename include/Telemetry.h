@@ -0,0 +1,60 @@
+/**********************************************************
+** @file		Telemetry.h
+**
+** Binary telemetry over Serial (USB CDC on the MKR Zero, at
+** full USB speed whatever the baud rate). send() encodes a
+** frame (see TelemetryFormat.h) into a RAM ring buffer and
+** returns at once, update() hands the buffer to Serial only
+** as far as availableForWrite() allows, so the tasks are
+** never blocked by a slow or missing host. A frame that does
+** not fit into the buffer is dropped and counted, while the
+** port is closed (no DTR) nothing is queued at all. The port
+** is checked with Serial.dtr(), the bool operator of the
+** SAMD core waits 10 ms on every call.
+**
+
+*/
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include "Arduino.h"
+#include "TelemetryFormat.h"
+
+// Size of the TX ring buffer (bytes), one MPPT frame takes 24 bytes
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE 1024
+#endif
+// Largest payload of a packet
+#define TELEMETRY_MAX_PAYLOAD 32
+// Largest encoded frame: header, payload and CRC, one COBS overhead byte per 254 and the delimiter
+#define TELEMETRY_MAX_FRAME (sizeof(TelemetryHeader) + TELEMETRY_MAX_PAYLOAD + 2 + 2)
+
+
+class Telemetry
+{
+public:
+    Telemetry();
+
+    void begin(unsigned long baud);
+    bool send(uint8_t type, const void *payload, unsigned int len);
+    void update();
+
+    unsigned long getSent();
+    unsigned long getDropped();
+
+    static unsigned int encode(const uint8_t *data, unsigned int len, uint8_t *out);
+
+private:
+    uint8_t _buffer[TELEMETRY_BUFFER_SIZE];
+    unsigned int _head;         // Next byte to queue
+    unsigned int _tail;         // Next byte to write to Serial
+    uint8_t _sequence;
+    unsigned long _sent;
+    unsigned long _dropped;
+
+    unsigned int _free();
+};
+
+
+#endif
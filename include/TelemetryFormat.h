@@ -0,0 +1,72 @@
+/**********************************************************
+** @file		TelemetryFormat.h
+**
+** Packets of the telemetry stream over USB Serial. Every
+** frame is
+**   COBS(TelemetryHeader, payload, CRC-16) 0x00
+** The CRC (Crc16.h, little endian) covers header and
+** payload. COBS removes every zero from the frame, so a zero
+** byte always ends a frame and a receiver that starts in the
+** middle or lost bytes resynchronizes on the next one. The
+** sequence number counts every frame that was queued, a gap
+** tells the receiver how many were dropped because the TX
+** buffer was full. All structs are little endian and packed,
+** they are shared with the host tool tools/telemetry.py.
+** New fields are only appended to a payload, a receiver
+** ignores the bytes it does not know.
+**
+
+*/
+
+#ifndef TelemetryFormat_h
+#define TelemetryFormat_h
+
+#include <stdint.h>
+
+#define TELEMETRY_MPPT 1
+#define TELEMETRY_WIND 2
+#define TELEMETRY_POWER_CURVE 3
+
+struct __attribute__((packed)) TelemetryHeader
+{
+    uint8_t type;           // TELEMETRY_MPPT, TELEMETRY_WIND, TELEMETRY_POWER_CURVE
+    uint8_t sequence;       // Number of the frame, wraps
+    uint32_t time;          // millis() when it was queued
+};
+
+// One step of the MPPT
+struct __attribute__((packed)) TelemetryMppt
+{
+    uint8_t state;          // State after the step
+    int8_t step;            // Change of the State, > 0 towards lower resistance, 0 held
+    float voltage;          // V across the cascade the step was based on
+    float power;            // W the step was based on
+    float noise;            // Standard error of the voltage (V)
+};
+
+// windDirection of a calculation without a direction, e.g. before the first vane sample
+#define TELEMETRY_NO_DIRECTION 0xFFFF
+
+// One calculation of the wind
+struct __attribute__((packed)) TelemetryWind
+{
+    uint16_t windSpeed;     // 0.1 km/h
+    uint16_t windGust;      // 0.1 km/h
+    uint16_t windDirection; // Degrees, TELEMETRY_NO_DIRECTION without one
+    uint16_t rain;          // Tips of the rain gauge in the interval
+    uint8_t state;          // State of the cascade
+};
+
+// One bin of the power curve (see PowerCurve.h), the non-empty bins are sent in turn
+struct __attribute__((packed)) TelemetryPowerCurve
+{
+    uint8_t bin;            // Wind speed bin, bin * 0.5 m/s
+    uint32_t count;         // MPPT steps in the bin
+    float powerMean;        // W
+    float powerMax;         // W
+    float stateMean;        // Mean State of the cascade
+    float energy;           // Wh harvested since the start of the curve
+    float capacityFactor;   // Energy as share of the rated power
+};
+
+#endif
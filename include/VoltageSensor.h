@@ -0,0 +1,71 @@
+/**********************************************************
+** @file		VoltageSensor.h
+**
+** Measurement stage for the turbine voltage. The raw ADC
+** samples between two MPPT steps are collected and reduced
+** to one value by a filter:
+**  VOLTAGE_FILTER_MEAN    arithmetic mean
+**  VOLTAGE_FILTER_MEDIAN  median, robust against single
+**                         spikes from switching the cascade
+**  VOLTAGE_FILTER_RIPPLE  mean over whole ripple periods
+**                         only, between the first and last
+**                         rising crossing of the mean, so an
+**                         unfinished period of the rectifier
+**                         ripple doesn't bias the value
+** Together with the value the standard error of it is
+** estimated from the spread of the samples. The MPPT uses it
+** as deadband, power changes within the noise do not count.
+**
+
+*/
+
+#ifndef VoltageSensor_h
+#define VoltageSensor_h
+
+#include "Arduino.h"
+
+// Largest number of samples per measurement, further samples are dropped
+#ifndef VOLTAGE_SENSOR_SAMPLES
+#define VOLTAGE_SENSOR_SAMPLES 64
+#endif
+
+enum VoltageFilter
+{
+    VOLTAGE_FILTER_MEAN,
+    VOLTAGE_FILTER_MEDIAN,
+    VOLTAGE_FILTER_RIPPLE
+};
+
+
+class VoltageSensor
+{
+public:
+    VoltageSensor();
+
+    void setFilter(VoltageFilter filter);
+    VoltageFilter getFilter();
+
+    void add(unsigned int raw);
+    unsigned int count();
+    bool measure();
+
+    float getValue();
+    float getNoise();
+    unsigned long getDropped();
+
+private:
+    VoltageFilter _filter;
+    uint16_t _sample[VOLTAGE_SENSOR_SAMPLES];
+    unsigned int _count;
+    unsigned long _dropped;
+
+    float _value;           // Filtered raw value of the last measurement
+    float _noise;           // Standard error of _value
+
+    float _mean(unsigned int from, unsigned int to);
+    float _median();
+    float _ripple(float mean);
+};
+
+
+#endif
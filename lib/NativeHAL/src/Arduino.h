@@ -0,0 +1,98 @@
+/**********************************************************
+** @file		Arduino.h
+**
+** Thin Arduino API for the host build (env:native). Only
+** what the firmware logic in src/ uses is provided. Time,
+** analog inputs, pin levels and interrupts are driven by the
+** simulation through SimHal.h, so a trace can be replayed
+** faster than real time. millis() and micros() do not wrap
+** like on the device, unsigned long has 64 bit on the host.
+**
+
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef void (*voidFuncPtr)();
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define LOW_LEVEL 0
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_AN_INTERRUPT -1
+
+// Pin numbers of the MKR Zero
+#define A0 15
+#define A1 16
+#define A2 17
+#define A3 18
+#define A4 19
+#define A5 20
+#define A6 21
+#define SDCARD_SS_PIN 28
+#define SIM_PINS 32
+
+#ifndef F_CPU
+#define F_CPU 48000000UL
+#endif
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+void analogReadResolution(int bits);
+
+int digitalPinToInterrupt(int pin);
+void attachInterrupt(int interrupt, voidFuncPtr isr, int mode);
+void detachInterrupt(int interrupt);
+void noInterrupts();
+void interrupts();
+
+
+class SimSerial
+{
+public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t len);
+    int availableForWrite();
+    int available();
+    int read();
+    void print(const char *text);
+    void println(const char *text = "");
+
+    //The host terminal is always there
+    bool dtr()
+    {
+        return true;
+    }
+};
+
+extern SimSerial Serial;
+
+
+#endif
@@ -0,0 +1,570 @@
+/**********************************************************
+** @file		NativeHAL.cpp
+**
+** Host implementation of the Arduino API in Arduino.h, the
+** SdFat library in SdFat.h and the simulation controls in SimHal.h.
+** delay() advances the simulated time instead of waiting.
+**
+
+*/
+
+#include "Arduino.h"
+#include "SimHal.h"
+#include "SdFat.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <filesystem>
+#include <vector>
+
+static unsigned long simMicros = 0;
+static int simAnalog[SIM_PINS];
+static int simLevel[SIM_PINS];
+static unsigned long simWrites[SIM_PINS];
+static voidFuncPtr simIsr[SIM_PINS];
+static int simIsrMode[SIM_PINS];
+static bool simSerialOutput = false;
+
+// Sectors handed out by preAllocate(), the raw writes of SdCard go into the file that owns them
+struct SimCardFile
+{
+    std::string path;
+    uint32_t first;
+    uint32_t count;
+};
+
+// First sector of the files, like the data area behind the FAT
+#define SIM_CARD_FIRST_SECTOR 8192
+
+static bool simCardContiguous = false;
+static bool simCardExFat = false;
+static std::vector<SimCardFile> simCardFiles;
+static uint32_t simCardNext = SIM_CARD_FIRST_SECTOR;
+static unsigned int simCardBusy = 0;        // isBusy() polls after every sector
+static unsigned int simCardBusyLeft = 0;
+static long simCardReject = -1;             // Accepted sector writes before the rejected one, -1 for none
+static unsigned long simCardWrites = 0;
+
+SimSerial Serial;
+
+//Returns true if pin is a pin of the simulated board.
+static bool validPin(int pin)
+{
+    return pin >= 0 && pin < SIM_PINS;
+}
+
+
+unsigned long millis()
+{
+    return simMicros / 1000;
+}
+
+unsigned long micros()
+{
+    return simMicros;
+}
+
+void delay(unsigned long ms)
+{
+    simMicros += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    simMicros += us;
+}
+
+void pinMode(int pin, int mode)
+{
+    if (validPin(pin) && mode == INPUT_PULLUP)
+    {
+        simLevel[pin] = HIGH;
+    }
+}
+
+void digitalWrite(int pin, int value)
+{
+    if (validPin(pin))
+    {
+        simLevel[pin] = value ? HIGH : LOW;
+        simWrites[pin]++;
+    }
+}
+
+int digitalRead(int pin)
+{
+    return validPin(pin) ? simLevel[pin] : LOW;
+}
+
+int analogRead(int pin)
+{
+    return validPin(pin) ? simAnalog[pin] : 0;
+}
+
+void analogReadResolution(int bits)
+{
+    (void) bits;
+}
+
+int digitalPinToInterrupt(int pin)
+{
+    return validPin(pin) ? pin : NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(int interrupt, voidFuncPtr isr, int mode)
+{
+    if (validPin(interrupt))
+    {
+        simIsr[interrupt] = isr;
+        simIsrMode[interrupt] = mode;
+    }
+}
+
+void detachInterrupt(int interrupt)
+{
+    if (validPin(interrupt))
+    {
+        simIsr[interrupt] = nullptr;
+    }
+}
+
+//The simulation is single threaded, an ISR only runs when SimHal::trigger() is called.
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+
+void SimSerial::begin(unsigned long baud)
+{
+    (void) baud;
+}
+
+size_t SimSerial::write(uint8_t data)
+{
+    if (simSerialOutput)
+    {
+        fputc(data, stderr);
+    }
+    return 1;
+}
+
+size_t SimSerial::write(const uint8_t *data, size_t len)
+{
+    if (simSerialOutput)
+    {
+        fwrite(data, 1, len, stderr);
+    }
+    return len;
+}
+
+int SimSerial::availableForWrite()
+{
+    return 256;
+}
+
+int SimSerial::available()
+{
+    return 0;
+}
+
+int SimSerial::read()
+{
+    return -1;
+}
+
+void SimSerial::print(const char *text)
+{
+    write((const uint8_t *) text, strlen(text));
+}
+
+void SimSerial::println(const char *text)
+{
+    print(text);
+    write('\n');
+}
+
+
+void SimHal::reset()
+{
+    simMicros = 0;
+    for (int pin = 0; pin < SIM_PINS; pin++)
+    {
+        simAnalog[pin] = 0;
+        simLevel[pin] = LOW;
+        simWrites[pin] = 0;
+        simIsr[pin] = nullptr;
+        simIsrMode[pin] = 0;
+    }
+    simCardContiguous = false;
+    simCardExFat = false;
+    simCardFiles.clear();
+    simCardNext = SIM_CARD_FIRST_SECTOR;
+    simCardBusy = 0;
+    simCardBusyLeft = 0;
+    simCardReject = -1;
+    simCardWrites = 0;
+}
+
+void SimHal::setMicros(unsigned long us)
+{
+    simMicros = us;
+}
+
+void SimHal::advance(unsigned long us)
+{
+    simMicros += us;
+}
+
+void SimHal::setAnalog(int pin, int value)
+{
+    if (validPin(pin))
+    {
+        simAnalog[pin] = value;
+    }
+}
+
+int SimHal::pinLevel(int pin)
+{
+    return digitalRead(pin);
+}
+
+unsigned long SimHal::pinWrites(int pin)
+{
+    return validPin(pin) ? simWrites[pin] : 0;
+}
+
+//Calls the ISR attached to pin, returns false if there is none.
+bool SimHal::trigger(int pin)
+{
+    if (!validPin(pin) || simIsr[pin] == nullptr)
+    {
+        return false;
+    }
+    simIsr[pin]();
+    return true;
+}
+
+void SimHal::setSerialOutput(bool enable)
+{
+    simSerialOutput = enable;
+}
+
+//With enable preAllocate() succeeds for new files and SdCard writes their sectors.
+void SimHal::setCardContiguous(bool enable)
+{
+    simCardContiguous = enable;
+}
+
+//With enable the card has exFAT, see SdFat.h.
+void SimHal::setCardExFat(bool enable)
+{
+    simCardExFat = enable;
+}
+
+//Sets how many isBusy() polls the card programs after every sector.
+void SimHal::setCardBusy(unsigned int polls)
+{
+    simCardBusy = polls;
+}
+
+//Rejects the sector write after the next accepted ones, once.
+void SimHal::rejectCardWrite(unsigned long accepted)
+{
+    simCardReject = (long) accepted;
+}
+
+//Returns the number of sectors the card accepted from raw writes.
+unsigned long SimHal::cardWrites()
+{
+    return simCardWrites;
+}
+
+
+FsFile::FsFile()
+{
+    _file = nullptr;
+}
+
+//Like SdFat, O_TRUNC empties the file, O_AT_END starts at its end and O_APPEND writes every byte there.
+bool FsFile::open(const char *path, oflag_t oflag)
+{
+    close();
+    struct stat info;
+    bool exists = stat(path, &info) == 0;
+    if ((exists && (oflag & O_EXCL) && (oflag & O_CREAT)) || (!exists && !(oflag & O_CREAT)))
+    {
+        return false;
+    }
+    const char *mode = "rb";
+    if (oflag & O_APPEND)
+    {
+        mode = "a+b";
+    }
+    else if ((oflag & (O_WRONLY | O_RDWR)) && (!exists || (oflag & O_TRUNC)))
+    {
+        mode = "w+b";
+    }
+    else if (oflag & (O_WRONLY | O_RDWR))
+    {
+        mode = "r+b";
+    }
+    _file = fopen(path, mode);
+    if (_file == nullptr)
+    {
+        return false;
+    }
+    _path = path;
+    if (oflag & O_AT_END)
+    {
+        fseek(_file, 0, SEEK_END);
+    }
+    return true;
+}
+
+size_t FsFile::write(uint8_t data)
+{
+    return _file != nullptr && fputc(data, _file) != EOF ? 1 : 0;
+}
+
+size_t FsFile::write(const void *data, size_t len)
+{
+    return _file != nullptr ? fwrite(data, 1, len, _file) : 0;
+}
+
+int FsFile::read()
+{
+    return _file != nullptr ? fgetc(_file) : -1;
+}
+
+int FsFile::read(void *data, size_t len)
+{
+    return _file != nullptr ? (int) fread(data, 1, len, _file) : -1;
+}
+
+int FsFile::available()
+{
+    return _file != nullptr ? (int) (size() - position()) : 0;
+}
+
+bool FsFile::seek(uint64_t position)
+{
+    return _file != nullptr && fseek(_file, (long) position, SEEK_SET) == 0;
+}
+
+uint64_t FsFile::position()
+{
+    return _file != nullptr ? (uint64_t) ftell(_file) : 0;
+}
+
+uint64_t FsFile::size()
+{
+    if (_file == nullptr)
+    {
+        return 0;
+    }
+    long position = ftell(_file);
+    fseek(_file, 0, SEEK_END);
+    long size = ftell(_file);
+    fseek(_file, position, SEEK_SET);
+    return (uint64_t) size;
+}
+
+//Hands out the next sectors and extends the file to length, like SdFat does for a contiguous file on FAT. On exFAT
+//the valid length stays 0.
+bool FsFile::preAllocate(uint64_t length)
+{
+    if (!simCardContiguous || _file == nullptr || length == 0 || size() > 0)
+    {
+        return false;
+    }
+    fflush(_file);
+    std::error_code error;
+    if (!simCardExFat)
+    {
+        std::filesystem::resize_file(_path, length, error);
+    }
+    if (error)
+    {
+        return false;
+    }
+    SimCardFile file = {_path, simCardNext, (uint32_t) ((length + 511) / 512)};
+    for (SimCardFile &entry : simCardFiles)
+    {
+        if (entry.path == _path)
+        {
+            entry = file;
+            simCardNext += file.count;
+            return true;
+        }
+    }
+    simCardFiles.push_back(file);
+    simCardNext += file.count;
+    return true;
+}
+
+//Cuts the file to length. Like SdFat it only extends a file on FAT, on exFAT nothing after the valid length exists.
+bool FsFile::truncate(uint64_t length)
+{
+    if (_file == nullptr || (simCardExFat && length > size()))
+    {
+        return false;
+    }
+    fflush(_file);
+    std::error_code error;
+    std::filesystem::resize_file(_path, length, error);
+    if (position() > length)
+    {
+        seek(length);
+    }
+    return !error;
+}
+
+bool FsFile::isContiguous()
+{
+    uint32_t first;
+    uint32_t last;
+    return contiguousRange(&first, &last);
+}
+
+bool FsFile::contiguousRange(uint32_t *bgnSector, uint32_t *endSector)
+{
+    for (const SimCardFile &entry : simCardFiles)
+    {
+        if (entry.path == _path && _file != nullptr)
+        {
+            *bgnSector = entry.first;
+            *endSector = entry.first + entry.count - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FsFile::flush()
+{
+    if (_file != nullptr)
+    {
+        fflush(_file);
+    }
+}
+
+bool FsFile::sync()
+{
+    flush();
+    return _file != nullptr;
+}
+
+bool FsFile::close()
+{
+    if (_file == nullptr)
+    {
+        return false;
+    }
+    fclose(_file);
+    _file = nullptr;
+    return true;
+}
+
+
+bool SdCard::writeStart(uint32_t sector)
+{
+    _sector = sector;
+    return simCardContiguous;
+}
+
+//Writes the sector into the file that owns it. Returns false for a sector outside the files or the rejected one. On
+//exFAT the part behind the valid length of the file is lost for its readers.
+bool SdCard::writeData(const uint8_t *src)
+{
+    if (simCardReject == 0)
+    {
+        simCardReject = -1;
+        return false;
+    }
+    for (const SimCardFile &entry : simCardFiles)
+    {
+        if (_sector >= entry.first && _sector < entry.first + entry.count)
+        {
+            FILE *file = fopen(entry.path.c_str(), "r+b");
+            if (file == nullptr)
+            {
+                return false;
+            }
+            long offset = (long) (_sector - entry.first) * 512;
+            fseek(file, 0, SEEK_END);
+            long valid = ftell(file);
+            size_t len = simCardExFat ? (valid > offset ? (size_t) (valid - offset < 512 ? valid - offset : 512) : 0)
+                                      : 512;
+            fseek(file, offset, SEEK_SET);
+            size_t written = fwrite(src, 1, len, file);
+            fclose(file);
+            if (written != len)
+            {
+                return false;
+            }
+            _sector++;
+            simCardWrites++;
+            simCardBusyLeft = simCardBusy;
+            if (simCardReject > 0)
+            {
+                simCardReject--;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SdCard::writeStop()
+{
+    return true;
+}
+
+bool SdCard::isBusy()
+{
+    if (simCardBusyLeft > 0)
+    {
+        simCardBusyLeft--;
+        return true;
+    }
+    return false;
+}
+
+
+bool SdFat::begin(SdSpiConfig config)
+{
+    (void) config;
+    return true;
+}
+
+bool SdFat::exists(const char *path)
+{
+    struct stat info;
+    return stat(path, &info) == 0;
+}
+
+bool SdFat::remove(const char *path)
+{
+    return ::remove(path) == 0;
+}
+
+bool SdFat::mkdir(const char *path)
+{
+    std::error_code error;
+    return std::filesystem::create_directory(path, error);
+}
+
+uint8_t SdFat::fatType()
+{
+    return simCardExFat ? FAT_TYPE_EXFAT : FAT_TYPE_FAT32;
+}
+
+FsFile SdFat::open(const char *path, oflag_t oflag)
+{
+    FsFile file;
+    file.open(path, oflag);
+    return file;
+}
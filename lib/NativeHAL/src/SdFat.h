@@ -0,0 +1,143 @@
+/**********************************************************
+** @file		SdFat.h
+**
+** SdFat library for the host build, the files are opened in
+** the working directory with stdio. Only what the firmware
+** uses is provided. There is no contiguous allocation on the
+** host, preAllocate() fails and the file grows as usual,
+** unless SimHal::setCardContiguous() is on: then a new file
+** gets a range of sectors and is extended to the allocated
+** size, and the raw sector writes of SdCard land in it.
+** SimHal::setCardExFat() turns the card into exFAT like
+** SdFat has it: preAllocate() reserves the sectors but keeps
+** the valid length of the file at 0, only write() advances
+** it. Raw sectors behind the valid length are never read
+** back and truncate() can't extend the file over them.
+**
+
+*/
+
+#ifndef SdFat_h
+#define SdFat_h
+
+#include <stdio.h>
+#include <string>
+#include "Arduino.h"
+
+#define O_RDONLY 0x00
+#define O_WRONLY 0x01
+#define O_RDWR 0x02
+#define O_AT_END 0x04
+#define O_APPEND 0x08
+#define O_CREAT 0x10
+#define O_TRUNC 0x20
+#define O_EXCL 0x40
+#define FILE_READ O_RDONLY
+#define FILE_WRITE (O_RDWR | O_CREAT | O_AT_END)
+
+typedef uint8_t oflag_t;
+
+#define DEDICATED_SPI 1
+#define SHARED_SPI 0
+#define SD_SCK_MHZ(mhz) (1000000UL * (mhz))
+
+#define FAT_TYPE_FAT16 16
+#define FAT_TYPE_FAT32 32
+#define FAT_TYPE_EXFAT 64
+
+struct SdSpiConfig
+{
+    SdSpiConfig(uint8_t cs, uint8_t opt = SHARED_SPI, uint32_t maxSck = SD_SCK_MHZ(50))
+    {
+        csPin = cs;
+        options = opt;
+        maxSpeed = maxSck;
+    }
+
+    uint8_t csPin;
+    uint8_t options;
+    uint32_t maxSpeed;
+};
+
+
+class FsFile
+{
+public:
+    FsFile();
+
+    bool open(const char *path, oflag_t oflag = O_RDONLY);
+    size_t write(uint8_t data);
+    size_t write(const void *data, size_t len);
+    int read();
+    int read(void *data, size_t len);
+    int available();
+    bool seek(uint64_t position);
+    uint64_t position();
+    uint64_t size();
+    bool preAllocate(uint64_t length);
+    bool truncate(uint64_t length);
+    bool isContiguous();
+    bool contiguousRange(uint32_t *bgnSector, uint32_t *endSector);
+    void flush();
+    bool sync();
+    bool close();
+
+    bool isOpen()
+    {
+        return _file != nullptr;
+    }
+
+    operator bool()
+    {
+        return _file != nullptr;
+    }
+
+private:
+    FILE *_file;
+    std::string _path;
+};
+
+typedef FsFile File;
+
+
+//The card below the file system. Its sectors are the ones preAllocate() handed out, a multi block write fails without
+//SimHal::setCardContiguous(). SimHal sets how long the card is busy after a sector and which one it rejects.
+class SdCard
+{
+public:
+    bool syncDevice()
+    {
+        return true;
+    }
+
+    bool writeStart(uint32_t sector);
+    bool writeData(const uint8_t *src);
+    bool writeStop();
+    bool isBusy();
+
+private:
+    uint32_t _sector;       // Next sector of the multi block write
+};
+
+
+class SdFat
+{
+public:
+    bool begin(SdSpiConfig config);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool mkdir(const char *path);
+    FsFile open(const char *path, oflag_t oflag = O_RDONLY);
+    uint8_t fatType();
+
+    SdCard *card()
+    {
+        return &_card;
+    }
+
+private:
+    SdCard _card;
+};
+
+
+#endif
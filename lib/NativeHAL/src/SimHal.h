@@ -0,0 +1,43 @@
+/**********************************************************
+** @file		SimHal.h
+**
+** Control side of the host Arduino API. The simulation sets
+** the time, the analog readings and fires the interrupts the
+** firmware attached, and can look at the pin levels and
+** count the writes of the outputs. For the SD-Card it turns
+** on the contiguous allocation of SdFat.h, picks FAT or
+** exFAT and sets how the card answers the raw sector writes.
+**
+
+*/
+
+#ifndef SimHal_h
+#define SimHal_h
+
+#include "Arduino.h"
+
+
+class SimHal
+{
+public:
+    static void reset();
+
+    static void setMicros(unsigned long us);
+    static void advance(unsigned long us);
+
+    static void setAnalog(int pin, int value);
+    static int pinLevel(int pin);
+    static unsigned long pinWrites(int pin);
+
+    static bool trigger(int pin);
+    static void setSerialOutput(bool enable);
+
+    static void setCardContiguous(bool enable);
+    static void setCardExFat(bool enable);
+    static void setCardBusy(unsigned int polls);
+    static void rejectCardWrite(unsigned long accepted);
+    static unsigned long cardWrites();
+};
+
+
+#endif
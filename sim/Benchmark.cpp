@@ -0,0 +1,149 @@
+/**********************************************************
+** @file		Benchmark.cpp
+**
+** MPPT benchmark on the rotor model, see Benchmark.h
+**
+
+*/
+
+#include "Benchmark.h"
+#include <string.h>
+#include <stdlib.h>
+
+//Runs config through profile on a fresh turbine and firmware.
+BenchResult Benchmark::run(const WindProfile &profile, const SimConfig &config)
+{
+    TurbineModel turbine;
+    turbine.setKind(TURBINE_MODEL_ROTOR);
+    Simulation sim(config, turbine);
+    sim.begin();
+    sim.setClock(12, 1);
+
+    BenchResult result = {};
+    result.profile = profile.name();
+    result.mppt = Simulation::strategyName(config.mppt);
+    result.duration = profile.duration();
+
+    // The start counts as the first recovery
+    bool recovering = true;
+    float recoveryStart = 0;
+    double recoveryTime = 0;
+    for (unsigned long ms = 0; ms < (unsigned long) (profile.duration() * 1000); ms += BENCH_STEP)
+    {
+        sim.setWind(profile.speed(ms / 1000.0f) * 3.6f, BENCH_DIRECTION);
+        sim.advance(BENCH_STEP);
+        float t = sim.getTime() / 1000.0f;
+        float best = turbine.bestPower();
+        bool atMpp = best <= 0 || sim.getPower() >= BENCH_MPP_THRESHOLD * best;
+        if (recovering && atMpp)
+        {
+            float time = t - recoveryStart;
+            recoveryTime += time;
+            result.recoveries++;
+            if (time > result.timeToMppMax)
+            {
+                result.timeToMppMax = time;
+            }
+            recovering = false;
+        }
+        else if (!recovering && !atMpp)
+        {
+            recovering = true;
+            recoveryStart = t;
+        }
+    }
+    if (recovering)
+    {
+        result.misses++;
+    }
+
+    result.energy = sim.getEnergy() / 3600;
+    result.available = sim.getEnergyBest() / 3600;
+    result.captured = result.available > 0 ? result.energy / result.available : 0;
+    result.timeToMpp = result.recoveries > 0 ? (float) (recoveryTime / result.recoveries) : -1;
+    result.switches = sim.getSwitches();
+    result.stateChanges = sim.getStateChanges();
+    result.moves = sim.mppt().getMoves();
+    result.holds = sim.mppt().getHolds();
+    unsigned long steps = sim.getMpptSteps();
+    result.stepNs = steps > 0 ? sim.getMpptTime() * 1e9 / steps : 0;
+    result.stepCycles = steps > 0 ? (double) sim.getMpptCycles() / steps : 0;
+    return result;
+}
+
+//Writes the results as CSV with a header line.
+void Benchmark::writeCsv(FILE *out, const std::vector<BenchResult> &results)
+{
+    fprintf(out, "profile,mppt,duration_s,energy_wh,available_wh,captured,time_to_mpp_s,time_to_mpp_max_s,"
+                 "recoveries,misses,mosfet_switches,state_changes,moves,holds,step_ns,step_cycles\n");
+    for (const BenchResult &r : results)
+    {
+        fprintf(out, "%s,%s,%.1f,%.5f,%.5f,%.4f,%.2f,%.2f,%u,%u,%lu,%lu,%lu,%lu,%.1f,%.0f\n", r.profile.c_str(),
+                r.mppt.c_str(), r.duration, r.energy, r.available, r.captured, r.timeToMpp, r.timeToMppMax,
+                r.recoveries, r.misses, r.switches, r.stateChanges, r.moves, r.holds, r.stepNs, r.stepCycles);
+    }
+}
+
+//Writes the results as a JSON array of objects with the names of the CSV columns.
+void Benchmark::writeJson(FILE *out, const std::vector<BenchResult> &results)
+{
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(out, "  {\"profile\": \"%s\", \"mppt\": \"%s\", \"duration_s\": %.1f, \"energy_wh\": %.5f, "
+                     "\"available_wh\": %.5f, \"captured\": %.4f, \"time_to_mpp_s\": %.2f, "
+                     "\"time_to_mpp_max_s\": %.2f, \"recoveries\": %u, \"misses\": %u, \"mosfet_switches\": %lu, "
+                     "\"state_changes\": %lu, \"moves\": %lu, \"holds\": %lu, \"step_ns\": %.1f, "
+                     "\"step_cycles\": %.0f}%s\n", r.profile.c_str(), r.mppt.c_str(), r.duration, r.energy,
+                r.available, r.captured, r.timeToMpp, r.timeToMppMax, r.recoveries, r.misses, r.switches,
+                r.stateChanges, r.moves, r.holds, r.stepNs, r.stepCycles, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+//Compares the captured share with a CSV of an earlier run, reports every profile and strategy that lost more than
+//tolerance to stderr. Returns the number of regressions, -1 if the baseline can't be read.
+int Benchmark::compare(const char *baseline, const std::vector<BenchResult> &results, float tolerance)
+{
+    FILE *file = fopen(baseline, "r");
+    if (file == nullptr)
+    {
+        return -1;
+    }
+    char line[512];
+    int regressions = 0;
+    // The header is skipped, the first columns are profile, mppt and the captured share is the sixth
+    bool header = true;
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (header)
+        {
+            header = false;
+            continue;
+        }
+        char *profile = strtok(line, ",");
+        char *mppt = strtok(nullptr, ",");
+        char *column = nullptr;
+        for (int i = 0; i < 4; i++)
+        {
+            column = strtok(nullptr, ",");
+        }
+        if (profile == nullptr || mppt == nullptr || column == nullptr)
+        {
+            continue;
+        }
+        float captured = atof(column);
+        for (const BenchResult &r : results)
+        {
+            if (r.profile == profile && r.mppt == mppt && r.captured < captured - tolerance)
+            {
+                fprintf(stderr, "regression %s/%s: captured %.4f, baseline %.4f\n", profile, mppt, r.captured,
+                        captured);
+                regressions++;
+            }
+        }
+    }
+    fclose(file);
+    return regressions;
+}
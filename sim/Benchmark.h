@@ -0,0 +1,76 @@
+/**********************************************************
+** @file		Benchmark.h
+**
+** Runs an MPPT strategy through a wind profile on the rotor
+** model and measures it:
+**  captured        energy taken up / energy of the best
+**                  steady state at every moment
+**  time to MPP     how long the power stays below
+**                  BENCH_MPP_THRESHOLD of the best after it
+**                  fell below (and after the start), mean
+**                  and maximum; recoveries that did not end
+**                  before the profile did are counted as
+**                  misses
+**  switches        MOSFET transitions and State changes
+**  step time       host time and cycles (TSC on x86) per
+**                  step() of the strategy, relative between
+**                  strategies, not the cycles on the SAMD21
+** The results are written as CSV or JSON, a CSV of an
+** earlier run can be used as baseline: a captured share that
+** dropped by more than the tolerance is a regression.
+**
+
+*/
+
+#ifndef Benchmark_h
+#define Benchmark_h
+
+#include "Simulation.h"
+#include "WindProfile.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Share of the best power that counts as being at the MPP
+#ifndef BENCH_MPP_THRESHOLD
+#define BENCH_MPP_THRESHOLD 0.95f
+#endif
+// Time step (ms) the wind of the profile is updated and the MPP is checked with
+#define BENCH_STEP 100
+// Wind direction (degrees) of the synthetic profiles
+#define BENCH_DIRECTION 270
+
+
+struct BenchResult
+{
+    std::string profile;
+    std::string mppt;
+    float duration;             // s
+    double energy;              // Wh
+    double available;           // Wh
+    double captured;            // energy / available
+    float timeToMpp;            // s, mean of the recoveries, -1 without any
+    float timeToMppMax;         // s
+    unsigned int recoveries;
+    unsigned int misses;
+    unsigned long switches;
+    unsigned long stateChanges;
+    unsigned long moves;
+    unsigned long holds;
+    double stepNs;              // Host ns per step()
+    double stepCycles;          // Host cycles per step(), 0 without cycle counter
+};
+
+
+class Benchmark
+{
+public:
+    static BenchResult run(const WindProfile &profile, const SimConfig &config);
+
+    static void writeCsv(FILE *out, const std::vector<BenchResult> &results);
+    static void writeJson(FILE *out, const std::vector<BenchResult> &results);
+    static int compare(const char *baseline, const std::vector<BenchResult> &results, float tolerance);
+};
+
+
+#endif
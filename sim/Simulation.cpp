@@ -0,0 +1,416 @@
+/**********************************************************
+** @file		Simulation.cpp
+**
+** Firmware logic on the host driven by a turbine model, see
+** Simulation.h
+**
+
+*/
+
+#include "Simulation.h"
+#include <SimHal.h>
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define SIM_SAMPLES_PER_BLOCK (SIM_ADC_SAMPLE_RATE * SIM_VANE_SAMPLE_INTERVAL / 1000)
+
+static const char SIM_MOSFET_PINS[LOAD_STAGES] = {0, 1, 2, 3, 7, 6, 8, 9};
+
+Simulation *Simulation::_active = nullptr;
+
+//Returns the cycle counter of the host, 0 if there is none.
+static unsigned long long hostCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+Simulation::Simulation(const SimConfig &config, TurbineModel &turbine)
+    : _config(config), _turbine(turbine), _weather(SIM_RAIN_PIN, SIM_VANE_PIN, SIM_ANEMOMETER_PIN)
+{
+    switch (_config.mppt)
+    {
+    case SIM_MPPT_ADAPTIVE_STEP:
+        _mppt = &_adaptiveStep;
+        break;
+    case SIM_MPPT_INCREMENTAL_CONDUCTANCE:
+        _mppt = &_incrementalConductance;
+        break;
+    default:
+        _mppt = &_perturbObserve;
+        break;
+    }
+    _state = 255;
+    _switched = 0;
+    _vaneDecimation = 0;
+    _rng.seed(_config.seed);
+    _windSpeed = 0;
+    _windDirection = 0;
+    _hours = 0;
+    _day = 1;
+    _pulsePeriod = 0;
+    _nextPulse = 0;
+    _tips = 0;
+    _now = 0;
+    _energy = 0;
+    _energyBest = 0;
+    _switches = 0;
+    _stateChanges = 0;
+    _mpptSteps = 0;
+    _mpptTime = 0;
+    _mpptCycles = 0;
+}
+
+Simulation::~Simulation()
+{
+    if (_active == this)
+    {
+        _active = nullptr;
+    }
+}
+
+//setup() of the sketch with background sampling and the interrupt backends of anemometer and rain gauge. The time
+//starts at 0.
+void Simulation::begin()
+{
+    _active = this;
+    SimHal::reset();
+    _weather.setVaneResolution(12);
+    _weather.setVaneAveraging(_config.vane);
+    _voltageSensor.setFilter(_config.filter);
+    _weather.attachRainGauge(FALLING);
+    _weather.attachAnemometer(FALLING);
+    _weather.setPeriodMode(true);
+    _cascadeSwitch.begin(SIM_MOSFET_PINS, CASCADE_SWITCH_ATOMIC);
+    _mppt->begin(_state, true);
+    _switch(_state);
+    _switched = _readPins();
+    _scheduler.addTask("vane", _vaneTask, SIM_VANE_SAMPLE_INTERVAL);
+    _scheduler.addTask("wind", _windTask, SIM_CALC_INTERVAL_SENSOR, SIM_CALC_INTERVAL_SENSOR);
+    _scheduler.addTask("mppt", _mpptTask, _config.interval);
+    _scheduler.begin();
+}
+
+//Sets the wind speed (km/h) and direction (degrees) from now on, the phase of the pulses continues.
+void Simulation::setWind(float windSpeed, int windDirection)
+{
+    _windSpeed = windSpeed > 0 ? windSpeed : 0;
+    _windDirection = windDirection;
+    // 2.4 km/h per pulse and second
+    _pulsePeriod = _windSpeed > 0 ? (unsigned long) (2.4e6f / _windSpeed) : 0;
+    if (_pulsePeriod == 0)
+    {
+        _nextPulse = 0;
+    }
+    else if (_nextPulse == 0 || _nextPulse > _now + _pulsePeriod)
+    {
+        _nextPulse = _now + _pulsePeriod;
+    }
+    _turbine.setWind(_windSpeed / 3.6f);
+}
+
+//Sets the time the rain clock of the gauge sees.
+void Simulation::setClock(unsigned char hours, unsigned char day)
+{
+    _hours = hours;
+    _day = day;
+}
+
+//Tips of the rain gauge during the next advance(), spread over it. The debounce of the gauge allows one tip per
+//RAIN_DEBOUNCE_TIME.
+void Simulation::setRain(unsigned int tips)
+{
+    _tips = tips;
+}
+
+//Advances the time by ms in steps of 1 ms, the scheduler runs the due tasks after the pulses of every step.
+void Simulation::advance(unsigned long ms)
+{
+    unsigned int tips = std::min(_tips, (unsigned int) (ms / RAIN_DEBOUNCE_TIME));
+    unsigned int tipped = 0;
+    _tips = 0;
+    for (unsigned long step = 1; step <= ms; step++)
+    {
+        unsigned long now = _now + 1000;
+        while (_nextPulse != 0 && _nextPulse <= now)
+        {
+            SimHal::setMicros(_nextPulse);
+            SimHal::trigger(SIM_ANEMOMETER_PIN);
+            _nextPulse += _pulsePeriod;
+        }
+        if (tipped < tips && step * (tips + 1) >= (tipped + 1UL) * ms)
+        {
+            SimHal::setMicros(now);
+            SimHal::trigger(SIM_RAIN_PIN);
+            tipped++;
+        }
+        _now = now;
+        SimHal::setMicros(now);
+        _scheduler.run();
+        _turbine.update(_switched, 1e-3f);
+        _energy += _turbine.power(_switched) * 1e-3;
+        _energyBest += _turbine.bestPower() * 1e-3;
+    }
+}
+
+//Returns the simulated time in ms.
+unsigned long Simulation::getTime()
+{
+    return _now / 1000;
+}
+
+//Returns the State the MOSFETs are switched to.
+int Simulation::getState()
+{
+    return _switched;
+}
+
+//Returns the power in the cascade now.
+float Simulation::getPower()
+{
+    return _turbine.power(_switched);
+}
+
+//Returns the energy (Ws) the cascade took up.
+double Simulation::getEnergy()
+{
+    return _energy;
+}
+
+//Returns the energy (Ws) of the best steady state at every moment, what a perfect MPPT could take up.
+double Simulation::getEnergyBest()
+{
+    return _energyBest;
+}
+
+//Returns the number of MOSFET transitions.
+unsigned long Simulation::getSwitches()
+{
+    return _switches;
+}
+
+//Returns how often the State changed.
+unsigned long Simulation::getStateChanges()
+{
+    return _stateChanges;
+}
+
+unsigned long Simulation::getMpptSteps()
+{
+    return _mpptSteps;
+}
+
+//Returns the host time (s) spent in the step() of the strategy.
+double Simulation::getMpptTime()
+{
+    return _mpptTime;
+}
+
+//Returns the host cycles spent in the step() of the strategy, 0 without cycle counter.
+unsigned long long Simulation::getMpptCycles()
+{
+    return _mpptCycles;
+}
+
+MpptBase &Simulation::mppt()
+{
+    return *_mppt;
+}
+
+ADSWeather &Simulation::weather()
+{
+    return _weather;
+}
+
+PowerCurve &Simulation::powerCurve()
+{
+    return _powerCurve;
+}
+
+//Reads a strategy name (po, adaptive, inc), returns false if unknown.
+bool Simulation::parseStrategy(const char *name, SimStrategy &strategy)
+{
+    for (int i = SIM_MPPT_PERTURB_OBSERVE; i <= SIM_MPPT_INCREMENTAL_CONDUCTANCE; i++)
+    {
+        if (strcmp(name, strategyName((SimStrategy) i)) == 0)
+        {
+            strategy = (SimStrategy) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *Simulation::strategyName(SimStrategy strategy)
+{
+    switch (strategy)
+    {
+    case SIM_MPPT_ADAPTIVE_STEP:
+        return "adaptive";
+    case SIM_MPPT_INCREMENTAL_CONDUCTANCE:
+        return "inc";
+    default:
+        return "po";
+    }
+}
+
+void Simulation::_vaneTask()
+{
+    _active->_sampleBlock();
+}
+
+void Simulation::_windTask()
+{
+    _active->_calculateWind();
+}
+
+void Simulation::_mpptTask()
+{
+    _active->_stepMppt();
+}
+
+//One block of the background ADC: sample pairs spread over the last vane interval, every SIM_VANE_DECIMATION-th vane
+//sample goes to the weather station like in vane_sample_task() of the sketch.
+void Simulation::_sampleBlock()
+{
+    for (unsigned int i = 0; i < SIM_SAMPLES_PER_BLOCK; i++)
+    {
+        unsigned long at = _now - (SIM_SAMPLES_PER_BLOCK - 1 - i) * (1000000UL / SIM_ADC_SAMPLE_RATE);
+        if (++_vaneDecimation >= SIM_VANE_DECIMATION)
+        {
+            _vaneDecimation = 0;
+            _weather.addVaneSample(_vaneRaw());
+        }
+        _voltageSensor.add(_voltageRaw(at));
+    }
+}
+
+//wind_calc_task() and mppt_wind_update() of the sketch.
+void Simulation::_calculateWind()
+{
+    _weather.setRainClock(_hours, _day);
+    _weather.calculate();
+    int windSpeedX10 = _weather.getWindSpeedX10();
+    if (_config.cache && _loadCache.enter(windSpeedX10))
+    {
+        int cached = _loadCache.lookup(windSpeedX10);
+        if (cached >= 0 && cached != _state)
+        {
+            _mppt->jumpTo(cached);
+            _state = _mppt->getState();
+            _switch(_state);
+        }
+    }
+}
+
+//mppt_task() of the sketch, the power is calculated from the filtered voltage like on the board.
+void Simulation::_stepMppt()
+{
+    float volt = 0;
+    float noise = 0;
+    if (_voltageSensor.measure())
+    {
+        volt = _voltageSensor.getValue() * SIM_ADC_REFERENCE / SIM_ADC_MAX / _config.divider;
+        noise = _voltageSensor.getNoise() * SIM_ADC_REFERENCE / SIM_ADC_MAX / _config.divider;
+    }
+    float power = LoadCascade::power(volt, _state);
+    if (_config.cache)
+    {
+        _loadCache.update(_weather.getWindSpeedX10(), _state, power);
+    }
+    _powerCurve.add(_weather.getWindSpeedX10(), power, _state, _config.interval);
+    _mppt->setNoise(_config.deadband ? noise : 0);
+
+    auto start = std::chrono::steady_clock::now();
+    unsigned long long cycles = hostCycles();
+    switch (_config.mppt)
+    {
+    case SIM_MPPT_ADAPTIVE_STEP:
+        _state = _adaptiveStep.step(power, volt);
+        break;
+    case SIM_MPPT_INCREMENTAL_CONDUCTANCE:
+        _state = _incrementalConductance.step(power, volt);
+        break;
+    default:
+        _state = _perturbObserve.step(power, volt);
+        break;
+    }
+    _mpptCycles += hostCycles() - cycles;
+    _mpptTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    _mpptSteps++;
+    _switch(_state);
+}
+
+//Switches the MOSFETs of a State and counts what changed on the pins.
+void Simulation::_switch(int state)
+{
+    _cascadeSwitch.write(LoadCascade::pattern(state));
+    int switched = _readPins();
+    int changed = LoadCascade::pattern(switched) ^ LoadCascade::pattern(_switched);
+    if (changed != 0)
+    {
+        _switches += __builtin_popcount(changed);
+        _stateChanges++;
+    }
+    _switched = switched;
+}
+
+//Returns the State the MOSFET pins are in, the turbine sees what was written, not what the MPPT wanted.
+int Simulation::_readPins()
+{
+    int pattern = 0;
+    for (int i = 0; i < LOAD_STAGES; i++)
+    {
+        if (SimHal::pinLevel(SIM_MOSFET_PINS[i]) == HIGH)
+        {
+            pattern |= 1 << i;
+        }
+    }
+    return TurbineModel::stateOf(pattern);
+}
+
+//Returns the 12 bit reading of the vane, the position of the bin nearest to the wind direction, scattered by
+//vaneSpread.
+unsigned int Simulation::_vaneRaw()
+{
+    float direction = (float) _windDirection;
+    if (_config.vaneSpread > 0)
+    {
+        std::normal_distribution<float> spread(0, _config.vaneSpread);
+        direction += spread(_rng);
+    }
+    direction = fmodf(direction, 360.0f);
+    if (direction < 0)
+    {
+        direction += 360.0f;
+    }
+    unsigned char bin = (unsigned char) ((int) (direction / 22.5f + 0.5f) % 16);
+    for (int i = 0; i < VANE_POSITIONS; i++)
+    {
+        if (VANE_BIN[i] == bin)
+        {
+            return (unsigned int) (4095UL * VANE_RESISTANCE[i] / (VANE_RESISTANCE[i] + VANE_PULLUP));
+        }
+    }
+    return 0;
+}
+
+//Returns the 12 bit reading of the measurement pin at a time, with ripple and noise.
+unsigned int Simulation::_voltageRaw(unsigned long us)
+{
+    float u = _turbine.voltage(_switched) * _config.divider;
+    u *= 1 + _config.ripple * sinf(6.2831853f * _config.rippleHz * (us / 1e6f));
+    float raw = u * SIM_ADC_MAX / SIM_ADC_REFERENCE;
+    if (_config.noise > 0)
+    {
+        std::normal_distribution<float> noise(0, _config.noise);
+        raw += noise(_rng);
+    }
+    return (unsigned int) constrain(raw + 0.5f, 0.0f, (float) SIM_ADC_MAX);
+}
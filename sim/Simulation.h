@@ -0,0 +1,157 @@
+/**********************************************************
+** @file		Simulation.h
+**
+** One instance of the firmware logic on the host: scheduler,
+** ADSWeather, voltage filter, MPPT strategy, load cache and
+** cascade switch with the tasks and periods of the sketch,
+** connected to a TurbineModel. The caller sets the wind and
+** the rain and advances the time, the anemometer pulses, rain
+** tips and ADC samples are generated from them, and the MOSFET
+** pins the cascade switch wrote load the turbine.
+** The scheduler tasks have no context, only one Simulation
+** can run at a time.
+**
+
+*/
+
+#ifndef Simulation_h
+#define Simulation_h
+
+#include <Arduino.h>
+#include <ADSWeather.h>
+#include <Scheduler.h>
+#include <Mppt.h>
+#include <LoadCache.h>
+#include <PowerCurve.h>
+#include <VoltageSensor.h>
+#include <CascadeSwitch.h>
+#include "TurbineModel.h"
+#include <random>
+
+// Pins like in the sketch
+#define SIM_ANEMOMETER_PIN A0
+#define SIM_VANE_PIN A1
+#define SIM_MEASUREMENT_PIN A2
+#define SIM_RAIN_PIN 5
+
+// Reference voltage and highest reading of the ADC with 12 bit resolution
+#define SIM_ADC_REFERENCE 3.3f
+#define SIM_ADC_MAX 4095
+
+// Intervals (ms) of the sketch, the MPPT interval can be changed with SimConfig
+#define SIM_CALC_INTERVAL_SENSOR 1000
+#define SIM_CALC_INTERVAL_RESISTOR 100
+#define SIM_VANE_SAMPLE_INTERVAL 20
+// Sample pairs per second of the background ADC, every SIM_VANE_DECIMATION-th vane sample is used
+#define SIM_ADC_SAMPLE_RATE 250
+#define SIM_VANE_DECIMATION (SIM_ADC_SAMPLE_RATE * SIM_VANE_SAMPLE_INTERVAL / 1000)
+
+enum SimStrategy
+{
+    SIM_MPPT_PERTURB_OBSERVE,
+    SIM_MPPT_ADAPTIVE_STEP,
+    SIM_MPPT_INCREMENTAL_CONDUCTANCE
+};
+
+struct SimConfig
+{
+    SimStrategy mppt = SIM_MPPT_PERTURB_OBSERVE;
+    unsigned long interval = SIM_CALC_INTERVAL_RESISTOR; // ms between two MPPT steps
+    VoltageFilter filter = VOLTAGE_FILTER_RIPPLE;
+    float divider = 1;          // Voltage divider in front of the measurement pin
+    float noise = 2;            // ADC noise, standard deviation in LSB
+    float ripple = 0;           // Ripple amplitude, share of the voltage
+    float rippleHz = 50;
+    bool cache = false;         // Learn and use the load cache
+    bool deadband = true;       // Noise deadband of the MPPT
+    VaneAveraging vane = VANE_AVERAGING_CONSENSUS;
+    float vaneSpread = 0;       // Standard deviation of the direction of a vane sample, degrees
+    unsigned long seed = 1;     // Seed of the noise
+};
+
+
+class Simulation
+{
+public:
+    Simulation(const SimConfig &config, TurbineModel &turbine);
+    ~Simulation();
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    void begin();
+    void setWind(float windSpeed, int windDirection);
+    void setClock(unsigned char hours, unsigned char day);
+    void setRain(unsigned int tips);
+    void advance(unsigned long ms);
+
+    unsigned long getTime();
+    int getState();
+    float getPower();
+    double getEnergy();
+    double getEnergyBest();
+    unsigned long getSwitches();
+    unsigned long getStateChanges();
+    unsigned long getMpptSteps();
+    double getMpptTime();
+    unsigned long long getMpptCycles();
+
+    MpptBase &mppt();
+    ADSWeather &weather();
+    PowerCurve &powerCurve();
+
+    static bool parseStrategy(const char *name, SimStrategy &strategy);
+    static const char *strategyName(SimStrategy strategy);
+
+private:
+    SimConfig _config;
+    TurbineModel &_turbine;
+
+    Scheduler _scheduler;
+    VoltageSensor _voltageSensor;
+    LoadCache _loadCache;
+    PowerCurve _powerCurve;
+    CascadeSwitch _cascadeSwitch;
+    ADSWeather _weather;
+    PerturbObserve _perturbObserve;
+    AdaptiveStep _adaptiveStep;
+    IncrementalConductance _incrementalConductance;
+    MpptBase *_mppt;
+
+    int _state;                 // State the MPPT asked for
+    int _switched;              // State the MOSFET pins are in
+    unsigned int _vaneDecimation;
+    std::mt19937 _rng;
+
+    float _windSpeed;           // km/h
+    int _windDirection;
+    unsigned char _hours;
+    unsigned char _day;
+    unsigned long _pulsePeriod; // us, 0 without wind
+    unsigned long _nextPulse;
+    unsigned int _tips;         // Rain tips of the next advance()
+    unsigned long _now;         // us
+
+    double _energy;             // Ws
+    double _energyBest;
+    unsigned long _switches;    // MOSFET transitions
+    unsigned long _stateChanges;
+    unsigned long _mpptSteps;
+    double _mpptTime;           // s of host time in the step() of the strategy
+    unsigned long long _mpptCycles; // Host cycle counter (TSC on x86, 0 elsewhere) in step()
+
+    static Simulation *_active;
+    static void _vaneTask();
+    static void _windTask();
+    static void _mpptTask();
+
+    void _sampleBlock();
+    void _calculateWind();
+    void _stepMppt();
+    void _switch(int state);
+    int _readPins();
+    unsigned int _vaneRaw();
+    unsigned int _voltageRaw(unsigned long us);
+};
+
+
+#endif
@@ -0,0 +1,100 @@
+/**********************************************************
+** @file		TraceReader.cpp
+**
+** Parser for the CSV datalog of the sketch, see TraceReader.h
+**
+
+*/
+
+#include "TraceReader.h"
+#include <string.h>
+
+TraceReader::TraceReader()
+{
+    _file = nullptr;
+    _records = 0;
+    _skipped = 0;
+}
+
+TraceReader::~TraceReader()
+{
+    close();
+}
+
+//Opens a datalog, returns false if it can't be read.
+bool TraceReader::open(const char *fileName)
+{
+    close();
+    _file = fopen(fileName, "r");
+    _records = 0;
+    _skipped = 0;
+    return _file != nullptr;
+}
+
+//Reads the next record, returns false at the end of the file.
+bool TraceReader::next(TraceRecord &record)
+{
+    char line[TRACE_LINE_MAX];
+    while (_file != nullptr && fgets(line, sizeof(line), _file) != nullptr)
+    {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] != '\n' && !feof(_file))
+        {
+            // Too long, drop the rest of the line
+            int c;
+            while ((c = fgetc(_file)) != EOF && c != '\n')
+            {
+            }
+            _skipped++;
+            continue;
+        }
+        if (parse(line, record))
+        {
+            _records++;
+            return true;
+        }
+        if (line[0] != '\n' && line[0] != '\r')
+        {
+            _skipped++;
+        }
+    }
+    return false;
+}
+
+void TraceReader::close()
+{
+    if (_file != nullptr)
+    {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+//Returns the number of records read so far.
+unsigned long TraceReader::getRecords()
+{
+    return _records;
+}
+
+//Returns the number of lines that were not a record.
+unsigned long TraceReader::getSkipped()
+{
+    return _skipped;
+}
+
+//Parses one line of the datalog, the rain column is optional.
+bool TraceReader::parse(const char *line, TraceRecord &record)
+{
+    int fields = sscanf(line, "%f,%f,%d,%f,%d,%f,%d/%d,%d:%d:%d,%f", &record.windSpeed, &record.windGust,
+                        &record.windDirection, &record.power, &record.pattern, &record.voltage, &record.month,
+                        &record.day, &record.hours, &record.minutes, &record.seconds, &record.rain);
+    if (fields < 11)
+    {
+        return false;
+    }
+    if (fields < 12)
+    {
+        record.rain = 0;
+    }
+    return record.pattern >= 0 && record.pattern <= 255 && record.windSpeed >= 0;
+}
@@ -0,0 +1,63 @@
+/**********************************************************
+** @file		TraceReader.h
+**
+** Reads the CSV lines of a datalog.txt written by the sketch
+**   speed,gust,direction,power,state,voltage,month/day,
+**   hours:minutes:seconds[,rain]
+** one record per calculation interval. The rain column is
+** missing in logs written before the rain gauge was added.
+** "New Initialization" and other lines that do not parse are
+** skipped and counted.
+**
+
+*/
+
+#ifndef TraceReader_h
+#define TraceReader_h
+
+#include <stdio.h>
+
+// Longest line that is read, longer ones are skipped
+#define TRACE_LINE_MAX 128
+
+
+struct TraceRecord
+{
+    float windSpeed;        // km/h
+    float windGust;         // km/h
+    int windDirection;      // Degrees
+    float power;            // W
+    int pattern;            // Switched MOSFETs (the state column)
+    float voltage;          // V at the measurement pin
+    int month;
+    int day;
+    int hours;
+    int minutes;
+    int seconds;
+    float rain;             // mm, 0 without rain column
+};
+
+
+class TraceReader
+{
+public:
+    TraceReader();
+    ~TraceReader();
+
+    bool open(const char *fileName);
+    bool next(TraceRecord &record);
+    void close();
+
+    unsigned long getRecords();
+    unsigned long getSkipped();
+
+    static bool parse(const char *line, TraceRecord &record);
+
+private:
+    FILE *_file;
+    unsigned long _records;
+    unsigned long _skipped;
+};
+
+
+#endif
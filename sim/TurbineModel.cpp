@@ -0,0 +1,198 @@
+/**********************************************************
+** @file		TurbineModel.cpp
+**
+** Source and rotor model of the turbine, see TurbineModel.h
+**
+
+*/
+
+#include "TurbineModel.h"
+
+TurbineModel::TurbineModel(float internalResistance)
+{
+    _kind = TURBINE_MODEL_SOURCE;
+    _internalResistance = internalResistance;
+    _source = 0;
+    _wind = 0;
+    _omega = 0;
+    _best = -1;
+    _bestState = 0;
+}
+
+void TurbineModel::setKind(TurbineModelKind kind)
+{
+    _kind = kind;
+    _best = -1;
+}
+
+TurbineModelKind TurbineModel::getKind()
+{
+    return _kind;
+}
+
+void TurbineModel::setInternalResistance(float internalResistance)
+{
+    _internalResistance = internalResistance;
+    _best = -1;
+}
+
+//Sets the source voltage E of the source model directly.
+void TurbineModel::setSource(float voltage)
+{
+    if (voltage != _source)
+    {
+        _source = voltage;
+        _best = -1;
+    }
+}
+
+//Estimates E of the source model from the cascade voltage of a record and the MOSFETs that were switched at the time.
+void TurbineModel::fromRecord(float voltage, int pattern)
+{
+    float resistance = LoadCascade::resistance(stateOf(pattern));
+    setSource(voltage * (resistance + _internalResistance) / resistance);
+}
+
+//Sets the wind speed (m/s) of the rotor model.
+void TurbineModel::setWind(float windSpeed)
+{
+    if (windSpeed != _wind)
+    {
+        _wind = windSpeed < 0 ? 0 : windSpeed;
+        _best = -1;
+    }
+}
+
+//Advances the rotor by seconds with the cascade in state, the difference of the torques accelerates it.
+void TurbineModel::update(int state, float seconds)
+{
+    if (_kind != TURBINE_MODEL_ROTOR)
+    {
+        return;
+    }
+    float torque = _aeroTorque(_omega) - TURBINE_KE * _current(_omega, state);
+    _omega += torque / TURBINE_INERTIA * seconds;
+    if (_omega < 0)
+    {
+        _omega = 0;
+    }
+}
+
+float TurbineModel::getSource()
+{
+    return _kind == TURBINE_MODEL_ROTOR ? TURBINE_KE * _omega : _source;
+}
+
+//Returns the rotor speed (rad/s), 0 in the source model.
+float TurbineModel::getRotorSpeed()
+{
+    return _omega;
+}
+
+//Returns the voltage across the cascade in a state.
+float TurbineModel::voltage(int state)
+{
+    if (_kind == TURBINE_MODEL_ROTOR)
+    {
+        return _current(_omega, state) * LoadCascade::resistance(state);
+    }
+    float resistance = LoadCascade::resistance(state);
+    return _source * resistance / (resistance + _internalResistance);
+}
+
+//Returns the power in the cascade in a state at the current rotor speed.
+float TurbineModel::power(int state)
+{
+    float u = voltage(state);
+    return u * u * LoadCascade::conductance(state);
+}
+
+//Returns the power in the cascade once the rotor settled with the cascade in state, the same as power() for the source
+//model.
+float TurbineModel::steadyPower(int state)
+{
+    if (_kind != TURBINE_MODEL_ROTOR)
+    {
+        return power(state);
+    }
+    float i = _current(_steadyOmega(state), state);
+    return i * i * LoadCascade::resistance(state);
+}
+
+//Returns the highest steady power any state reaches at the current wind or source voltage, the unreachable E^2 / (4 Ri)
+//is not what a perfect MPPT could get.
+float TurbineModel::bestPower(int *bestState)
+{
+    if (_best < 0)
+    {
+        _best = 0;
+        _bestState = 0;
+        for (int i = 0; i < LOAD_STATES; i++)
+        {
+            float p = steadyPower(i);
+            if (p > _best)
+            {
+                _best = p;
+                _bestState = i;
+            }
+        }
+    }
+    if (bestState != nullptr)
+    {
+        *bestState = _bestState;
+    }
+    return _best;
+}
+
+//Returns the state that switches pattern, the inverse of LoadCascade::pattern().
+int TurbineModel::stateOf(int pattern)
+{
+    static int inverse[LOAD_STATES];
+    static bool ready = false;
+    if (!ready)
+    {
+        for (int state = 0; state < LOAD_STATES; state++)
+        {
+            inverse[LoadCascade::pattern(state)] = state;
+        }
+        ready = true;
+    }
+    return inverse[pattern & 0xFF];
+}
+
+//Returns the torque of the wind on the rotor, P / omega = 1/2 rho pi r^3 v^2 Cp(lambda) / lambda, which stays finite
+//at standstill.
+float TurbineModel::_aeroTorque(float omega)
+{
+    float a = 0.5f * TURBINE_AIR_DENSITY * 3.14159265f * TURBINE_RADIUS * TURBINE_RADIUS * TURBINE_RADIUS *
+              TURBINE_CP_MAX;
+    return a * (2.0f * _wind * _wind / TURBINE_TSR - TURBINE_RADIUS * omega * _wind / (TURBINE_TSR * TURBINE_TSR));
+}
+
+//Returns the current through rectifier and cascade, 0 while E is below the drop of the rectifier.
+float TurbineModel::_current(float omega, int state)
+{
+    float e = TURBINE_KE * omega - TURBINE_RECTIFIER_DROP;
+    if (e <= 0)
+    {
+        return 0;
+    }
+    return e / (LoadCascade::resistance(state) + _internalResistance);
+}
+
+//Returns the rotor speed at which wind and load torque are equal, both are linear in omega.
+float TurbineModel::_steadyOmega(int state)
+{
+    float a = 0.5f * TURBINE_AIR_DENSITY * 3.14159265f * TURBINE_RADIUS * TURBINE_RADIUS * TURBINE_RADIUS *
+              TURBINE_CP_MAX;
+    float c1 = 2.0f * a * _wind * _wind / TURBINE_TSR;
+    float c2 = a * TURBINE_RADIUS * _wind / (TURBINE_TSR * TURBINE_TSR);
+    float total = LoadCascade::resistance(state) + _internalResistance;
+    float omega = (c1 + TURBINE_KE * TURBINE_RECTIFIER_DROP / total) / (c2 + TURBINE_KE * TURBINE_KE / total);
+    if (TURBINE_KE * omega <= TURBINE_RECTIFIER_DROP)
+    {
+        // No current flows, the rotor runs free
+        return c2 > 0 ? c1 / c2 : 0;
+    }
+    return omega;
+}
@@ -0,0 +1,109 @@
+/**********************************************************
+** @file		TurbineModel.h
+**
+** Electrical model of the turbine for the simulation, with
+** two kinds of source:
+**  TURBINE_MODEL_SOURCE  a source voltage E behind the
+**                        internal resistance Ri (Thevenin
+**                        equivalent of generator and
+**                        rectifier), estimated from every
+**                        logged record by fromRecord(). The
+**                        power in the cascade is highest at
+**                        R = Ri whatever the wind.
+**  TURBINE_MODEL_ROTOR   a rotor with the power curve
+**                        P = 1/2 rho A v^3 Cp(lambda) driving
+**                        a generator with E = ke * omega and
+**                        a rectifier that drops
+**                        TURBINE_RECTIFIER_DROP. The load
+**                        brakes the rotor, its inertia makes
+**                        the speed follow the wind and the
+**                        load with a delay. The best load
+**                        falls with the wind speed (about 1/v)
+**                        like on the real turbine.
+** Cp(lambda) is a parabola with its maximum TURBINE_CP_MAX at
+** the tip speed ratio TURBINE_TSR and 0 at 0 and twice the
+** ratio, which keeps the steady state rotor speed linear in
+** the load and solvable in closed form.
+**
+
+*/
+
+#ifndef TurbineModel_h
+#define TurbineModel_h
+
+#include "LoadCascade.h"
+
+// Internal resistance (Ohm) of generator and rectifier
+#ifndef TURBINE_INTERNAL_RESISTANCE
+#define TURBINE_INTERNAL_RESISTANCE 10.0f
+#endif
+// Rotor radius (m), highest power coefficient and the tip speed ratio it is reached at
+#ifndef TURBINE_RADIUS
+#define TURBINE_RADIUS 0.2f
+#endif
+#ifndef TURBINE_CP_MAX
+#define TURBINE_CP_MAX 0.35f
+#endif
+#ifndef TURBINE_TSR
+#define TURBINE_TSR 6.0f
+#endif
+// Moment of inertia of rotor and generator (kg m^2)
+#ifndef TURBINE_INERTIA
+#define TURBINE_INERTIA 0.002f
+#endif
+// Generator constant (V s / rad) and the voltage drop of the rectifier (V)
+#ifndef TURBINE_KE
+#define TURBINE_KE 0.08f
+#endif
+#ifndef TURBINE_RECTIFIER_DROP
+#define TURBINE_RECTIFIER_DROP 1.4f
+#endif
+// Density of the air (kg/m^3)
+#define TURBINE_AIR_DENSITY 1.225f
+
+enum TurbineModelKind
+{
+    TURBINE_MODEL_SOURCE,
+    TURBINE_MODEL_ROTOR
+};
+
+
+class TurbineModel
+{
+public:
+    TurbineModel(float internalResistance = TURBINE_INTERNAL_RESISTANCE);
+
+    void setKind(TurbineModelKind kind);
+    TurbineModelKind getKind();
+    void setInternalResistance(float internalResistance);
+
+    void setSource(float voltage);
+    void fromRecord(float voltage, int pattern);
+    void setWind(float windSpeed);
+    void update(int state, float seconds);
+
+    float getSource();
+    float getRotorSpeed();
+    float voltage(int state);
+    float power(int state);
+    float steadyPower(int state);
+    float bestPower(int *bestState = nullptr);
+
+    static int stateOf(int pattern);
+
+private:
+    TurbineModelKind _kind;
+    float _internalResistance;
+    float _source;              // E (V) of the source model
+    float _wind;                // m/s
+    float _omega;               // Rotor speed (rad/s)
+    float _best;                // Cached bestPower(), negative when the inputs changed
+    int _bestState;
+
+    float _aeroTorque(float omega);
+    float _current(float omega, int state);
+    float _steadyOmega(int state);
+};
+
+
+#endif
@@ -0,0 +1,128 @@
+/**********************************************************
+** @file		WindProfile.cpp
+**
+** Synthetic and recorded wind profiles, see WindProfile.h
+**
+
+*/
+
+#include "WindProfile.h"
+#include "TraceReader.h"
+#include <math.h>
+#include <string.h>
+#include <random>
+
+// Speeds (m/s) of the staircase, one step per minute
+static const float STEPS[] = {3, 5, 8, 11, 8, 4, 6, 3};
+#define STEP_TIME 60.0f
+
+WindProfile::WindProfile(WindProfileKind kind, const char *name, float duration, unsigned long seed)
+    : _name(name)
+{
+    _kind = kind;
+    _duration = duration;
+    _sampleStep = 1;
+    if (kind == WIND_PROFILE_TURBULENT)
+    {
+        // u[n+1] = a u[n] + sqrt(1 - a^2) sigma e[n] keeps the variance at sigma^2
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> normal(0, 1);
+        float a = expf(-WIND_TURBULENCE_STEP / WIND_TURBULENCE_TIME);
+        float sigma = WIND_TURBULENCE_INTENSITY;
+        float u = 0;
+        _sampleStep = WIND_TURBULENCE_STEP;
+        for (float t = 0; t <= duration + _sampleStep; t += _sampleStep)
+        {
+            _samples.push_back(u);
+            u = a * u + sqrtf(1 - a * a) * sigma * normal(rng);
+        }
+    }
+}
+
+//Reads the wind speeds of a datalog.txt into profile, returns false without records.
+bool WindProfile::fromTrace(const char *fileName, WindProfile &profile)
+{
+    TraceReader reader;
+    if (!reader.open(fileName))
+    {
+        return false;
+    }
+    const char *base = strrchr(fileName, '/');
+    profile = WindProfile(WIND_PROFILE_TRACE, base != nullptr ? base + 1 : fileName, 0);
+    TraceRecord record;
+    while (reader.next(record))
+    {
+        profile._samples.push_back(record.windSpeed / 3.6f);
+    }
+    profile._sampleStep = WIND_TRACE_INTERVAL;
+    profile._duration = profile._samples.size() * profile._sampleStep;
+    return !profile._samples.empty();
+}
+
+//Returns the synthetic profiles of the benchmark.
+std::vector<WindProfile> WindProfile::library(unsigned long seed)
+{
+    std::vector<WindProfile> profiles;
+    profiles.push_back(WindProfile(WIND_PROFILE_STEPS, "steps", STEP_TIME * (sizeof(STEPS) / sizeof(STEPS[0]))));
+    profiles.push_back(WindProfile(WIND_PROFILE_RAMP, "ramp", 600));
+    profiles.push_back(WindProfile(WIND_PROFILE_GUSTS, "gusts", 300));
+    profiles.push_back(WindProfile(WIND_PROFILE_TURBULENT, "turbulent", 600, seed));
+    return profiles;
+}
+
+const char *WindProfile::name() const
+{
+    return _name.c_str();
+}
+
+//Returns the length of the profile (s).
+float WindProfile::duration() const
+{
+    return _duration;
+}
+
+//Returns the wind speed (m/s) t seconds after the start.
+float WindProfile::speed(float t) const
+{
+    switch (_kind)
+    {
+    case WIND_PROFILE_STEPS:
+    {
+        int i = (int) (t / STEP_TIME);
+        int last = sizeof(STEPS) / sizeof(STEPS[0]) - 1;
+        return STEPS[i < 0 ? 0 : (i > last ? last : i)];
+    }
+    case WIND_PROFILE_RAMP:
+        // 3 m/s up to 12 m/s in the first half and back
+        return 3.0f + 9.0f * (1.0f - fabsf(2.0f * t / _duration - 1.0f));
+    case WIND_PROFILE_GUSTS:
+    {
+        // 6 m/s with a gust of +6 m/s lasting 10 s every 40 s
+        float phase = fmodf(t, 40.0f) - 20.0f;
+        if (phase < 0 || phase > 10.0f)
+        {
+            return 6.0f;
+        }
+        return 6.0f + 3.0f * (1.0f - cosf(2.0f * 3.14159265f * phase / 10.0f));
+    }
+    case WIND_PROFILE_TURBULENT:
+    case WIND_PROFILE_TRACE:
+    default:
+    {
+        if (_samples.empty())
+        {
+            return 0;
+        }
+        float position = t / _sampleStep;
+        size_t i = position <= 0 ? 0 : (size_t) position;
+        if (i + 1 >= _samples.size())
+        {
+            i = _samples.size() - 1;
+        }
+        float fraction = i + 1 < _samples.size() ? position - i : 0;
+        float value = _samples[i] + (i + 1 < _samples.size() ? fraction * (_samples[i + 1] - _samples[i]) : 0);
+        // The turbulence is relative to a mean wind of 7 m/s
+        return _kind == WIND_PROFILE_TURBULENT ? fmaxf(0, 7.0f * (1 + value)) : value;
+    }
+    }
+}
@@ -0,0 +1,66 @@
+/**********************************************************
+** @file		WindProfile.h
+**
+** Wind speed over time for the benchmark, synthetic or from
+** the wind column of a recorded datalog.txt:
+**  WIND_PROFILE_STEPS      a staircase up and down
+**  WIND_PROFILE_RAMP       a slow rise and fall
+**  WIND_PROFILE_GUSTS      gust bursts (1 - cos shape like the
+**                          IEC extreme operating gust) on a
+**                          steady wind
+**  WIND_PROFILE_TURBULENT  a mean wind with first order
+**                          (exponentially correlated) random
+**                          turbulence, seeded
+**  WIND_PROFILE_TRACE      a recorded log, linear between the
+**                          records (one per second)
+** The speeds are in m/s.
+**
+
+*/
+
+#ifndef WindProfile_h
+#define WindProfile_h
+
+#include <vector>
+#include <string>
+
+// Time constant (s) and intensity (standard deviation / mean) of the turbulence
+#define WIND_TURBULENCE_TIME 8.0f
+#define WIND_TURBULENCE_INTENSITY 0.2f
+// Time step (s) the turbulence is generated with
+#define WIND_TURBULENCE_STEP 0.1f
+// Time (s) between two records of a trace
+#define WIND_TRACE_INTERVAL 1.0f
+
+enum WindProfileKind
+{
+    WIND_PROFILE_STEPS,
+    WIND_PROFILE_RAMP,
+    WIND_PROFILE_GUSTS,
+    WIND_PROFILE_TURBULENT,
+    WIND_PROFILE_TRACE
+};
+
+
+class WindProfile
+{
+public:
+    WindProfile(WindProfileKind kind, const char *name, float duration, unsigned long seed = 1);
+
+    static bool fromTrace(const char *fileName, WindProfile &profile);
+    static std::vector<WindProfile> library(unsigned long seed = 1);
+
+    const char *name() const;
+    float duration() const;
+    float speed(float t) const;
+
+private:
+    WindProfileKind _kind;
+    std::string _name;
+    float _duration;                // s
+    std::vector<float> _samples;    // Speeds of the trace and the turbulence
+    float _sampleStep;              // s between two samples
+};
+
+
+#endif
@@ -0,0 +1,301 @@
+/**********************************************************
+** @file		main.cpp
+**
+** Runs the firmware logic on the host, faster than real time.
+**
+** Replay of a datalog.txt through ADSWeather, the voltage
+** filter and the MPPT: every record is one calculation
+** interval, the logged wind speed becomes anemometer pulses,
+** the direction vane readings, the rain tips of the
+** gauge, and voltage and MOSFET pattern give the source
+** voltage of the turbine (see TurbineModel.h). One CSV row
+** per record goes to stdout, the summary with the harvested
+** energy against the best reachable one to stderr.
+**   .pio/build/native/program datalog.txt [options] > sim.csv
+**
+** Benchmark of the MPPT strategies on the rotor model with
+** the synthetic wind profiles and the wind of the given logs
+** (see Benchmark.h), the results go to stdout.
+**   .pio/build/native/program bench [datalog.txt ...]
+**       [options] [--json] [--baseline old.csv]
+**       [--tolerance T] > bench.csv
+** It exits with 1 if the baseline shows a regression.
+**
+** Build with pio run -e native, pio test -e native runs
+** the unit tests in test/ against the same sources. Options
+**   --mppt po|adaptive|inc     MPPT strategy (po, the
+**                              benchmark runs all by default)
+**   --filter mean|median|ripple  voltage filter (ripple)
+**   --interval MS              ms between two MPPT steps (100)
+**   --model source|rotor       turbine of the replay (source)
+**   --ri OHM                   internal resistance (10)
+**   --divider D                voltage divider (1, bench 0.055)
+**   --noise LSB                ADC noise, standard deviation (2)
+**   --ripple F                 ripple amplitude, share of U (0)
+**   --ripple-hz HZ             ripple frequency (50)
+**   --vane consensus|vector    averaging of the vane samples
+**                              (consensus)
+**   --vane-spread DEG          scatter of the vane samples,
+**                              standard deviation (0)
+**   --cache                    learn and use the load cache
+**   --no-deadband              no noise deadband in the MPPT
+**   --seed N                   seed of the noise (1)
+**   --quiet                    replay without CSV rows
+**   --curve                    power curve of the replay
+**                              after the summary (stderr)
+**
+
+*/
+
+#include "Simulation.h"
+#include "TraceReader.h"
+#include "TurbineModel.h"
+#include "WindProfile.h"
+#include "Benchmark.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// Voltage divider of the benchmark, the rotor model reaches about 55 V
+#define BENCH_DIVIDER 0.055f
+
+// Options of the command line
+struct Options {
+    SimConfig config;
+    bool mpptSet = false;
+    bool dividerSet = false;
+    TurbineModelKind model = TURBINE_MODEL_SOURCE;
+    float internalResistance = TURBINE_INTERNAL_RESISTANCE;
+    bool quiet = false;
+    bool curve = false;
+    bool json = false;
+    const char *baseline = nullptr;
+    float tolerance = 0.01f;
+    std::vector<const char *> traces;
+};
+
+Options options;
+
+bool parse_options(int argc, char **argv, int first);
+
+int replay(const char *trace);
+
+int bench();
+
+void usage(const char *program);
+
+// The unit tests in test/ are linked with the simulation and bring their own main()
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char **argv) {
+    bool benchmark = argc > 1 && !strcmp(argv[1], "bench");
+    if (!parse_options(argc, argv, benchmark ? 2 : 1) || (!benchmark && options.traces.size() != 1)) {
+        usage(argv[0]);
+        return 2;
+    }
+    return benchmark ? bench() : replay(options.traces[0]);
+}
+#endif
+
+void usage(const char *program) {
+    fprintf(stderr, "usage: %s datalog.txt [options]\n"
+                    "       %s bench [datalog.txt ...] [options] [--json] [--baseline old.csv] [--tolerance T]\n"
+                    "options: [--mppt po|adaptive|inc] [--filter mean|median|ripple] [--interval MS]\n"
+                    "         [--model source|rotor] [--ri OHM] [--divider D] [--noise LSB] [--ripple F]\n"
+                    "         [--ripple-hz HZ] [--vane consensus|vector] [--vane-spread DEG] [--cache]\n"
+                    "         [--no-deadband] [--seed N] [--quiet] [--curve]\n", program, program);
+}
+
+bool parse_options(int argc, char **argv, int first) {
+    /** Reads the command line from argv[first] on into options, returns false on unknown options. **/
+    SimConfig &config = options.config;
+    for (int i = first; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg[0] != '-') {
+            options.traces.push_back(arg);
+        } else if (!strcmp(arg, "--cache")) {
+            config.cache = true;
+        } else if (!strcmp(arg, "--no-deadband")) {
+            config.deadband = false;
+        } else if (!strcmp(arg, "--quiet")) {
+            options.quiet = true;
+        } else if (!strcmp(arg, "--curve")) {
+            options.curve = true;
+        } else if (!strcmp(arg, "--json")) {
+            options.json = true;
+        } else if (value == nullptr) {
+            return false;
+        } else {
+            i++;
+            if (!strcmp(arg, "--mppt")) {
+                if (!Simulation::parseStrategy(value, config.mppt)) {
+                    return false;
+                }
+                options.mpptSet = true;
+            } else if (!strcmp(arg, "--filter")) {
+                if (!strcmp(value, "mean")) {
+                    config.filter = VOLTAGE_FILTER_MEAN;
+                } else if (!strcmp(value, "median")) {
+                    config.filter = VOLTAGE_FILTER_MEDIAN;
+                } else if (!strcmp(value, "ripple")) {
+                    config.filter = VOLTAGE_FILTER_RIPPLE;
+                } else {
+                    return false;
+                }
+            } else if (!strcmp(arg, "--model")) {
+                if (!strcmp(value, "source")) {
+                    options.model = TURBINE_MODEL_SOURCE;
+                } else if (!strcmp(value, "rotor")) {
+                    options.model = TURBINE_MODEL_ROTOR;
+                } else {
+                    return false;
+                }
+            } else if (!strcmp(arg, "--vane")) {
+                if (!strcmp(value, "consensus")) {
+                    config.vane = VANE_AVERAGING_CONSENSUS;
+                } else if (!strcmp(value, "vector")) {
+                    config.vane = VANE_AVERAGING_VECTOR;
+                } else {
+                    return false;
+                }
+            } else if (!strcmp(arg, "--vane-spread")) {
+                config.vaneSpread = atof(value);
+            } else if (!strcmp(arg, "--interval")) {
+                config.interval = strtoul(value, nullptr, 10);
+            } else if (!strcmp(arg, "--ri")) {
+                options.internalResistance = atof(value);
+            } else if (!strcmp(arg, "--divider")) {
+                config.divider = atof(value);
+                options.dividerSet = true;
+            } else if (!strcmp(arg, "--noise")) {
+                config.noise = atof(value);
+            } else if (!strcmp(arg, "--ripple")) {
+                config.ripple = atof(value);
+            } else if (!strcmp(arg, "--ripple-hz")) {
+                config.rippleHz = atof(value);
+            } else if (!strcmp(arg, "--seed")) {
+                config.seed = strtoul(value, nullptr, 10);
+            } else if (!strcmp(arg, "--baseline")) {
+                options.baseline = value;
+            } else if (!strcmp(arg, "--tolerance")) {
+                options.tolerance = atof(value);
+            } else {
+                return false;
+            }
+        }
+    }
+    return options.internalResistance > 0 && config.divider > 0 && config.interval > 0;
+}
+
+int replay(const char *trace) {
+    /** Replays a datalog record by record and writes one CSV row per record. **/
+    TraceReader reader;
+    if (!reader.open(trace)) {
+        fprintf(stderr, "can't open %s\n", trace);
+        return 1;
+    }
+    TurbineModel turbine(options.internalResistance);
+    turbine.setKind(options.model);
+    Simulation sim(options.config, turbine);
+    sim.begin();
+
+    if (!options.quiet) {
+        printf("time,wind,wind_measured,direction,direction_measured,state,pattern,voltage,power,power_best,"
+               "power_logged\n");
+    }
+    auto wallStart = std::chrono::steady_clock::now();
+    double energyLogged = 0;
+    double windError = 0;
+    double directionError = 0;
+    TraceRecord record;
+    while (reader.next(record)) {
+        if (options.model == TURBINE_MODEL_SOURCE) {
+            turbine.fromRecord(record.voltage / options.config.divider, record.pattern);
+        }
+        sim.setWind(record.windSpeed, record.windDirection);
+        sim.setClock(record.hours, record.day);
+        sim.setRain((unsigned int) (record.rain / RAIN_MM_PER_TIP + 0.5f));
+        sim.advance(SIM_CALC_INTERVAL_SENSOR);
+
+        energyLogged += record.power * (SIM_CALC_INTERVAL_SENSOR / 1000.0);
+        float measured = sim.weather().getWindSpeedX10() / 10.0f;
+        windError += fabs(measured - record.windSpeed);
+        int offset = ((sim.weather().getWindDirection() - record.windDirection) % 360 + 540) % 360 - 180;
+        directionError += abs(offset);
+        if (!options.quiet) {
+            int s = sim.getState();
+            printf("%.1f,%.1f,%.1f,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n", sim.getTime() / 1000.0, record.windSpeed,
+                   measured, record.windDirection, sim.weather().getWindDirection(), s, LoadCascade::pattern(s),
+                   turbine.voltage(s), sim.getPower(), turbine.bestPower(), record.power);
+        }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    unsigned long records = reader.getRecords();
+    double simulated = sim.getTime() / 1000.0;
+    fprintf(stderr, "records %lu (%lu lines skipped), %.0f s simulated in %.3f s (%.0fx real time)\n", records,
+            reader.getSkipped(), simulated, wall, wall > 0 ? simulated / wall : 0);
+    fprintf(stderr, "energy %.4f Wh, best reachable %.4f Wh (%.1f %%), logged %.4f Wh\n", sim.getEnergy() / 3600,
+            sim.getEnergyBest() / 3600, sim.getEnergyBest() > 0 ? 100 * sim.getEnergy() / sim.getEnergyBest() : 0,
+            energyLogged / 3600);
+    fprintf(stderr, "mppt %s: %lu steps, %lu moves, %lu holds, %lu MOSFET switches; wind error %.2f km/h mean, "
+                    "direction error %.1f degrees mean, rain %.2f mm\n", Simulation::strategyName(options.config.mppt),
+            sim.mppt().getSteps(), sim.mppt().getMoves(), sim.mppt().getHolds(), sim.getSwitches(),
+            records > 0 ? windError / records : 0, records > 0 ? directionError / records : 0,
+            sim.weather().getRainTotal());
+    if (options.curve) {
+        PowerCurve &curve = sim.powerCurve();
+        fprintf(stderr, "power curve, %.4f Wh in %.2f h\nwind_ms,steps,power_mean,power_max,state_mean\n",
+                curve.getEnergy(), curve.getHours());
+        PowerCurveBin entry;
+        for (unsigned char bin = 0; bin < POWER_CURVE_BINS; bin++) {
+            if (curve.getBin(bin, entry)) {
+                fprintf(stderr, "%.1f,%lu,%.3f,%.3f,%.1f\n", PowerCurve::binSpeed(bin), (unsigned long) entry.count,
+                        entry.powerMean, entry.powerMax, entry.stateMean);
+            }
+        }
+    }
+    return 0;
+}
+
+int bench() {
+    /** Runs every strategy (or the one of --mppt) through every profile and writes the results. **/
+    std::vector<WindProfile> profiles = WindProfile::library(options.config.seed);
+    for (const char *trace : options.traces) {
+        WindProfile profile(WIND_PROFILE_TRACE, trace, 0);
+        if (!WindProfile::fromTrace(trace, profile)) {
+            fprintf(stderr, "can't read %s\n", trace);
+            return 2;
+        }
+        profiles.push_back(profile);
+    }
+    SimConfig config = options.config;
+    if (!options.dividerSet) {
+        config.divider = BENCH_DIVIDER;
+    }
+    std::vector<BenchResult> results;
+    for (const WindProfile &profile : profiles) {
+        for (int s = SIM_MPPT_PERTURB_OBSERVE; s <= SIM_MPPT_INCREMENTAL_CONDUCTANCE; s++) {
+            if (options.mpptSet && s != options.config.mppt) {
+                continue;
+            }
+            config.mppt = (SimStrategy) s;
+            results.push_back(Benchmark::run(profile, config));
+        }
+    }
+    if (options.json) {
+        Benchmark::writeJson(stdout, results);
+    } else {
+        Benchmark::writeCsv(stdout, results);
+    }
+    if (options.baseline != nullptr) {
+        int regressions = Benchmark::compare(options.baseline, results, options.tolerance);
+        if (regressions < 0) {
+            fprintf(stderr, "can't read %s\n", options.baseline);
+            return 2;
+        }
+        return regressions > 0 ? 1 : 0;
+    }
+    return 0;
+}
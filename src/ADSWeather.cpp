@@ -18,113 +18,442 @@
 */
 
 #include "Arduino.h"
+#include "Platform.h"
 #include "ADSWeather.h"
+#include "Profiler.h"
+#include <math.h>
+
+#ifdef PLATFORM_SAMD21
+#include "wiring_private.h"
+#endif
 
 #define DEBOUNCE_TIME 15
 #define CALC_INTERVAL 1000
 
-volatile int _anemometerCounter;
-volatile unsigned long last_micros_rg;
-volatile unsigned long last_micros_an;
+#define NO_SLOT 0xFF
+
+//Stations by interrupt slot
+ADSWeather *ADSWeather::_station[ADS_WEATHER_MAX_STATIONS] = {};
+
+//Station whose edges are counted by TC3 and captured by TCC0, the peripherals exist once
+static ADSWeather *_hwStation = nullptr;
+static ADSWeather *_captureStation = nullptr;
 
 
+//Initialization routine for a station without rain gauge.
+ADSWeather::ADSWeather(int windDirPin, int windSpdPin) : ADSWeather(-1, windDirPin, windSpdPin)
+{
+}
+
 //Initialization routine. This functrion sets up the pins on the Arduino and initializes variables.
-ADSWeather::ADSWeather(int windDirPin, int windSpdPin)
+ADSWeather::ADSWeather(int rainPin, int windDirPin, int windSpdPin)
 {
 
 
     //Initialization routine
-    _anemometerCounter = 0;
-    _gustIdx = 0;
+    _tipCount = 0;
+    _tipLast = 0;
+    _rainTips = 0;
+    _rainTotal = 0;
+    _rainHour = 0;
+    _rainDay = 0;
+    _rainLastHour = 0;
+    _rainLastDay = 0;
+    _rainClockHour = 0xFF;
+    _rainClockDay = 0xFF;
+    _pulseCount = 0;
+    _pulseFirst = 0;
+    _pulseLast = 0;
+    _slot = NO_SLOT;
+    for (unsigned char i = 0; i < ADS_WEATHER_MAX_STATIONS; i++)
+    {
+        if (_station[i] == nullptr)
+        {
+            _station[i] = this;
+            _slot = i;
+            break;
+        }
+    }
+    _hwCounter = false;
+    _hwCount = 0;
+    _periodMode = false;
+    _capture = false;
+    _captureIrq = false;
+    _captureCount = 0;
+    _edgeCount = 0;
+    _edgeRate = 1000000UL;
+    _edgeMask = 0xFFFFFFFFUL;
+    _edgeRefValid = false;
+    _edgeRefAge = 0;
+    _periodSpd = 0;
+    _windSpd = 0;
+    _windSpdMax = 0;
+    _gustHead = 0;
+    _gustCount = 0;
+    _gustClock = 0;
+    _gustWindow = 30;
+    _gustWmo = false;
+    _gustMeanIdx = 0;
+    //The first update() calculates right away, then every CALC_INTERVAL without drifting.
+    _calcTimer = PeriodicTimer(CALC_INTERVAL);
+    _calcTimer.start(0);
+    for (unsigned char i = 0; i < GUST_WMO_SAMPLES; i++)
+    {
+        _gustMean[i] = 0;
+    }
     _vaneSampleIdx = 0;
+    _vaneSampleCount = 0;
+    _windDir = 0;
+    for (unsigned char i = 0; i < 16; i++)
+    {
+        _windDirBin[i] = 0;
+        _windDirWindow[i] = 0;
+    }
+    _windDirX = 0;
+    _windDirY = 0;
+    _vaneAveraging = VANE_AVERAGING_CONSENSUS;
 
+    _rainPin = rainPin;
     _windDirPin = windDirPin;
     _windSpdPin = windSpdPin;
+    _vaneThresholds = VANE_THRESHOLDS_10BIT;
 
 
     pinMode(_windSpdPin, INPUT);
     digitalWrite(_windSpdPin, HIGH);
 
+    if (_rainPin >= 0)
+    {
+        pinMode(_rainPin, INPUT);
+        digitalWrite(_rainPin, HIGH);
+    }
+
     pinMode(_windDirPin, INPUT);
 }
 
+//Releases the interrupt slot and the hardware counter.
+ADSWeather::~ADSWeather()
+{
+    if (_slot != NO_SLOT)
+    {
+        detachInterrupt(digitalPinToInterrupt(_windSpdPin));
+        if (_rainPin >= 0)
+        {
+            detachInterrupt(digitalPinToInterrupt(_rainPin));
+        }
+        _station[_slot] = nullptr;
+    }
+    if (_hwStation == this)
+    {
+        _hwStation = nullptr;
+    }
+    if (_captureStation == this)
+    {
+        _enableCapture(false);
+        _captureStation = nullptr;
+    }
+}
+
+//Attaches the interrupt of this station to its anemometer pin. Returns false if all ADS_WEATHER_MAX_STATIONS slots
+//are taken.
+bool ADSWeather::attachAnemometer(int mode)
+{
+    ADSWeatherIsr isr = anemometerIsr();
+    if (isr == nullptr)
+    {
+        return false;
+    }
+    attachInterrupt(digitalPinToInterrupt(_windSpdPin), isr, mode);
+    return true;
+}
+
+//Returns the anemometer ISR of this station, for attaching it by hand. nullptr if the station got no slot.
+ADSWeatherIsr ADSWeather::anemometerIsr()
+{
+    if (_slot == NO_SLOT)
+    {
+        return nullptr;
+    }
+    return _slotIsr(_slot, false, std::make_index_sequence<ADS_WEATHER_MAX_STATIONS>());
+}
+
+//Attaches the interrupt of this station to its rain gauge pin. TC3 is taken by the anemometer, the tips are rare
+//enough for an interrupt each. Call this before useHardwareCounter(), attachInterrupt() changes the EIC clock. Returns
+//false without rain gauge or slot.
+bool ADSWeather::attachRainGauge(int mode)
+{
+    ADSWeatherIsr isr = rainGaugeIsr();
+    if (isr == nullptr)
+    {
+        return false;
+    }
+    attachInterrupt(digitalPinToInterrupt(_rainPin), isr, mode);
+    return true;
+}
+
+//Returns the rain gauge ISR of this station, for attaching it by hand. nullptr without rain gauge or slot.
+ADSWeatherIsr ADSWeather::rainGaugeIsr()
+{
+    if (_slot == NO_SLOT || _rainPin < 0)
+    {
+        return nullptr;
+    }
+    return _slotIsr(_slot, true, std::make_index_sequence<ADS_WEATHER_MAX_STATIONS>());
+}
+
+//Rolls the hourly and daily sums over, call it with the hour and day of the RTC once per calculation, before
+//calculate() so the tips of the first interval count for the new hour. The first call only sets the clock. Returns
+//true if an hour closed, getRainLastHour() and getRainLastDay() have new values then.
+bool ADSWeather::setRainClock(unsigned char hour, unsigned char day)
+{
+    bool closed = _rainClockHour != 0xFF && hour != _rainClockHour;
+    if (closed)
+    {
+        _rainLastHour = _rainHour;
+        _rainHour = 0;
+    }
+    if (_rainClockDay != 0xFF && day != _rainClockDay)
+    {
+        _rainLastDay = _rainDay;
+        _rainDay = 0;
+    }
+    _rainClockHour = hour;
+    _rainClockDay = day;
+    return closed;
+}
+
+//Returns the tips of the last calculation interval.
+unsigned int ADSWeather::getRainTips()
+{
+    return _rainTips;
+}
+
+//Returns all tips since the start.
+unsigned long ADSWeather::getRainTotalTips()
+{
+    return _rainTotal;
+}
+
+//Returns the rain (mm) of the last calculation interval.
+float ADSWeather::getRain()
+{
+    return _rainTips * RAIN_MM_PER_TIP;
+}
+
+//Returns the rain (mm) of the current hour.
+float ADSWeather::getRainHour()
+{
+    return _rainHour * RAIN_MM_PER_TIP;
+}
+
+//Returns the rain (mm) of the current day.
+float ADSWeather::getRainDay()
+{
+    return _rainDay * RAIN_MM_PER_TIP;
+}
+
+//Returns the rain (mm) of the previous hour.
+float ADSWeather::getRainLastHour()
+{
+    return _rainLastHour * RAIN_MM_PER_TIP;
+}
+
+//Returns the rain (mm) of the previous day.
+float ADSWeather::getRainLastDay()
+{
+    return _rainLastDay * RAIN_MM_PER_TIP;
+}
+
+//Returns the rain (mm) since the start.
+float ADSWeather::getRainTotal()
+{
+    return _rainTotal * RAIN_MM_PER_TIP;
+}
+
 //The update function updates the values of all of the sensor variables. This should be run as frequently as possible
 //in the main loop for maximum precision.
 void ADSWeather::update()
 {
-    _timer = millis();
-    _vaneSample[_vaneSampleIdx] = analogRead(_windDirPin);
+    sampleVane();
+    if(_calcTimer.expired(millis()))
+    {
+        //UPDATE ALL VALUES
+        calculate();
+    }
+}
+
+//Takes one sample of the wind vane. Use this together with calculate() instead of update() if the sampling is timed
+//by the caller, 50 samples should be taken per calculation.
+void ADSWeather::sampleVane()
+{
+    addVaneSample(analogRead(_windDirPin));
+}
+
+//Adds a vane reading that was taken by the caller, for example by a background ADC. The histogram is kept up to date
+//with every sample: the bin of the sample that drops out of the ring is decremented, the new one incremented.
+void ADSWeather::addVaneSample(unsigned int windVane)
+{
+    unsigned char bin = decodeVane(windVane);
+    if (_vaneSampleCount >= 50)
+    {
+        _changeBin(_vaneSampleBin[_vaneSampleIdx], false);
+    }
+    else
+    {
+        _vaneSampleCount++;
+    }
+    _changeBin(bin, true);
+
+    _vaneSample[_vaneSampleIdx] = windVane;
+    _vaneSampleBin[_vaneSampleIdx] = bin;
     _vaneSampleIdx++;
     if(_vaneSampleIdx >= 50)
     {
         _vaneSampleIdx=0;
     }
-    if(_timer > _nextCalc)
-    {
-        _nextCalc = _timer + CALC_INTERVAL;
+}
 
-        //UPDATE ALL VALUES
-        _windSpd = _readWindSpd();
+//Calculates wind speed and direction, call this once per CALC_INTERVAL if update() is not used.
+void ADSWeather::calculate()
+{
+    _windSpd = _readWindSpd();
 
-        _windDir = _readWindDir();
+    _windDir = _readWindDir();
 
-    }
+    _readRain();
 }
 
-//Returns the direction of the wind in degrees.
+//Returns the direction of the wind in degrees, calculated from the last 50 vane samples.
 int ADSWeather::getWindDirection()
 {
-    return _windDir;
+    return _readWindDir();
+}
+
+//Returns the mean resultant length of the last 50 vane samples: 1 if they all point the same way, towards 0 the more
+//they scatter.
+float ADSWeather::getWindSteadiness()
+{
+    if (_vaneSampleCount == 0)
+    {
+        return 0;
+    }
+    float length = sqrtf((float) _windDirX * _windDirX + (float) _windDirY * _windDirY);
+    return length / ((float) _vaneSampleCount * VANE_VECTOR_ONE);
+}
+
+//Returns the circular standard deviation of the last 50 vane samples in degrees, at most 180.
+int ADSWeather::getWindDirDeviation()
+{
+    float steadiness = getWindSteadiness();
+    if (steadiness <= 0)
+    {
+        return 180;
+    }
+    float deviation = sqrtf(-2 * logf(steadiness < 1 ? steadiness : 1)) * (180.0f / (float) M_PI);
+    return deviation < 180 ? (int) (deviation + 0.5f) : 180;
+}
+
+//Returns the sum of the unit vectors of the last vane samples (fixed point, VANE_VECTOR_ONE per sample, North is +x,
+//East +y) and their number. Sums of several calls give the vector mean over a longer period.
+void ADSWeather::getWindVector(long &x, long &y, unsigned int &samples)
+{
+    x = _windDirX;
+    y = _windDirY;
+    samples = _vaneSampleCount;
+}
+
+//Selects how getWindDirection() averages the vane samples, the consensus average by default.
+void ADSWeather::setVaneAveraging(VaneAveraging mode)
+{
+    _vaneAveraging = mode;
 }
 
 //Returns the wind speed.
 int ADSWeather::getWindSpeed()
+{
+    return _windSpd / 10;
+}
+
+//Returns the wind speed in 0.1 km/h.
+int ADSWeather::getWindSpeedX10()
 {
     return _windSpd;
 }
 
-//Returns the maximum wind gust speed.
+//Returns the maximum wind gust speed within the gust window.
 int ADSWeather::getWindGust()
 {
-    return _windSpdMax;
+    return getWindGustX10() / 10;
 }
 
+//Returns the maximum wind gust speed within the gust window in 0.1 km/h.
+int ADSWeather::getWindGustX10()
+{
+    if (_gustCount == 0)
+    {
+        return 0;
+    }
+    return _gust[_gustHead];
+}
 
-//Updates the wind direction internal state.
-int ADSWeather::_readWindDir()
+//Returns the highest wind speed of a calculation interval since the start, in both gust modes.
+int ADSWeather::getWindGustMax()
 {
-    unsigned int maximum, sum;
-    unsigned char i, j, max_i;
+    return _windSpdMax / 10;
+}
 
-    //Clear wind vane averaging bins
-    for(i=0;i<16;i++)
+//Sets the gust window in calculation intervals (seconds), at most GUST_WINDOW_MAX. With wmo the gust is the highest
+//3 second running mean of the speed like the WMO defines it, otherwise the highest single speed.
+void ADSWeather::setGustWindow(unsigned int seconds, bool wmo)
+{
+    if (seconds < 1)
     {
-        _windDirBin[i] = 0;
+        seconds = 1;
     }
+    if (seconds > GUST_WINDOW_MAX)
+    {
+        seconds = GUST_WINDOW_MAX;
+    }
+    _gustWindow = seconds;
+    _gustWmo = wmo;
+    _gustCount = 0;
+}
+
 
-    //Read all samples into bins
-    for(i=0;i<50;i++)
+//Updates the wind direction internal state.
+int ADSWeather::_readWindDir()
+{
+    unsigned int maximum, sum;
+    unsigned char i, max_i;
+
+    if (_vaneAveraging == VANE_AVERAGING_VECTOR)
     {
-        _setBin(_vaneSample[i]);
+        if (_windDirX == 0 && _windDirY == 0)
+        {
+            //No samples yet, or they cancel out
+            return _windDir;
+        }
+        int direction = (int) lroundf(atan2f((float) _windDirY, (float) _windDirX) * (180.0f / (float) M_PI));
+        return (direction + 360) % 360;
     }
 
     //Calculate the weighted average
-    //Find the blokc of 5 bins with the highest sum
+    //Find the block of 5 bins with the highest sum, the sums are kept up to date by _changeBin()
     maximum = 0;
+    max_i = 0;
     for(i=0;i<16;i++)
     {
-        //get the sum of the next 5 bins
-        sum = 0;
-        for(j=0;j<5;j++)
-        {
-            sum += _windDirBin[(i+j) & 0x0F];
-        }
-        if(sum > maximum)
+        if(_windDirWindow[i] > maximum)
         {
-            maximum = sum;
+            maximum = _windDirWindow[i];
             max_i = i;
         }
     }
+    if(maximum == 0)
+    {
+        //No samples yet
+        return _windDir;
+    }
     sum = 0;
     for(i=1;i<5;i++)
     {
@@ -135,58 +464,500 @@ int ADSWeather::_readWindDir()
 }
 
 
-//returns the wind speed since the last calcInterval.
-int ADSWeather::_readWindSpd()
+//Counts the anemometer pulses in hardware: the pin's external interrupt line sends an event for every falling edge
+//through the event system to TC3, which counts them without any CPU involvement. With glitchFilter the EIC majority
+//filter is enabled and the EIC is clocked from the 32kHz generator (GCLK1), which suppresses spikes shorter than about
+//90us. The count itself has no minimum interval, so ms long contact bounce of a reed anemometer is counted, unlike
+//with DEBOUNCE_TIME in the interrupt backend; only the edges of the period measurement are debounced. The first
+//attachInterrupt() of the sketch switches the EIC back to GCLK0, so call this afterwards. Returns false if the
+//platform or the pin does not support it, or another station owns TC3; use attachAnemometer() then.
+bool ADSWeather::useHardwareCounter(bool glitchFilter)
+{
+#ifdef PLATFORM_SAMD21
+    uint32_t extint = g_APinDescription[_windSpdPin].ulExtInt;
+    if (extint == NOT_AN_INTERRUPT || (_hwStation != nullptr && _hwStation != this))
+    {
+        return false;
+    }
+    _hwStation = this;
+
+    //EIC: event output on the falling edge of the line, no interrupt
+    PM->APBAMASK.reg |= PM_APBAMASK_EIC;
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_ID_EIC |
+                        (glitchFilter ? GCLK_CLKCTRL_GEN_GCLK1 : GCLK_CLKCTRL_GEN_GCLK0);
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    pinPeripheral(_windSpdPin, PIO_EXTINT);
+
+    EIC->CTRL.bit.ENABLE = 0;
+    while (EIC->STATUS.bit.SYNCBUSY);
+    uint32_t shift = (extint % 8) * 4;
+    uint32_t config = EIC_CONFIG_SENSE0_FALL_Val | (glitchFilter ? EIC_CONFIG_FILTEN0 : 0);
+    EIC->CONFIG[extint / 8].reg = (EIC->CONFIG[extint / 8].reg & ~(0xFUL << shift)) | (config << shift);
+    EIC->INTENCLR.reg = 1UL << extint;
+    EIC->EVCTRL.reg |= 1UL << extint;
+    EIC->CTRL.bit.ENABLE = 1;
+    while (EIC->STATUS.bit.SYNCBUSY);
+
+    //Event system: EXTINT -> TC3
+    PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+    EVSYS->USER.reg = EVSYS_USER_CHANNEL(EVSYS_CHANNEL_ANEMOMETER + 1) | EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(EVSYS_CHANNEL_ANEMOMETER) |
+                         EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + extint) |
+                         EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT;
+
+    //TC3: 16 bit counter, incremented by every event
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    PM->APBCMASK.reg |= PM_APBCMASK_TC3;
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC3->COUNT16.CTRLA.bit.SWRST);
+    TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV1;
+    TC3->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_COUNT;
+    TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+    while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+
+    _hwCount = 0;
+    _hwCounter = true;
+    if (_periodMode)
+    {
+        setPeriodMode(true);
+    }
+    return true;
+#else
+    (void) glitchFilter;
+    return false;
+#endif
+}
+
+//Returns true if the pulses are counted by the hardware counter.
+bool ADSWeather::hardwareCounter()
+{
+    return _hwCounter;
+}
+
+//Derives the speed from the time between the anemometer pulses instead of their number, which resolves far less than
+//2.4 km/h at low wind. The edges are timestamped by the TCC0 capture (hardware counter) or with micros() in
+//the anemometer ISR. Above PERIOD_MAX_PULSES per interval the speed is counted as before.
+void ADSWeather::setPeriodMode(bool enable)
+{
+    _periodMode = enable;
+    _edgeRefValid = false;
+    _periodSpd = 0;
+    if (enable && _hwCounter && !_capture)
+    {
+        _startCapture();
+    }
+    _enableCapture(enable && _capture);
+}
+
+//Timestamps every event of the anemometer channel in TCC0 (187.5 kHz, 24 bit, wraps after 89 s).
+void ADSWeather::_startCapture()
+{
+#ifdef PLATFORM_SAMD21
+    if (_captureStation != nullptr)
+    {
+        return;
+    }
+    _captureStation = this;
+
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC0_TCC1;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    PM->APBCMASK.reg |= PM_APBCMASK_TCC0;
+    TCC0->CTRLA.reg = TCC_CTRLA_SWRST;
+    while (TCC0->SYNCBUSY.bit.SWRST);
+    TCC0->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV256 | TCC_CTRLA_CPTEN0;
+    TCC0->EVCTRL.reg = TCC_EVCTRL_MCEI0;
+    TCC0->PER.reg = 0xFFFFFF;
+    while (TCC0->SYNCBUSY.bit.PER);
+    TCC0->CTRLA.bit.ENABLE = 1;
+    while (TCC0->SYNCBUSY.bit.ENABLE);
+
+    //Second user of the anemometer event channel
+    EVSYS->USER.reg = EVSYS_USER_CHANNEL(EVSYS_CHANNEL_ANEMOMETER + 1) | EVSYS_USER_USER(EVSYS_ID_USER_TCC0_MC_0);
+
+    NVIC_SetPriority(TCC0_IRQn, 1);
+    NVIC_EnableIRQ(TCC0_IRQn);
+
+    _capture = true;
+    _edgeRate = F_CPU / 256;
+    _edgeMask = 0xFFFFFFUL;
+#endif
+}
+
+//Switches the capture interrupt on or off, counting continues either way.
+void ADSWeather::_enableCapture(bool enable)
 {
-    unsigned char i;
+#ifdef PLATFORM_SAMD21
+    if (!_capture || enable == _captureIrq)
+    {
+        return;
+    }
+    if (enable)
+    {
+        TCC0->INTFLAG.reg = TCC_INTFLAG_MC0 | TCC_INTFLAG_ERR;
+        _captureCount = 0;
+        TCC0->INTENSET.reg = TCC_INTENSET_MC0;
+    }
+    else
+    {
+        TCC0->INTENCLR.reg = TCC_INTENCLR_MC0;
+    }
+#endif
+    _captureIrq = enable;
+}
 
-    long spd = 24;
-    spd *= _anemometerCounter;
-    spd /= 10;
-    _anemometerCounter = 0;
-    if(_gustIdx > 29)
+//Returns the anemometer pulses since the last call, from TC3 or from the interrupt counter. Also takes a snapshot of
+//the edge timestamps for the period measurement.
+unsigned int ADSWeather::_readPulses()
+{
+    unsigned int pulses;
+#ifdef PLATFORM_SAMD21
+    if (_hwCounter)
     {
-        _gustIdx = 0;
+        TC3->COUNT16.READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+        while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+        uint16_t count = TC3->COUNT16.COUNT.reg;
+        pulses = (uint16_t) (count - _hwCount);
+        _hwCount = count;
+
+        _edgeCount = 0;
+        if (_capture)
+        {
+            noInterrupts();
+            _edgeCount = _captureIrq ? _captureCount : 0;
+            _edgeFirst = _captureFirst;
+            _edgeLast = _captureLast;
+            _captureCount = 0;
+            interrupts();
+            TCC0->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+            while (TCC0->SYNCBUSY.bit.CTRLB);
+            while (TCC0->SYNCBUSY.bit.COUNT);
+            _edgeNow = TCC0->COUNT.reg;
+        }
+        return pulses;
     }
-    _gust[_gustIdx] = (int) spd;
+#endif
+    //Snapshot and reset in one critical section, an edge can't land between reading and clearing the counter.
+    noInterrupts();
+    pulses = _pulseCount;
+    _edgeFirst = _pulseFirst;
+    _edgeLast = _pulseLast;
+    _pulseCount = 0;
+    interrupts();
+    _edgeCount = pulses;
+    _edgeNow = micros();
+    return pulses;
+}
 
-    for (i = 0; i < 30; i++)
+//returns the wind speed since the last calcInterval in 0.1 km/h.
+int ADSWeather::_readWindSpd()
+{
+    unsigned int pulses = _readPulses();
+    //2.4 km/h per pulse and second
+    long spd = 24L * pulses;
+    if (_periodMode)
     {
-        if (_gust[i] > _windSpdMax) _windSpdMax = _gust[i];
+        long fine = _periodSpeed(pulses);
+        if (fine >= 0)
+        {
+            spd = fine;
+        }
     }
+
+    _updateGust((unsigned int) spd);
     return (int) spd;
 }
 
-//Internal function for calculatin the wind direction using consensus averaging.
-void ADSWeather::_setBin(unsigned int windVane)
-{
-    //Read wind directions into bins
-    unsigned char bin;
-    if( windVane > 940) bin = 12;     //W
-    else if(windVane > 890) bin = 14; //NW
-    else if(windVane > 820) bin = 13; //WNW
-    else if(windVane > 785) bin = 0;  //N
-    else if(windVane > 690) bin = 15; //NNW
-    else if(windVane > 630) bin = 10; //SW
-    else if(windVane > 590) bin = 11; //WSW
-    else if(windVane > 455) bin = 2;  //NE
-    else if(windVane > 400) bin = 1;  //NNE
-    else if(windVane > 285) bin = 8;  //S
-    else if(windVane > 240) bin = 9;  //SSW
-    else if(windVane > 180) bin = 6;  //SE
-    else if(windVane > 125) bin = 7;  //SSE
-    else if(windVane > 90)  bin = 4;  //E
-    else if(windVane > 80)  bin = 3;  //ESE
-    else bin = 5;
-    _windDirBin[bin]++;
-}
-
-//ISR for anemometer.
+//Speed in 0.1 km/h from the mean time between the edges of this interval, -1 if the counted speed should be used.
+long ADSWeather::_periodSpeed(unsigned int pulses)
+{
+    if (pulses > PERIOD_MAX_PULSES)
+    {
+        //Fast enough for counting, stop interrupting on every pulse.
+        _enableCapture(false);
+        _edgeRefValid = false;
+        return -1;
+    }
+    if (!_captureIrq && _capture)
+    {
+        //First slow interval after counting, the timestamps start with the next edge.
+        _enableCapture(true);
+        return -1;
+    }
+
+    if (_edgeCount == 0)
+    {
+        //No edge yet: the period is at least as long as the time since the last edge, so the speed can't be higher
+        //than that suggests.
+        if (!_edgeRefValid || ++_edgeRefAge > PERIOD_TIMEOUT)
+        {
+            _edgeRefValid = false;
+            _periodSpd = 0;
+            return 0;
+        }
+        unsigned long elapsed = (_edgeNow - _edgeRef) & _edgeMask;
+        long bound = elapsed > 0 ? (long) ((24UL * _edgeRate) / elapsed) : _periodSpd;
+        return bound < _periodSpd ? bound : _periodSpd;
+    }
+
+    unsigned long start = _edgeRefValid ? _edgeRef : _edgeFirst;
+    unsigned int intervals = _edgeRefValid ? _edgeCount : _edgeCount - 1;
+    unsigned long span = (_edgeLast - start) & _edgeMask;
+    _edgeRef = _edgeLast;
+    _edgeRefValid = true;
+    _edgeRefAge = 0;
+    if (intervals == 0 || span == 0)
+    {
+        return -1;
+    }
+    _periodSpd = (long) ((24UL * intervals * _edgeRate + span / 2) / span);
+    return _periodSpd;
+}
+
+//Adds the speed of one calculation interval to the rolling maximum, amortized O(1).
+void ADSWeather::_updateGust(unsigned int spd)
+{
+    _gustClock++;
+    //The lifetime maximum is the raw speed of an interval, also in WMO mode
+    if (spd > _windSpdMax)
+    {
+        _windSpdMax = spd;
+    }
+    if (_gustWmo)
+    {
+        _gustMean[_gustMeanIdx] = spd;
+        _gustMeanIdx = (_gustMeanIdx + 1) % GUST_WMO_SAMPLES;
+        unsigned int sum = 0;
+        for (unsigned char i = 0; i < GUST_WMO_SAMPLES; i++)
+        {
+            sum += _gustMean[i];
+        }
+        spd = (sum + GUST_WMO_SAMPLES / 2) / GUST_WMO_SAMPLES;
+    }
+
+    //Drop the front if it left the window, before the push so the ring never holds more than the window
+    if (_gustCount > 0 && _gustClock - _gustTime[_gustHead] >= _gustWindow)
+    {
+        _gustHead = (_gustHead + 1) % GUST_WINDOW_MAX;
+        _gustCount--;
+    }
+
+    //Drop the speeds that can never be the maximum again, they are older and not faster than the new one
+    while (_gustCount > 0 && _gust[(_gustHead + _gustCount - 1) % GUST_WINDOW_MAX] <= spd)
+    {
+        _gustCount--;
+    }
+    unsigned int tail = (_gustHead + _gustCount) % GUST_WINDOW_MAX;
+    _gust[tail] = spd;
+    _gustTime[tail] = _gustClock;
+    _gustCount++;
+}
+
+//Internal function for calculatin the wind direction using consensus averaging. Adds or removes one sample from a
+//bin, from the 5 windows that contain the bin and from the vector sums.
+void ADSWeather::_changeBin(unsigned char bin, bool add)
+{
+    unsigned char j;
+    if(add)
+    {
+        _windDirX += VANE_COS[bin];
+        _windDirY += VANE_SIN(bin);
+        _windDirBin[bin]++;
+        for(j=0;j<5;j++)
+        {
+            _windDirWindow[(bin - j) & 0x0F]++;
+        }
+    }
+    else
+    {
+        _windDirX -= VANE_COS[bin];
+        _windDirY -= VANE_SIN(bin);
+        _windDirBin[bin]--;
+        for(j=0;j<5;j++)
+        {
+            _windDirWindow[(bin - j) & 0x0F]--;
+        }
+    }
+}
+
+//Sorts all stored samples into the bins again, needed after the thresholds changed.
+void ADSWeather::_rebuildBins()
+{
+    unsigned int i;
+    for(i=0;i<16;i++)
+    {
+        _windDirBin[i] = 0;
+        _windDirWindow[i] = 0;
+    }
+    _windDirX = 0;
+    _windDirY = 0;
+    for(i=0;i<_vaneSampleCount;i++)
+    {
+        _vaneSampleBin[i] = decodeVane(_vaneSample[i]);
+        _changeBin(_vaneSampleBin[i], true);
+    }
+}
+
+//Selects the vane thresholds for the resolution analogRead() (or the background ADC) is using. The tables for 10 and
+//12 bit with the default pull-up are calculated at compile time, other combinations at run time.
+void ADSWeather::setVaneResolution(unsigned char bits, unsigned long pullup)
+{
+    if (pullup == VANE_PULLUP && bits == 10)
+    {
+        _vaneThresholds = VANE_THRESHOLDS_10BIT;
+    }
+    else if (pullup == VANE_PULLUP && bits == 12)
+    {
+        _vaneThresholds = VANE_THRESHOLDS_12BIT;
+    }
+    else
+    {
+        _vaneThresholds = makeVaneThresholds(bits, pullup);
+    }
+    _rebuildBins();
+}
+
+//Calibration hook: replaces the thresholds with measured ones, for example from readings of the vane in every
+//position. The thresholds have to be in the order of VANE_RESISTANCE and increasing.
+void ADSWeather::setVaneCalibration(const VaneThresholds &thresholds)
+{
+    _vaneThresholds = thresholds;
+    _rebuildBins();
+}
+
+//Returns the thresholds in use.
+const VaneThresholds &ADSWeather::getVaneCalibration()
+{
+    return _vaneThresholds;
+}
+
+//Returns the bin of a vane reading. Binary search over the 15 thresholds, always 4 comparisons.
+unsigned char ADSWeather::decodeVane(unsigned int windVane)
+{
+    unsigned char position = 0;
+    for (unsigned char step = 8; step > 0; step >>= 1)
+    {
+        if (windVane > _vaneThresholds.threshold[position + step - 1])
+        {
+            position += step;
+        }
+    }
+    return VANE_BIN[position];
+}
+
+//ISR for the anemometer of the first station, kept for sketches that attach it by hand. Use attachAnemometer() or
+//anemometerIsr() for every other station.
 void ADSWeather::countAnemometer()
 {
-    if((long)(micros() - last_micros_an) >= DEBOUNCE_TIME * 1000)
+    _anemometerIsr<0>();
+}
+
+//Interrupt trampoline of one slot, there is one instance per slot so every station gets its own ISR.
+template <unsigned char SLOT>
+void ADSWeather::_anemometerIsr()
+{
+    ADSWeather *station = _station[SLOT];
+    if (station != nullptr)
+    {
+        station->_anemometerEdge();
+    }
+}
+
+//Rain gauge trampoline of one slot.
+template <unsigned char SLOT>
+void ADSWeather::_rainIsr()
+{
+    ADSWeather *station = _station[SLOT];
+    if (station != nullptr)
+    {
+        station->_rainTip();
+    }
+}
+
+//Returns the anemometer or rain gauge trampoline of a slot from the tables of all instantiated ones.
+template <size_t... SLOTS>
+ADSWeatherIsr ADSWeather::_slotIsr(unsigned char slot, bool rain, std::index_sequence<SLOTS...>)
+{
+    static const ADSWeatherIsr anemometer[] = {&ADSWeather::_anemometerIsr<SLOTS>...};
+    static const ADSWeatherIsr gauge[] = {&ADSWeather::_rainIsr<SLOTS>...};
+    return rain ? gauge[slot] : anemometer[slot];
+}
+
+//Counts a debounced tip of the rain gauge bucket.
+void ADSWeather::_rainTip()
+{
+    unsigned long now = millis();
+    if ((long) (now - _tipLast) >= RAIN_DEBOUNCE_TIME)
+    {
+        _tipCount++;
+        _tipLast = now;
+    }
+}
+
+//Takes the tips since the last calculation and adds them to the sums.
+void ADSWeather::_readRain()
+{
+    noInterrupts();
+    unsigned int tips = _tipCount;
+    _tipCount = 0;
+    interrupts();
+    _rainTips = tips;
+    _rainTotal += tips;
+    _rainHour += tips;
+    _rainDay += tips;
+}
+
+//Counts a debounced anemometer edge. The time of the accepted edge is kept for the period measurement.
+void ADSWeather::_anemometerEdge()
+{
+    unsigned long now = micros();
+    if((long)(now - _pulseLast) >= DEBOUNCE_TIME * 1000)
     {
-        _anemometerCounter++;
-        last_micros_an = micros();
+        if (_pulseCount == 0)
+        {
+            _pulseFirst = now;
+        }
+        _pulseCount++;
+        _pulseLast = now;
     }
 }
+
+//ISR for the TCC0 capture, stores the timestamp of the anemometer edge.
+void ADSWeather::captureEdge()
+{
+#ifdef PLATFORM_SAMD21
+    ADSWeather *station = _captureStation;
+    uint32_t flags = TCC0->INTFLAG.reg;
+    TCC0->INTFLAG.reg = flags;
+    if (station == nullptr || !(flags & TCC_INTFLAG_MC0))
+    {
+        return;
+    }
+    unsigned long timestamp = TCC0->CC[0].reg & 0xFFFFFF;
+#ifdef PROFILING
+    //Time from the edge to here in cycles (TCC0 counts F_CPU / 256), the sync of the counter is included.
+    TCC0->CTRLBSET.reg = TCC_CTRLBSET_CMD_READSYNC;
+    while (TCC0->SYNCBUSY.bit.CTRLB);
+    while (TCC0->SYNCBUSY.bit.COUNT);
+    PROFILE_LATENCY(((TCC0->COUNT.reg - timestamp) & 0xFFFFFF) * 256);
+#endif
+    //Contact bounce: an edge within DEBOUNCE_TIME of the last accepted one is dropped, like in _anemometerEdge().
+    if (((timestamp - station->_captureLast) & 0xFFFFFF) < DEBOUNCE_TIME * (F_CPU / 256 / 1000))
+    {
+        return;
+    }
+    if (station->_captureCount == 0)
+    {
+        station->_captureFirst = timestamp;
+    }
+    station->_captureLast = timestamp;
+    station->_captureCount++;
+#endif
+}
+
+#ifdef PLATFORM_SAMD21
+void TCC0_Handler(void)
+{
+    ADSWeather::captureEdge();
+}
+#endif
@@ -0,0 +1,223 @@
+/**********************************************************
+** @file		AdcSampler.cpp
+**
+** Timer triggered ADC scan into DMA buffers, see
+** AdcSampler.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "Platform.h"
+#include "AdcSampler.h"
+
+#ifdef PLATFORM_SAMD21
+#include "wiring_private.h"
+#include "DmaController.h"
+
+// Second descriptor of the ping-pong chain, the first one lives in the DmaController table
+__attribute__((aligned(16))) static DmacDescriptor _secondDescriptor;
+#endif
+
+#define NO_BLOCK 0xFF
+
+// Sampler that receives the block interrupts
+static AdcSampler *_sampler = nullptr;
+
+
+AdcSampler::AdcSampler()
+{
+    _running = false;
+    _next = 0;
+    _ready = NO_BLOCK;
+    _blocks = 0;
+    _overruns = 0;
+    _latestVoltage = 0;
+}
+
+//Starts sampling both pins with rate pairs per second, every sample the average of 2^averaging conversions. Returns
+//false if the pins can not be scanned together or the platform has no DMA backend.
+bool AdcSampler::begin(int vanePin, int voltagePin, unsigned int rate, unsigned char averaging)
+{
+#ifdef PLATFORM_SAMD21
+    unsigned int vaneInput = g_APinDescription[vanePin].ulADCChannelNumber;
+    unsigned int voltageInput = g_APinDescription[voltagePin].ulADCChannelNumber;
+    if (voltageInput != vaneInput + 1 || rate == 0)
+    {
+        return false;
+    }
+    if (averaging > ADC_SAMPLER_MAX_AVERAGING)
+    {
+        averaging = ADC_SAMPLER_MAX_AVERAGING;
+    }
+    _sampler = this;
+    pinPeripheral(vanePin, PIO_ANALOG);
+    pinPeripheral(voltagePin, PIO_ANALOG);
+
+    // ADC: 12 bit, one (averaged) conversion per start event, scanning from the vane to the voltage input. Averaging
+    // needs the 16 bit result mode, ADJRES divides the sum back to 12 bit.
+    ADC->CTRLA.bit.ENABLE = 0;
+    while (ADC->STATUS.bit.SYNCBUSY);
+    ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV32 | (averaging ? ADC_CTRLB_RESSEL_16BIT : ADC_CTRLB_RESSEL_12BIT);
+    while (ADC->STATUS.bit.SYNCBUSY);
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(averaging) | ADC_AVGCTRL_ADJRES(averaging);
+    while (ADC->STATUS.bit.SYNCBUSY);
+    ADC->INPUTCTRL.reg = ADC_INPUTCTRL_MUXPOS(vaneInput) | ADC_INPUTCTRL_MUXNEG_GND | ADC_INPUTCTRL_INPUTSCAN(1) |
+                         ADC_INPUTCTRL_INPUTOFFSET(0) | ADC_INPUTCTRL_GAIN_DIV2;
+    while (ADC->STATUS.bit.SYNCBUSY);
+    ADC->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+
+    // DMAC: move every result into the blocks, the two descriptors point to each other.
+    DmaController::begin();
+    DmaController::configure(DMA_CHANNEL_ADC, ADC_DMAC_ID_RESRDY, blockComplete);
+    DmacDescriptor *first = DmaController::descriptor(DMA_CHANNEL_ADC);
+    DmacDescriptor *descriptors[2] = {first, &_secondDescriptor};
+    for (unsigned char i = 0; i < 2; i++)
+    {
+        descriptors[i]->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BLOCKACT_INT | DMAC_BTCTRL_BEATSIZE_HWORD |
+                                     DMAC_BTCTRL_DSTINC;
+        descriptors[i]->BTCNT.reg = ADC_SAMPLER_BLOCK * 2;
+        descriptors[i]->SRCADDR.reg = (uint32_t) &ADC->RESULT.reg;
+        // With address increment the DMAC expects the end of the block.
+        descriptors[i]->DSTADDR.reg = (uint32_t) &_buffer[i][ADC_SAMPLER_BLOCK * 2];
+        descriptors[i]->DESCADDR.reg = (uint32_t) descriptors[1 - i];
+    }
+    _next = 0;
+    _ready = NO_BLOCK;
+    DmaController::enable(DMA_CHANNEL_ADC);
+
+    ADC->CTRLA.bit.ENABLE = 1;
+    while (ADC->STATUS.bit.SYNCBUSY);
+
+    // Event: TC5 overflow starts a conversion.
+    PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+    EVSYS->USER.reg = EVSYS_USER_CHANNEL(EVSYS_CHANNEL_ADC + 1) | EVSYS_USER_USER(EVSYS_ID_USER_ADC_START);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(EVSYS_CHANNEL_ADC) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_TC5_OVF) |
+                         EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EDGSEL_NO_EVT_OUTPUT;
+
+    // TC5: overflow twice per sample pair, one conversion per input.
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TC4_TC5;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    PM->APBCMASK.reg |= PM_APBCMASK_TC5;
+    TC5->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC5->COUNT16.CTRLA.bit.SWRST);
+    TC5->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV64;
+    TC5->COUNT16.CC[0].reg = F_CPU / 64 / (2UL * rate) - 1;
+    while (TC5->COUNT16.STATUS.bit.SYNCBUSY);
+    TC5->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+    TC5->COUNT16.CTRLA.bit.ENABLE = 1;
+    while (TC5->COUNT16.STATUS.bit.SYNCBUSY);
+
+    _running = true;
+    return true;
+#else
+    (void) vanePin;
+    (void) voltagePin;
+    (void) rate;
+    (void) averaging;
+    return false;
+#endif
+}
+
+//Stops the trigger and the DMA transfer, analogRead() can be used again afterwards.
+void AdcSampler::end()
+{
+#ifdef PLATFORM_SAMD21
+    if (!_running)
+    {
+        return;
+    }
+    TC5->COUNT16.CTRLA.bit.ENABLE = 0;
+    while (TC5->COUNT16.STATUS.bit.SYNCBUSY);
+    DmaController::disable(DMA_CHANNEL_ADC);
+    ADC->EVCTRL.reg = 0;
+    ADC->INPUTCTRL.bit.INPUTSCAN = 0;
+    while (ADC->STATUS.bit.SYNCBUSY);
+    // analogRead() expects single conversions in 12 bit mode.
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM_1 | ADC_AVGCTRL_ADJRES(0);
+    while (ADC->STATUS.bit.SYNCBUSY);
+    ADC->CTRLB.bit.RESSEL = ADC_CTRLB_RESSEL_12BIT_Val;
+    while (ADC->STATUS.bit.SYNCBUSY);
+#endif
+    _running = false;
+}
+
+//Returns true if the background sampling is active.
+bool AdcSampler::running()
+{
+    return _running;
+}
+
+//Returns true if a completed block is waiting to be read.
+bool AdcSampler::available()
+{
+    return _ready != NO_BLOCK;
+}
+
+//Copies the waiting block into vane and voltage (ADC_SAMPLER_BLOCK entries each) and returns the number of pairs, 0
+//if there was no new block.
+unsigned int AdcSampler::read(unsigned int *vane, unsigned int *voltage)
+{
+    unsigned char block = _ready;
+    if (block == NO_BLOCK)
+    {
+        return 0;
+    }
+    for (unsigned int i = 0; i < ADC_SAMPLER_BLOCK; i++)
+    {
+        vane[i] = _buffer[block][2 * i];
+        voltage[i] = _buffer[block][2 * i + 1];
+    }
+    _latestVoltage = voltage[ADC_SAMPLER_BLOCK - 1];
+    // Only mark the block as read if the DMAC did not complete another one in the meantime.
+    noInterrupts();
+    if (_ready == block)
+    {
+        _ready = NO_BLOCK;
+    }
+    interrupts();
+    return ADC_SAMPLER_BLOCK;
+}
+
+//Returns the last voltage sample that was read.
+unsigned int AdcSampler::latestVoltage()
+{
+    return _latestVoltage;
+}
+
+//Returns the number of completed blocks.
+unsigned long AdcSampler::getBlocks()
+{
+    return _blocks;
+}
+
+//Returns the number of blocks that were overwritten before they were read.
+unsigned long AdcSampler::getOverruns()
+{
+    return _overruns;
+}
+
+//DMAC callback at the end of every block.
+void AdcSampler::blockComplete(unsigned char flags)
+{
+#ifdef PLATFORM_SAMD21
+    if (_sampler == nullptr || !(flags & DMAC_CHINTFLAG_TCMPL))
+    {
+        return;
+    }
+#else
+    (void) flags;
+    if (_sampler == nullptr)
+    {
+        return;
+    }
+#endif
+    if (_sampler->_ready != NO_BLOCK)
+    {
+        _sampler->_overruns++;
+    }
+    _sampler->_ready = _sampler->_next;
+    _sampler->_next ^= 1;
+    _sampler->_blocks++;
+}
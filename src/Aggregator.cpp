@@ -0,0 +1,203 @@
+/**********************************************************
+** @file		Aggregator.cpp
+**
+** Tier statistics of wind and power, see Aggregator.h
+**
+
+*/
+
+#include "Aggregator.h"
+#include "ADSWeather.h"
+#include "Checkpoint.h"
+#include <math.h>
+
+void RunningStats::clear()
+{
+    count = 0;
+    mean = 0;
+    m2 = 0;
+}
+
+void RunningStats::add(float x)
+{
+    count++;
+    float delta = x - mean;
+    mean += delta / count;
+    m2 += delta * (x - mean);
+}
+
+//Returns the standard deviation of the population, 0 for less than two values.
+float RunningStats::stdDev() const
+{
+    return count > 1 ? sqrtf(m2 / count) : 0;
+}
+
+
+Aggregator::Aggregator()
+{
+    _tiers = 0;
+    _powerSum = 0;
+    _powerCount = 0;
+    _powerLast = 0;
+}
+
+//Adds a tier with a period of the given seconds, returns false if there are AGGREGATOR_MAX_TIERS already.
+bool Aggregator::addTier(unsigned int seconds)
+{
+    if (_tiers >= AGGREGATOR_MAX_TIERS || seconds == 0)
+    {
+        return false;
+    }
+    Tier &tier = _tier[_tiers++];
+    tier.period = seconds;
+    tier.block = 0;
+    tier.ready = false;
+    _clear(tier);
+    return true;
+}
+
+//Returns the number of tiers.
+unsigned char Aggregator::tiers()
+{
+    return _tiers;
+}
+
+//Adds the power of one MPPT step, the steps of a second are averaged.
+void Aggregator::addPower(float power)
+{
+    _powerSum += power;
+    _powerCount++;
+}
+
+//Adds the measurement of the second that ends at epoch: speed and gust in 0.1 km/h, the vane vector sum of
+//ADSWeather::getWindVector() with its number of samples and the rain tips of the second. Completes the periods that
+//end with it, getSummary() returns them.
+void Aggregator::addSecond(unsigned long epoch, int windSpeedX10, int windGustX10, long dirX, long dirY,
+                           unsigned int dirSamples, unsigned int rainTips)
+{
+    if (_powerCount > 0)
+    {
+        _powerLast = _powerSum / _powerCount;
+    }
+    _powerSum = 0;
+    _powerCount = 0;
+
+    for (unsigned char t = 0; t < _tiers; t++)
+    {
+        Tier &tier = _tier[t];
+        // The second up to epoch belongs to the period that an epoch divisible by the period closes
+        unsigned long block = (epoch - 1) / tier.period;
+        if (block != tier.block && tier.speed.count > 0)
+        {
+            // The clock jumped, end the old period where it should have ended.
+            _close(tier, (tier.block + 1) * tier.period);
+        }
+        tier.block = block;
+        tier.speed.add(windSpeedX10 / 10.0f);
+        tier.power.add(_powerLast);
+        if ((unsigned int) windGustX10 > tier.gustMax)
+        {
+            tier.gustMax = windGustX10;
+        }
+        if (_powerLast > tier.powerMax)
+        {
+            tier.powerMax = _powerLast;
+        }
+        tier.dirX += dirX;
+        tier.dirY += dirY;
+        tier.dirSamples += dirSamples;
+        tier.energy += _powerLast;
+        tier.rainTips += rainTips;
+        if (epoch % tier.period == 0)
+        {
+            _close(tier, epoch);
+        }
+    }
+}
+
+//Copies the last completed period of a tier into summary, returns false if there is none since the last call.
+bool Aggregator::getSummary(unsigned char tier, AggregateSummary &summary)
+{
+    if (tier >= _tiers || !_tier[tier].ready)
+    {
+        return false;
+    }
+    summary = _tier[tier].summary;
+    _tier[tier].ready = false;
+    return true;
+}
+
+//Continues the running periods saved by save(checkpoint), returns false if the tiers differ from the saved ones.
+bool Aggregator::load(Checkpoint &checkpoint)
+{
+    unsigned char tiers;
+    Tier tier[AGGREGATOR_MAX_TIERS];
+    if (!checkpoint.read(&tiers, sizeof(tiers)) || tiers != _tiers || !checkpoint.read(tier, tiers * sizeof(Tier)) ||
+        !checkpoint.read(&_powerLast, sizeof(_powerLast)))
+    {
+        return false;
+    }
+    for (unsigned char t = 0; t < tiers; t++)
+    {
+        if (tier[t].period != _tier[t].period)
+        {
+            return false;
+        }
+    }
+    for (unsigned char t = 0; t < tiers; t++)
+    {
+        _tier[t] = tier[t];
+        // The summary was logged before the snapshot or is lost with the log buffer
+        _tier[t].ready = false;
+    }
+    return true;
+}
+
+//Appends the running periods to a snapshot that was started by the caller.
+bool Aggregator::save(Checkpoint &checkpoint)
+{
+    return checkpoint.write(&_tiers, sizeof(_tiers)) && checkpoint.write(_tier, _tiers * sizeof(Tier)) &&
+           checkpoint.write(&_powerLast, sizeof(_powerLast));
+}
+
+void Aggregator::_clear(Tier &tier)
+{
+    tier.speed.clear();
+    tier.power.clear();
+    tier.gustMax = 0;
+    tier.powerMax = 0;
+    tier.dirX = 0;
+    tier.dirY = 0;
+    tier.dirSamples = 0;
+    tier.energy = 0;
+    tier.rainTips = 0;
+}
+
+//Completes the running period of a tier, it ended at epoch. An unfetched older summary is replaced.
+void Aggregator::_close(Tier &tier, unsigned long epoch)
+{
+    AggregateSummary &summary = tier.summary;
+    summary.period = tier.period;
+    summary.epoch = epoch;
+    summary.samples = tier.speed.count;
+    summary.speedMean = tier.speed.mean;
+    summary.speedStdDev = tier.speed.stdDev();
+    summary.gustMax = tier.gustMax / 10.0f;
+    summary.direction = -1;
+    summary.steadiness = 0;
+    if (tier.dirX != 0 || tier.dirY != 0)
+    {
+        float x = (float) tier.dirX;
+        float y = (float) tier.dirY;
+        int direction = (int) lroundf(atan2f(y, x) * (180.0f / (float) M_PI));
+        summary.direction = (direction + 360) % 360;
+        summary.steadiness = sqrtf(x * x + y * y) / ((float) tier.dirSamples * VANE_VECTOR_ONE);
+    }
+    summary.powerMean = tier.power.mean;
+    summary.powerStdDev = tier.power.stdDev();
+    summary.powerMax = tier.powerMax;
+    summary.energy = tier.energy / 3600.0f;
+    summary.rainTips = tier.rainTips;
+    tier.ready = true;
+    _clear(tier);
+}
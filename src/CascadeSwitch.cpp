@@ -0,0 +1,133 @@
+/**********************************************************
+** @file		CascadeSwitch.cpp
+**
+** Port register backend for the MOSFETs of the cascade, see
+** CascadeSwitch.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "CascadeSwitch.h"
+
+
+CascadeSwitch::CascadeSwitch()
+{
+    _pins = nullptr;
+    _mode = CASCADE_SWITCH_ATOMIC;
+    _pattern = 0;
+#ifdef PLATFORM_SAMD21
+    _groups = 0;
+#endif
+}
+
+//Configures the CASCADE_SWITCH_PINS pins (bit 0 of the pattern first) as outputs, switches all MOSFETs off and builds
+//the mask tables.
+void CascadeSwitch::begin(const char *pins, CascadeSwitchMode mode)
+{
+    _pins = pins;
+    _mode = mode;
+    _pattern = 0;
+    for (int i = 0; i < CASCADE_SWITCH_PINS; i++)
+    {
+        digitalWrite(_pins[i], LOW);
+        pinMode(_pins[i], OUTPUT);
+    }
+
+#ifdef PLATFORM_SAMD21
+    _groups = 0;
+    memset(_all, 0, sizeof(_all));
+    memset(_low, 0, sizeof(_low));
+    memset(_high, 0, sizeof(_high));
+    for (int i = 0; i < CASCADE_SWITCH_PINS; i++)
+    {
+        uint8_t port = g_APinDescription[(int) _pins[i]].ulPort;
+        uint32_t mask = 1UL << g_APinDescription[(int) _pins[i]].ulPin;
+        uint8_t g = 0;
+        while (g < _groups && _group[g] != port)
+        {
+            g++;
+        }
+        if (g == _groups)
+        {
+            _group[_groups++] = port;
+        }
+        _all[g] |= mask;
+
+        // Every table entry whose index has the bit of this pin set switches the pin on.
+        uint32_t (*table)[16] = i < 4 ? _low : _high;
+        uint8_t bit = 1 << (i % 4);
+        for (uint8_t nibble = 0; nibble < 16; nibble++)
+        {
+            if (nibble & bit)
+            {
+                table[g][nibble] |= mask;
+            }
+        }
+    }
+#endif
+}
+
+//Sets the switching order for the following writes.
+void CascadeSwitch::setMode(CascadeSwitchMode mode)
+{
+    _mode = mode;
+}
+
+//Switches MOSFET i on if bit i of the pattern is set.
+void CascadeSwitch::write(uint8_t pattern)
+{
+    if (_pins == nullptr)
+    {
+        return;
+    }
+#ifdef PLATFORM_SAMD21
+    uint32_t set[CASCADE_SWITCH_GROUPS];
+    for (uint8_t g = 0; g < _groups; g++)
+    {
+        set[g] = _low[g][pattern & 0x0F] | _high[g][pattern >> 4];
+    }
+    if (_mode == CASCADE_SWITCH_BREAK_BEFORE_MAKE)
+    {
+        for (uint8_t g = 0; g < _groups; g++)
+        {
+            PORT_IOBUS->Group[_group[g]].OUTCLR.reg = _all[g] & ~set[g];
+        }
+        for (uint8_t g = 0; g < _groups; g++)
+        {
+            PORT_IOBUS->Group[_group[g]].OUTSET.reg = set[g];
+        }
+    }
+    else
+    {
+        // Toggle exactly the cascade pins that differ, the other pins of the group are not written.
+        for (uint8_t g = 0; g < _groups; g++)
+        {
+            PortGroup &group = PORT_IOBUS->Group[_group[g]];
+            group.OUTTGL.reg = (group.OUT.reg ^ set[g]) & _all[g];
+        }
+    }
+#else
+    if (_mode == CASCADE_SWITCH_BREAK_BEFORE_MAKE)
+    {
+        for (int i = 0; i < CASCADE_SWITCH_PINS; i++)
+        {
+            if (!(pattern & (1 << i)))
+            {
+                digitalWrite(_pins[i], LOW);
+            }
+        }
+    }
+    for (int i = 0; i < CASCADE_SWITCH_PINS; i++)
+    {
+        digitalWrite(_pins[i], (pattern & (1 << i)) ? HIGH : LOW);
+    }
+#endif
+    _pattern = pattern;
+}
+
+//Returns the pattern that was written last.
+uint8_t CascadeSwitch::read()
+{
+    return _pattern;
+}
@@ -0,0 +1,247 @@
+/**********************************************************
+** @file		Checkpoint.cpp
+**
+** Wear levelled snapshots in the internal flash, see
+** Checkpoint.h
+**
+
+*/
+
+#include "Checkpoint.h"
+#include "Crc16.h"
+#include <stddef.h>
+
+#define CHECKPOINT_AREA_SIZE (CHECKPOINT_SLOTS * CHECKPOINT_SLOT_SIZE)
+
+#ifdef PLATFORM_SAMD21
+//The area is a constant of the firmware image, aligned to a row. It is only read through volatile pointers, so the
+//compiler doesn't assume the zeros of the initializer.
+__attribute__((aligned(CHECKPOINT_ROW_SIZE), used)) static const uint8_t _checkpointArea[CHECKPOINT_AREA_SIZE] = {};
+#else
+static uint8_t _checkpointArea[CHECKPOINT_AREA_SIZE];
+#endif
+
+//Copies len bytes out of the area.
+static void _copy(void *data, const volatile uint8_t *from, unsigned int len)
+{
+    uint8_t *to = (uint8_t *) data;
+    while (len--)
+    {
+        *to++ = *from++;
+    }
+}
+
+
+Checkpoint::Checkpoint()
+{
+    _layout = 0;
+    _newest = -1;
+    _sequence = 0;
+    _saved = 0;
+    _readOffset = 0;
+    _readSize = 0;
+    _writeSlot = -1;
+    _writeOffset = 0;
+    _erasedRows = 0;
+    _writeCrc = CRC16_START;
+}
+
+//Looks for the newest snapshot with the given layout, returns true if there is one. read() returns its data from the
+//start.
+bool Checkpoint::begin(uint16_t layout)
+{
+    _layout = layout;
+    _newest = -1;
+    _sequence = 0;
+    _readOffset = 0;
+    _readSize = 0;
+    for (unsigned int slot = 0; slot < CHECKPOINT_SLOTS; slot++)
+    {
+        CheckpointTrailer trailer;
+        if (_valid(slot, trailer) && (_newest < 0 || (int32_t) (trailer.sequence - _sequence) > 0))
+        {
+            _newest = (int) slot;
+            _sequence = trailer.sequence;
+            _readSize = trailer.size;
+        }
+    }
+    return _newest >= 0;
+}
+
+//Reads the next len bytes of the newest snapshot, returns false if it has less.
+bool Checkpoint::read(void *data, unsigned int len)
+{
+    if (_newest < 0 || _readOffset + len > _readSize)
+    {
+        return false;
+    }
+    _copy(data, _slot(_newest) + _readOffset, len);
+    _readOffset += len;
+    return true;
+}
+
+//Starts a new snapshot in the slot after the newest one, the newest snapshot stays valid until finish(). The row with
+//the trailer is erased first, so the old snapshot of the slot is gone, the other rows when the data reaches them.
+void Checkpoint::start()
+{
+    _writeSlot = _newest < 0 ? 0 : (_newest + 1) % CHECKPOINT_SLOTS;
+    _eraseRow(_slot(_writeSlot) + (CHECKPOINT_SLOT_ROWS - 1) * CHECKPOINT_ROW_SIZE);
+    _erasedRows = 0;
+    _writeOffset = 0;
+    _writeCrc = CRC16_START;
+}
+
+//Appends len bytes to the snapshot, full pages are written right away. Returns false if they don't fit into
+//CHECKPOINT_DATA_MAX or start() wasn't called.
+bool Checkpoint::write(const void *data, unsigned int len)
+{
+    if (_writeSlot < 0 || _writeOffset + len > CHECKPOINT_DATA_MAX)
+    {
+        return false;
+    }
+    _writeCrc = crc16(data, len, _writeCrc);
+    const uint8_t *bytes = (const uint8_t *) data;
+    while (len--)
+    {
+        _page[_writeOffset % CHECKPOINT_PAGE_SIZE] = *bytes++;
+        _writeOffset++;
+        if (_writeOffset % CHECKPOINT_PAGE_SIZE == 0)
+        {
+            _writePage(_writeSlot, _writeOffset - CHECKPOINT_PAGE_SIZE);
+        }
+    }
+    return true;
+}
+
+//Writes the rest of the data and the trailer, from now on the new snapshot is the newest. Returns false if it can't
+//be read back.
+bool Checkpoint::finish()
+{
+    if (_writeSlot < 0)
+    {
+        return false;
+    }
+    unsigned int used = _writeOffset % CHECKPOINT_PAGE_SIZE;
+    if (used > 0)
+    {
+        memset(_page + used, 0xFF, CHECKPOINT_PAGE_SIZE - used);
+        _writePage(_writeSlot, _writeOffset - used);
+    }
+
+    CheckpointTrailer trailer;
+    memcpy(trailer.magic, CHECKPOINT_MAGIC, sizeof(trailer.magic));
+    trailer.layout = _layout;
+    trailer.size = (uint16_t) _writeOffset;
+    trailer.sequence = _sequence + 1;
+    trailer.crc = crc16(&trailer, offsetof(CheckpointTrailer, crc), _writeCrc);
+    memset(_page, 0xFF, sizeof(_page));
+    memcpy(_page, &trailer, sizeof(trailer));
+    // The row of the trailer was erased by start(), the rows after the data stay as they are.
+    _programPage(_slot(_writeSlot) + CHECKPOINT_DATA_MAX, _page);
+
+    unsigned int slot = _writeSlot;
+    _writeSlot = -1;
+    if (!_valid(slot, trailer))
+    {
+        return false;
+    }
+    _newest = (int) slot;
+    _sequence = trailer.sequence;
+    _readOffset = 0;
+    _readSize = trailer.size;
+    _saved++;
+    return true;
+}
+
+//Returns the sequence number of the newest snapshot, 0 if there is none.
+unsigned long Checkpoint::getSequence()
+{
+    return _newest < 0 ? 0 : _sequence;
+}
+
+//Returns the number of snapshots written since the start.
+unsigned long Checkpoint::getSaved()
+{
+    return _saved;
+}
+
+//Checks the trailer of a slot and the CRC of its data.
+bool Checkpoint::_valid(unsigned int slot, CheckpointTrailer &trailer)
+{
+    const volatile uint8_t *data = _slot(slot);
+    _copy(&trailer, data + CHECKPOINT_DATA_MAX, sizeof(trailer));
+    if (memcmp(trailer.magic, CHECKPOINT_MAGIC, sizeof(trailer.magic)) != 0 || trailer.layout != _layout ||
+        trailer.size > CHECKPOINT_DATA_MAX)
+    {
+        return false;
+    }
+    uint16_t crc = CRC16_START;
+    uint8_t chunk[CHECKPOINT_PAGE_SIZE];
+    for (unsigned int offset = 0; offset < trailer.size; offset += sizeof(chunk))
+    {
+        unsigned int len = trailer.size - offset < sizeof(chunk) ? trailer.size - offset : sizeof(chunk);
+        _copy(chunk, data + offset, len);
+        crc = crc16(chunk, len, crc);
+    }
+    return crc16(&trailer, offsetof(CheckpointTrailer, crc), crc) == trailer.crc;
+}
+
+//Writes the page buffer to a data page of a slot, erases the rows up to it first. The trailer row isn't erased here,
+//start() did that.
+void Checkpoint::_writePage(unsigned int slot, unsigned int offset)
+{
+    unsigned int row = offset / CHECKPOINT_ROW_SIZE;
+    while (_erasedRows <= row && _erasedRows < CHECKPOINT_SLOT_ROWS - 1)
+    {
+        _eraseRow(_slot(slot) + _erasedRows * CHECKPOINT_ROW_SIZE);
+        _erasedRows++;
+    }
+    _programPage(_slot(slot) + offset, _page);
+}
+
+const volatile uint8_t *Checkpoint::_slot(unsigned int slot)
+{
+    return (const volatile uint8_t *) _checkpointArea + slot * CHECKPOINT_SLOT_SIZE;
+}
+
+//Erases one row, all its bytes read 0xFF afterwards.
+void Checkpoint::_eraseRow(const volatile uint8_t *row)
+{
+#ifdef PLATFORM_SAMD21
+    NVMCTRL->STATUS.reg = NVMCTRL_STATUS_MASK;
+    NVMCTRL->ADDR.reg = (uint32_t) row / 2;
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+    while (!NVMCTRL->INTFLAG.bit.READY)
+    {
+    }
+#else
+    memset((uint8_t *) row, 0xFF, CHECKPOINT_ROW_SIZE);
+#endif
+}
+
+//Programs one erased page. The page buffer of the NVM controller is filled with 32 bit writes to the page address
+//and written with the write page command.
+void Checkpoint::_programPage(const volatile uint8_t *page, const uint8_t *data)
+{
+#ifdef PLATFORM_SAMD21
+    NVMCTRL->CTRLB.bit.MANW = 1;
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+    while (!NVMCTRL->INTFLAG.bit.READY)
+    {
+    }
+    volatile uint32_t *buffer = (volatile uint32_t *) page;
+    for (unsigned int i = 0; i < CHECKPOINT_PAGE_SIZE / 4; i++)
+    {
+        uint32_t word;
+        memcpy(&word, data + i * 4, sizeof(word));
+        buffer[i] = word;
+    }
+    NVMCTRL->ADDR.reg = (uint32_t) page / 2;
+    NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+    while (!NVMCTRL->INTFLAG.bit.READY)
+    {
+    }
+#else
+    memcpy((uint8_t *) page, data, CHECKPOINT_PAGE_SIZE);
+#endif
+}
@@ -0,0 +1,488 @@
+/**********************************************************
+** @file		DataLogger.cpp
+**
+** Buffered SD-Card logger, see DataLogger.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "Platform.h"
+#include "DataLogger.h"
+#include "Deadline.h"
+#include "LogFormat.h"
+
+// Logger that is flushed by the brown-out interrupt
+static DataLogger *_brownoutLogger = nullptr;
+
+
+DataLogger::DataLogger()
+{
+    _open = false;
+    _indexed = false;
+    _head = 0;
+    _used = 0;
+    _filePos = 0;
+    _size = 0;
+    _epoch = 0;
+    _indexPos = 0;
+    _maxRecords = 30;
+    _maxAge = 30000;
+    _records = 0;
+    _lastFlush = 0;
+    _overruns = 0;
+    _dropped = 0;
+    _queueMax = 0;
+    _directWrites = false;
+    _direct = false;
+    _sector = 0;
+    _target = 0;
+    _written = 0;
+    _inFlight = 0;
+    _targetEpoch = 0;
+}
+
+//Opens the log file for appending, with indexName the index is appended to it. A new file gets size bytes
+//allocated in one piece (if the card has a contiguous free range), full() tells when it is filled.
+bool DataLogger::begin(const char *fileName, const char *indexName, unsigned long size)
+{
+    SdCardLock lock;
+    _file = sd.open(fileName, FILE_WRITE);
+    _open = (bool) _file;
+    _indexed = false;
+    _direct = false;
+    _size = size;
+    if (_open)
+    {
+        _filePos = _file.size();
+        // Fails on a fragmented card, the file then grows cluster by cluster.
+        if (_filePos == 0 && size > 0 && _file.preAllocate(size) && _directWrites)
+        {
+            // exFAT keeps the valid length of the allocated file at 0 and only SdFat's writes advance it, the raw
+            // sectors would never be part of the file. FAT sets the size to the allocation, close() cuts it.
+            uint32_t last;
+            _direct = sd.fatType() != FAT_TYPE_EXFAT && _file.contiguousRange(&_sector, &last) && _writer.begin();
+        }
+        if (indexName != nullptr)
+        {
+            _indexFile = sd.open(indexName, FILE_WRITE);
+            _indexed = (bool) _indexFile;
+        }
+    }
+    // The ring starts at the file offset, so every sector of the file is in one piece in the buffer.
+    _head = (_filePos + _used) % LOG_BUFFER_SIZE;
+    _target = _filePos;
+    _written = _filePos;
+    _inFlight = 0;
+    _indexPos = _filePos;
+    _lastFlush = millis();
+    return _open;
+}
+
+//Writes everything that is buffered and cuts the file to the written size, the allocated rest is freed.
+void DataLogger::close()
+{
+    if (!_open)
+    {
+        return;
+    }
+    SdCardLock lock;
+    forceFlush();
+    // A direct write keeps the incomplete sector in the buffer.
+    _file.truncate(_filePos + _used);
+    _file.close();
+    _used = 0;
+    if (_indexed)
+    {
+        _indexFile.close();
+    }
+    _open = false;
+    _indexed = false;
+}
+
+//Sets after how many records or milliseconds the buffered sectors are written to the card.
+void DataLogger::setFlushPolicy(unsigned int maxRecords, unsigned long maxAge)
+{
+    _maxRecords = maxRecords;
+    _maxAge = maxAge;
+}
+
+//Writes the sectors of the next files through SdDmaWriter without waiting for the card, if the card has FAT16/FAT32
+//and they can be allocated in one piece. Otherwise SdFat writes them as before.
+void DataLogger::setDirectWrites(bool enabled)
+{
+    _directWrites = enabled;
+}
+
+//Uses the BOD33 brown-out detector to write all buffered data before the supply collapses. After the warning the
+//detector is switched back to reset the MCU, so this works once per boot.
+bool DataLogger::enableBrownoutFlush()
+{
+#ifdef PLATFORM_SAMD21
+    _brownoutLogger = this;
+
+    SYSCTRL->BOD33.bit.ENABLE = 0;
+    while (!SYSCTRL->PCLKSR.bit.B33SRDY);
+    SYSCTRL->BOD33.reg = SYSCTRL_BOD33_LEVEL(LOG_BROWNOUT_LEVEL) | SYSCTRL_BOD33_ACTION_INT | SYSCTRL_BOD33_HYST;
+    SYSCTRL->BOD33.bit.ENABLE = 1;
+    while (!SYSCTRL->PCLKSR.bit.BOD33RDY);
+
+    SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_BOD33DET;
+    SYSCTRL->INTENSET.reg = SYSCTRL_INTENSET_BOD33DET;
+    NVIC_EnableIRQ(SYSCTRL_IRQn);
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Appends one line to the buffer. Returns false if the record had to be dropped.
+bool DataLogger::log(const char *record)
+{
+    return _append(record, strlen(record), true);
+}
+
+//Appends one binary record to the buffer. Returns false if the record had to be dropped.
+bool DataLogger::write(const void *data, unsigned int len)
+{
+    return _append((const char *) data, len, false);
+}
+
+//Sets the time of the records that follow, it goes into the index with the next flush.
+void DataLogger::mark(unsigned long epoch)
+{
+    _epoch = epoch;
+}
+
+//Checks the flush policy. Call this once per loop.
+void DataLogger::update()
+{
+    if (!_open)
+    {
+        return;
+    }
+    if (_direct && _written < _target)
+    {
+        _writeDirect(_target, false);
+    }
+    if (_records >= _maxRecords || timeSince(millis(), _lastFlush) >= _maxAge ||
+        _used >= LOG_BUFFER_SIZE - LOG_SECTOR_SIZE)
+    {
+        flush();
+    }
+}
+
+//Writes all complete sectors to the card, an incomplete sector stays in the buffer.
+void DataLogger::flush()
+{
+    if (!_open)
+    {
+        return;
+    }
+    SdCardLock lock;
+    if (_direct)
+    {
+        _writeDirect((_filePos + _used) / LOG_SECTOR_SIZE * LOG_SECTOR_SIZE, false);
+    }
+    unsigned int chunk = LOG_SECTOR_SIZE - (_filePos % LOG_SECTOR_SIZE);
+    while (!_direct && _used >= chunk)
+    {
+        _write(chunk);
+        chunk = LOG_SECTOR_SIZE;
+    }
+    if (!_direct)
+    {
+        _sync();
+    }
+    _records = 0;
+    _lastFlush = millis();
+}
+
+//Writes everything that is buffered, including an incomplete sector, and updates the directory entry.
+void DataLogger::forceFlush()
+{
+    if (!_open)
+    {
+        return;
+    }
+    SdCardLock lock;
+    if (_direct)
+    {
+        _writeDirect(_filePos + _used, true);
+    }
+    if (!_direct)
+    {
+        _write(_used);
+        _sync();
+    }
+    _records = 0;
+    _lastFlush = millis();
+}
+
+//Waits for the sectors on their way to the card and ends the direct write, so other files can be written.
+void DataLogger::release()
+{
+    if (_direct && (_inFlight > 0 || _written < _target))
+    {
+        _writeDirect(_target, true);
+    }
+}
+
+//Returns the number of bytes waiting in RAM.
+unsigned int DataLogger::buffered()
+{
+    return _used;
+}
+
+//Returns true if the allocated size of the file can't take another buffer, it is time for the next file.
+bool DataLogger::full()
+{
+    return _open && _size > 0 && _filePos + _used + LOG_BUFFER_SIZE > _size;
+}
+
+//Returns true if the open file is written through SdDmaWriter.
+bool DataLogger::direct()
+{
+    return _direct;
+}
+
+//Returns how often a full buffer forced a flush outside the policy.
+unsigned long DataLogger::getOverruns()
+{
+    return _overruns;
+}
+
+//Returns the number of records dropped because the buffer was full of sectors waiting for the card.
+unsigned long DataLogger::getDropped()
+{
+    return _dropped;
+}
+
+//Returns the most complete sectors that waited in the buffer at once.
+unsigned int DataLogger::getQueueMax()
+{
+    return _queueMax;
+}
+
+//Returns the number of sectors the card rejected or didn't confirm in time, each one switches the file back to SdFat.
+unsigned long DataLogger::getWriteErrors()
+{
+    return _writer.getErrors();
+}
+
+//Cuts a file that wasn't closed, e.g. by a reset, to the size of its last index entry. Without close() the
+//allocated rest or the records after the last flush would be read as garbage. Returns false if nothing was cut.
+bool DataLogger::recover(const char *fileName, const char *indexName)
+{
+    SdCardLock lock;
+    FsFile index = sd.open(indexName, FILE_READ);
+    if (!index)
+    {
+        return false;
+    }
+    LogIndexEntry entry;
+    uint64_t entries = index.size() / sizeof(entry);
+    bool ok = entries > 0 && index.seek((entries - 1) * sizeof(entry)) &&
+              index.read(&entry, sizeof(entry)) == (int) sizeof(entry);
+    index.close();
+    if (!ok)
+    {
+        return false;
+    }
+    FsFile file = sd.open(fileName, O_RDWR);
+    if (!file)
+    {
+        return false;
+    }
+    ok = file.size() > entry.offset && file.truncate(entry.offset);
+    file.close();
+    return ok;
+}
+
+//Flushes the logger of the brown-out interrupt once the card is free.
+static void _brownoutFlush()
+{
+    if (_brownoutLogger != nullptr)
+    {
+        _brownoutLogger->forceFlush();
+    }
+}
+
+//Called from the brown-out interrupt. If the card is in use, by the logger or another file, the flush is done as soon
+//as it is free again.
+void DataLogger::brownoutDetected()
+{
+    SdCardLock::whenFree(_brownoutFlush);
+}
+
+//Adds a record to the buffer, flushing first if it does not fit anymore.
+bool DataLogger::_append(const char *data, unsigned int len, bool newline)
+{
+    unsigned int total = newline ? len + 2 : len;
+    if (!_open || total > LOG_BUFFER_SIZE - LOG_SECTOR_SIZE)
+    {
+        return false;
+    }
+
+    SdCardLock lock;
+    if (_direct && _used + total > LOG_BUFFER_SIZE)
+    {
+        // The sectors are still on their way, waiting for the card is what the direct writes avoid.
+        _dropped++;
+        return false;
+    }
+    if (_used + total > LOG_BUFFER_SIZE)
+    {
+        // Buffer full, write the sectors now even if the policy would wait longer.
+        _overruns++;
+        flush();
+    }
+    _put(data, len);
+    if (newline)
+    {
+        _put("\r\n", 2);
+    }
+    _records++;
+    unsigned int queue = (_filePos + _used) / LOG_SECTOR_SIZE - _filePos / LOG_SECTOR_SIZE;
+    if (queue > _queueMax)
+    {
+        _queueMax = queue;
+    }
+    return true;
+}
+
+//Copies data into the ring buffer, the caller made sure it fits.
+void DataLogger::_put(const char *data, unsigned int len)
+{
+    unsigned int first = LOG_BUFFER_SIZE - _head;
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(&_buffer[_head], data, first);
+    memcpy(&_buffer[0], data + first, len - first);
+    _head = (_head + len) % LOG_BUFFER_SIZE;
+    _used += len;
+}
+
+//Writes len bytes from the tail of the ring buffer to the file.
+void DataLogger::_write(unsigned int len)
+{
+    unsigned int tail = (_head + LOG_BUFFER_SIZE - _used) % LOG_BUFFER_SIZE;
+    unsigned int first = LOG_BUFFER_SIZE - tail;
+    if (first > len)
+    {
+        first = len;
+    }
+    _file.write((const uint8_t *) &_buffer[tail], first);
+    if (len > first)
+    {
+        _file.write((const uint8_t *) &_buffer[0], len - first);
+    }
+    _filePos += len;
+    _used -= len;
+}
+
+//Updates the directory entry and appends an index entry if the file grew since the last one.
+void DataLogger::_sync()
+{
+    _file.flush();
+    _index(_epoch, _filePos);
+}
+
+//Hands the sectors up to target to SdDmaWriter, a sector that ends after target is written but stays in the buffer.
+//Without wait it starts at most one transfer and returns, update() continues. When the card has everything the
+//write is ended and the index updated. If the card rejects a sector or doesn't confirm it in time (see
+//SdDmaWriter.h) the file is written by SdFat from there on.
+void DataLogger::_writeDirect(unsigned long target, bool wait)
+{
+    if (target > _target)
+    {
+        _target = target;
+        _targetEpoch = _epoch;
+    }
+    SdCardLock lock;
+    while (true)
+    {
+        if (_inFlight > 0)
+        {
+            if (!_writer.ready())
+            {
+                if (_writer.failed())
+                {
+                    break;
+                }
+                if (wait)
+                {
+                    continue;
+                }
+                return;
+            }
+            _written = _filePos + _inFlight;
+            if (_inFlight == LOG_SECTOR_SIZE)
+            {
+                _filePos += LOG_SECTOR_SIZE;
+                _used -= LOG_SECTOR_SIZE;
+            }
+            _inFlight = 0;
+        }
+        if (_written >= _target)
+        {
+            if (_writer.active())
+            {
+                _writer.stop();
+                _index(_targetEpoch, _written);
+            }
+            return;
+        }
+        if (!_writer.active() && !_writer.start(_sector + _filePos / LOG_SECTOR_SIZE))
+        {
+            break;
+        }
+        _writer.write((const uint8_t *) &_buffer[_filePos % LOG_BUFFER_SIZE]);
+        _inFlight = _target - _filePos < LOG_SECTOR_SIZE ? _target - _filePos : LOG_SECTOR_SIZE;
+        if (!wait)
+        {
+            return;
+        }
+    }
+    // Back to SdFat, it writes the buffer from the last confirmed sector on.
+    _writer.stop();
+    _direct = false;
+    _inFlight = 0;
+    _file.seek(_filePos);
+}
+
+//Appends an index entry if the file grew since the last one.
+void DataLogger::_index(unsigned long epoch, unsigned long offset)
+{
+    if (!_indexed || offset == _indexPos)
+    {
+        return;
+    }
+    LogIndexEntry entry;
+    entry.epoch = epoch;
+    entry.offset = offset;
+    _indexFile.write(&entry, sizeof(entry));
+    _indexFile.flush();
+    _indexPos = offset;
+}
+
+#ifdef PLATFORM_SAMD21
+//Brown-out warning, flush the log and let the detector reset the MCU if the voltage keeps falling.
+void SYSCTRL_Handler(void)
+{
+    if (SYSCTRL->INTFLAG.bit.BOD33DET)
+    {
+        SYSCTRL->INTENCLR.reg = SYSCTRL_INTENCLR_BOD33DET;
+        SYSCTRL->INTFLAG.reg = SYSCTRL_INTFLAG_BOD33DET;
+        DataLogger::brownoutDetected();
+
+        SYSCTRL->BOD33.bit.ENABLE = 0;
+        while (!SYSCTRL->PCLKSR.bit.B33SRDY);
+        SYSCTRL->BOD33.reg =
+                SYSCTRL_BOD33_LEVEL(LOG_BROWNOUT_RESET_LEVEL) | SYSCTRL_BOD33_ACTION_RESET | SYSCTRL_BOD33_HYST;
+        SYSCTRL->BOD33.bit.ENABLE = 1;
+    }
+}
+#endif
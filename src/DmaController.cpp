@@ -0,0 +1,119 @@
+/**********************************************************
+** @file		DmaController.cpp
+**
+** Shared DMAC setup and interrupt dispatch, see
+** DmaController.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "DmaController.h"
+
+#ifdef PLATFORM_SAMD21
+
+// The DMAC reads the first descriptor of every channel from here and writes the state of active channels back
+__attribute__((aligned(16))) static DmacDescriptor _descriptors[DMA_CHANNELS];
+__attribute__((aligned(16))) static DmacDescriptor _writeback[DMA_CHANNELS];
+
+static DmaCallback _callbacks[DMA_CHANNELS];
+static bool _started = false;
+
+
+//Enables the DMAC, safe to call from every user.
+void DmaController::begin()
+{
+    if (_started)
+    {
+        return;
+    }
+    _started = true;
+
+    PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+    PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+
+    DMAC->CTRL.bit.DMAENABLE = 0;
+    DMAC->CTRL.bit.SWRST = 1;
+    while (DMAC->CTRL.bit.SWRST);
+
+    memset(_descriptors, 0, sizeof(_descriptors));
+    memset(_writeback, 0, sizeof(_writeback));
+    DMAC->BASEADDR.reg = (uint32_t) _descriptors;
+    DMAC->WRBADDR.reg = (uint32_t) _writeback;
+    DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xF);
+
+    NVIC_SetPriority(DMAC_IRQn, 1);
+    NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+//Returns the first descriptor of a channel.
+DmacDescriptor *DmaController::descriptor(unsigned char channel)
+{
+    return &_descriptors[channel];
+}
+
+//Resets a channel and sets the peripheral trigger (one beat per trigger) and the callback for its interrupts.
+void DmaController::configure(unsigned char channel, unsigned char trigger, DmaCallback callback)
+{
+    _callbacks[channel] = callback;
+
+    noInterrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+    while (DMAC->CHCTRLA.bit.SWRST);
+    DMAC->CHCTRLB.reg = DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(trigger) | DMAC_CHCTRLB_TRIGACT_BEAT;
+    DMAC->CHINTENSET.reg = DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR;
+    interrupts();
+}
+
+//Starts a channel with its first descriptor.
+void DmaController::enable(unsigned char channel)
+{
+    noInterrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    DMAC->CHCTRLA.reg |= DMAC_CHCTRLA_ENABLE;
+    interrupts();
+}
+
+//Stops a channel.
+void DmaController::disable(unsigned char channel)
+{
+    noInterrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+    interrupts();
+}
+
+//Returns true while a channel is still transferring.
+bool DmaController::busy(unsigned char channel)
+{
+    noInterrupts();
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    bool enabled = DMAC->CHCTRLA.bit.ENABLE;
+    interrupts();
+    return enabled;
+}
+
+//Forwards the pending channel interrupt to its callback.
+void DmaController::handleInterrupt()
+{
+    unsigned char previous = DMAC->CHID.reg;
+    unsigned char channel = DMAC->INTPEND.bit.ID;
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    unsigned char flags = DMAC->CHINTFLAG.reg;
+    DMAC->CHINTFLAG.reg = flags;
+    DMAC->CHID.reg = previous;
+
+    if (channel < DMA_CHANNELS && _callbacks[channel] != nullptr)
+    {
+        _callbacks[channel](flags);
+    }
+}
+
+void DMAC_Handler(void)
+{
+    DmaController::handleInterrupt();
+}
+
+#endif
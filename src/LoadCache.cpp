@@ -0,0 +1,199 @@
+/**********************************************************
+** @file		LoadCache.cpp
+**
+** Learned optimal load per wind speed, see LoadCache.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "LoadCache.h"
+#include "Checkpoint.h"
+
+
+LoadCache::LoadCache()
+{
+    clear();
+}
+
+//Forgets everything that was learned.
+void LoadCache::clear()
+{
+    for (int i = 0; i < LOAD_CACHE_BUCKETS; i++)
+    {
+        _entry[i].power = 0;
+        _entry[i].state = 0;
+    }
+    _bucket = -1;
+    _dirty = false;
+}
+
+//Learns from one operating point: the power measured with a state at a wind speed.
+void LoadCache::update(int windSpeedX10, int state, float power)
+{
+    if (!(power > 0))
+    {
+        return;
+    }
+    LoadCacheEntry &entry = _entry[bucket(windSpeedX10)];
+    entry.power *= LOAD_CACHE_DECAY;
+    if (power >= entry.power)
+    {
+        _dirty |= entry.state != state || entry.power == 0;
+        entry.power = power;
+        entry.state = state;
+    }
+}
+
+//Returns the best known state for the wind speed, -1 if nothing was learned for it yet.
+int LoadCache::lookup(int windSpeedX10)
+{
+    const LoadCacheEntry &entry = _entry[bucket(windSpeedX10)];
+    return entry.power > 0 ? entry.state : -1;
+}
+
+//Tracks the bucket of the wind speed. Returns true if the wind moved to another bucket, the edges of the current one
+//are widened by LOAD_CACHE_HYSTERESIS so a wind speed on an edge doesn't toggle between two buckets.
+bool LoadCache::enter(int windSpeedX10)
+{
+    if (_bucket >= 0)
+    {
+        int low = _bucket * LOAD_CACHE_WIDTH - LOAD_CACHE_HYSTERESIS;
+        int high = (_bucket + 1) * LOAD_CACHE_WIDTH + LOAD_CACHE_HYSTERESIS;
+        if (windSpeedX10 >= low && (windSpeedX10 < high || _bucket == LOAD_CACHE_BUCKETS - 1))
+        {
+            return false;
+        }
+    }
+    _bucket = bucket(windSpeedX10);
+    return true;
+}
+
+//Reads a cache saved by save(). The learned values are kept if the file is missing or doesn't match the build.
+bool LoadCache::load(const char *fileName)
+{
+    FsFile file = sd.open(fileName, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+    LoadCacheHeader header;
+    LoadCacheEntry entry[LOAD_CACHE_BUCKETS];
+    bool ok = file.read((uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+              memcmp(header.magic, LOAD_CACHE_MAGIC, 4) == 0 && header.version == LOAD_CACHE_VERSION &&
+              header.buckets == LOAD_CACHE_BUCKETS && header.width == LOAD_CACHE_WIDTH &&
+              header.order == LOAD_ORDER &&
+              file.read((uint8_t *) entry, sizeof(entry)) == sizeof(entry);
+    file.close();
+    if (!ok)
+    {
+        return false;
+    }
+
+    LoadCacheEntry current[LOAD_CACHE_BUCKETS];
+    memcpy(current, _entry, sizeof(_entry));
+    memcpy(_entry, entry, sizeof(_entry));
+    if (_checksum() != header.checksum)
+    {
+        memcpy(_entry, current, sizeof(_entry));
+        return false;
+    }
+    _dirty = false;
+    return true;
+}
+
+//Replaces the file with the current cache.
+bool LoadCache::save(const char *fileName)
+{
+    LoadCacheHeader header;
+    memcpy(header.magic, LOAD_CACHE_MAGIC, 4);
+    header.version = LOAD_CACHE_VERSION;
+    header.buckets = LOAD_CACHE_BUCKETS;
+    header.width = LOAD_CACHE_WIDTH;
+    header.order = LOAD_ORDER;
+    header.checksum = _checksum();
+
+    sd.remove(fileName);
+    FsFile file = sd.open(fileName, FILE_WRITE);
+    if (!file)
+    {
+        return false;
+    }
+    bool ok = file.write((const uint8_t *) &header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t *) _entry, sizeof(_entry)) == sizeof(_entry);
+    file.close();
+    if (ok)
+    {
+        _dirty = false;
+    }
+    return ok;
+}
+
+//Reads the cache from a snapshot, it was written there by save(checkpoint). The learned values are kept if it doesn't
+//match the build. The restored cache is newer than the file on the SD-Card, so it counts as not saved.
+bool LoadCache::load(Checkpoint &checkpoint)
+{
+    LoadCacheHeader header;
+    LoadCacheEntry entry[LOAD_CACHE_BUCKETS];
+    bool ok = checkpoint.read(&header, sizeof(header)) && checkpoint.read(entry, sizeof(entry)) &&
+              memcmp(header.magic, LOAD_CACHE_MAGIC, 4) == 0 && header.version == LOAD_CACHE_VERSION &&
+              header.buckets == LOAD_CACHE_BUCKETS && header.width == LOAD_CACHE_WIDTH &&
+              header.order == LOAD_ORDER;
+    if (!ok)
+    {
+        return false;
+    }
+
+    LoadCacheEntry current[LOAD_CACHE_BUCKETS];
+    memcpy(current, _entry, sizeof(_entry));
+    memcpy(_entry, entry, sizeof(_entry));
+    if (_checksum() != header.checksum)
+    {
+        memcpy(_entry, current, sizeof(_entry));
+        return false;
+    }
+    _dirty = true;
+    return true;
+}
+
+//Appends the cache to a snapshot that was started by the caller.
+bool LoadCache::save(Checkpoint &checkpoint)
+{
+    LoadCacheHeader header;
+    memcpy(header.magic, LOAD_CACHE_MAGIC, 4);
+    header.version = LOAD_CACHE_VERSION;
+    header.buckets = LOAD_CACHE_BUCKETS;
+    header.width = LOAD_CACHE_WIDTH;
+    header.order = LOAD_ORDER;
+    header.checksum = _checksum();
+    return checkpoint.write(&header, sizeof(header)) && checkpoint.write(_entry, sizeof(_entry));
+}
+
+//Returns true if a state was learned since the last load or save.
+bool LoadCache::dirty()
+{
+    return _dirty;
+}
+
+//Returns the bucket of a wind speed.
+int LoadCache::bucket(int windSpeedX10)
+{
+    if (windSpeedX10 < 0)
+    {
+        return 0;
+    }
+    int index = windSpeedX10 / LOAD_CACHE_WIDTH;
+    return index < LOAD_CACHE_BUCKETS ? index : LOAD_CACHE_BUCKETS - 1;
+}
+
+//Sum of all entry bytes, enough to notice a file cut off by a power loss.
+uint16_t LoadCache::_checksum()
+{
+    const uint8_t *data = (const uint8_t *) _entry;
+    uint16_t sum = 0;
+    for (unsigned int i = 0; i < sizeof(_entry); i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
@@ -0,0 +1,40 @@
+/**********************************************************
+** @file		LoadCascade.cpp
+**
+** Resistor cascade model, see LoadCascade.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "LoadCascade.h"
+
+constexpr double LOAD_RESISTOR[LOAD_STAGES] = {LOAD_R1, LOAD_R2, LOAD_R3, LOAD_R4, LOAD_R5, LOAD_R6, LOAD_R7, LOAD_R8};
+
+// Calculated by the compiler, lives in flash
+static constexpr LoadTable LOAD_TABLE = makeLoadTable(LOAD_RESISTOR, LOAD_RDS_ON, LOAD_ORDER);
+
+
+//Returns the MOSFETs that are switched on in a state, bit i for MOSFET i.
+uint8_t LoadCascade::pattern(int state)
+{
+    return LOAD_TABLE.pattern[state & 0xFF];
+}
+
+//Returns the resistance (Ohm) of a state.
+float LoadCascade::resistance(int state)
+{
+    return LOAD_TABLE.resistance[state & 0xFF];
+}
+
+//Returns the conductance (Siemens) of a state.
+float LoadCascade::conductance(int state)
+{
+    return LOAD_TABLE.conductance[state & 0xFF];
+}
+
+//Returns the power (W) in the cascade at the given voltage across it, U^2 * G.
+float LoadCascade::power(float voltage, int state)
+{
+    return voltage * voltage * LOAD_TABLE.conductance[state & 0xFF];
+}
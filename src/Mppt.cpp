@@ -0,0 +1,288 @@
+/**********************************************************
+** @file		Mppt.cpp
+**
+** MPPT strategies for the resistor cascade, see Mppt.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "Mppt.h"
+#include "LoadCascade.h"
+
+
+MpptBase::MpptBase()
+{
+    begin(MPPT_STATE_MAX);
+}
+
+//Starts tracking at a state, 255 equals lowest possible resistance, thus the climb starts towards higher resistance.
+void MpptBase::begin(int state, bool risingRes)
+{
+    _state = constrain(state, MPPT_STATE_MIN, MPPT_STATE_MAX);
+    _risingRes = risingRes;
+    _first = true;
+    _oldPower = 0;
+    _oldVoltage = 0;
+    _oldState = _state;
+    _guessWind = -1;
+    _voltageNoise = 0;
+    _steps = 0;
+    _moves = 0;
+    _holds = 0;
+}
+
+//Returns the state the cascade should be switched to.
+int MpptBase::getState()
+{
+    return _state;
+}
+
+//Returns true if the search is heading towards a higher resistance (lower state).
+bool MpptBase::getRisingRes()
+{
+    return _risingRes;
+}
+
+//Moves to a state from outside (estimate, cache). The next step starts a new comparison from there.
+void MpptBase::jumpTo(int state)
+{
+    state = constrain(state, MPPT_STATE_MIN, MPPT_STATE_MAX);
+    if (state != _state)
+    {
+        _moves++;
+    }
+    _state = state;
+    _first = true;
+}
+
+//Jumps to the estimate for the wind speed if it changed by more than MPPT_GUESS_DELTA since the last estimate.
+//Returns true if the state changed.
+bool MpptBase::windUpdate(int windSpeedX10)
+{
+    if (_guessWind >= 0 && abs(windSpeedX10 - _guessWind) <= MPPT_GUESS_DELTA)
+    {
+        return false;
+    }
+    _guessWind = windSpeedX10;
+    int guess = guessState(windSpeedX10);
+    if (guess == _state)
+    {
+        return false;
+    }
+    jumpTo(guess);
+    return true;
+}
+
+//Sets the standard error of the voltage measurements (same unit as the voltage passed to step()), the deadband of
+//the strategies follows from it.
+void MpptBase::setNoise(float voltageNoise)
+{
+    _voltageNoise = voltageNoise > 0 ? voltageNoise : 0;
+}
+
+//Returns the state whose resistance is closest to the optimal load for the wind speed, R = MPPT_GUESS_K / v.
+int MpptBase::guessState(int windSpeedX10)
+{
+    if (windSpeedX10 <= 0)
+    {
+        //Standing rotor, let it start with the highest resistance.
+        return MPPT_STATE_MIN;
+    }
+    float target = MPPT_GUESS_K * 10.0f / windSpeedX10;
+    int best = MPPT_STATE_MIN;
+    float bestError = fabsf(LoadCascade::resistance(best) - target);
+    for (int state = MPPT_STATE_MIN + 1; state <= MPPT_STATE_MAX; state++)
+    {
+        float error = fabsf(LoadCascade::resistance(state) - target);
+        if (error < bestError)
+        {
+            bestError = error;
+            best = state;
+        }
+    }
+    return best;
+}
+
+//Returns the number of steps taken.
+unsigned long MpptBase::getSteps()
+{
+    return _steps;
+}
+
+//Returns the number of steps that changed the state.
+unsigned long MpptBase::getMoves()
+{
+    return _moves;
+}
+
+//Returns the number of steps that kept the state because the change was within the noise.
+unsigned long MpptBase::getHolds()
+{
+    return _holds;
+}
+
+//Changes the state by delta, limited to the valid states. Towards higher resistance is a negative delta.
+int MpptBase::_move(int delta)
+{
+    int state = constrain(_state + delta, MPPT_STATE_MIN, MPPT_STATE_MAX);
+    if (state != _state)
+    {
+        _moves++;
+    }
+    _state = state;
+    return _state;
+}
+
+//Stores the operating point for the next comparison.
+void MpptBase::_remember(float power, float voltage)
+{
+    _oldPower = power;
+    _oldVoltage = voltage;
+    _first = false;
+    _steps++;
+}
+
+//Hill-Climbing Decision, if the previous climb/fall was useful continue, else turn in the other direction. A change
+//within the deadband keeps the state.
+int PerturbObserve::step(float power, float voltage)
+{
+    if (!_first && !_significant(power, voltage))
+    {
+        return _hold();
+    }
+    _oldState = _state;
+    if (_first)
+    {
+        _move(_risingRes ? -1 : 1);
+    }
+    else if (power > _oldPower)
+    {
+        _move(_risingRes ? -1 : 1);
+    }
+    else if (power < _oldPower)
+    {
+        _move(_risingRes ? 1 : -1);
+        _risingRes = !_risingRes;
+    }
+    _remember(power, voltage);
+    return _state;
+}
+
+//Perturb and observe with a step size proportional to the slope of the power over the state: far from the maximum
+//the slope is steep and the steps are large, close to it they shrink to one state.
+int AdaptiveStep::step(float power, float voltage)
+{
+    int lastStep = abs(_state - _oldState);
+    if (!_first && lastStep != 0 && !_significant(power, voltage))
+    {
+        return _hold();
+    }
+    _oldState = _state;
+    if (_first || lastStep == 0)
+    {
+        _probe();
+        _remember(power, voltage);
+        return _state;
+    }
+
+    float mean = (power + _oldPower) / 2;
+    int size = 1;
+    if (mean > 0)
+    {
+        float slope = fabsf(power - _oldPower) / (mean * lastStep);
+        size = constrain((int) (MPPT_ADAPTIVE_GAIN * slope + 0.5f), 1, MPPT_MAX_STEP);
+    }
+    if (power < _oldPower)
+    {
+        _risingRes = !_risingRes;
+    }
+    _move(_risingRes ? -size : size);
+    _remember(power, voltage);
+    return _state;
+}
+
+//Incremental conductance: at the maximum dP/dU = I + U * dI/dU = 0. Left of it (dI/dU > -I/U) a higher voltage, thus a
+//higher resistance, gives more power. The slope of the source can only be seen between two different states, so after
+//a step without a move the state is perturbed by one.
+int IncrementalConductance::step(float power, float voltage)
+{
+    bool moved = _state != _oldState;
+    if (!_first && moved && voltage > 0 && fabsf(voltage - _oldVoltage) <= _voltageDeadband() &&
+        !_significant(power, voltage))
+    {
+        //Neither the voltage nor the power changed beyond the noise, the slope can't be told apart from the maximum.
+        return _hold();
+    }
+    float current = voltage * LoadCascade::conductance(_state);
+    float oldCurrent = _oldVoltage * LoadCascade::conductance(_oldState);
+    _oldState = _state;
+
+    if (_first || !moved || voltage <= 0)
+    {
+        _probe();
+        _remember(power, voltage);
+        return _state;
+    }
+
+    float dU = voltage - _oldVoltage;
+    float dI = current - oldCurrent;
+    float target = -current / voltage;
+    if (dU == 0)
+    {
+        //Same voltage with a different load: the source moved, follow the current.
+        if (dI != 0)
+        {
+            _risingRes = dI > 0;
+            _move(_risingRes ? -1 : 1);
+        }
+    }
+    else
+    {
+        float slope = dI / dU;
+        if (fabsf(slope - target) > MPPT_INC_TOLERANCE * fabsf(target))
+        {
+            _risingRes = slope > target;
+            _move(_risingRes ? -1 : 1);
+        }
+    }
+    _remember(power, voltage);
+    return _state;
+}
+
+//Moves one state in the search direction to get a difference to compare with, turns around at the end of the range.
+int MpptBase::_probe()
+{
+    if (_move(_risingRes ? -1 : 1) == _oldState)
+    {
+        _risingRes = !_risingRes;
+        _move(_risingRes ? -1 : 1);
+    }
+    return _state;
+}
+
+//Keeps the state and the last operating point, so a slow drift still adds up to a significant change.
+int MpptBase::_hold()
+{
+    _holds++;
+    _steps++;
+    return _state;
+}
+
+//Deadband for the difference of two voltage measurements.
+float MpptBase::_voltageDeadband()
+{
+    return MPPT_NOISE_SIGMA * 1.4142f * _voltageNoise;
+}
+
+//Returns true if the power differs from the last operating point by more than the noise. With P = U^2 * G the
+//relative error of the power is twice the one of the voltage.
+bool MpptBase::_significant(float power, float voltage)
+{
+    if (voltage <= 0)
+    {
+        return power != _oldPower;
+    }
+    float deadband = _voltageDeadband() * 2 * power / voltage;
+    return fabsf(power - _oldPower) > deadband;
+}
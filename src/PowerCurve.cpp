@@ -0,0 +1,119 @@
+/**********************************************************
+** @file		PowerCurve.cpp
+**
+** Power curve bins and energy of the turbine, see
+** PowerCurve.h
+**
+
+*/
+
+#include "PowerCurve.h"
+#include "Checkpoint.h"
+
+PowerCurve::PowerCurve()
+{
+    clear();
+}
+
+//Empties all bins and sets energy and time to 0.
+void PowerCurve::clear()
+{
+    memset(_bin, 0, sizeof(_bin));
+    _energy = 0;
+    _time = 0;
+}
+
+//Adds one MPPT step that lasted ms with the power it measured and the State it was measured with.
+void PowerCurve::add(int windSpeedX10, float power, int state, unsigned int ms)
+{
+    PowerCurveBin &entry = _bin[bin(windSpeedX10)];
+    entry.count++;
+    entry.powerMean += (power - entry.powerMean) / entry.count;
+    entry.stateMean += (state - entry.stateMean) / entry.count;
+    if (power > entry.powerMax)
+    {
+        entry.powerMax = power;
+    }
+    if (power > 0)
+    {
+        _energy += (uint64_t) (power * ms + 0.5f);
+    }
+    _time += ms;
+}
+
+//Copies a bin into out, returns false if it is empty or doesn't exist.
+bool PowerCurve::getBin(unsigned char bin, PowerCurveBin &out)
+{
+    if (bin >= POWER_CURVE_BINS || _bin[bin].count == 0)
+    {
+        return false;
+    }
+    out = _bin[bin];
+    return true;
+}
+
+//Returns the energy since the start in Wh.
+float PowerCurve::getEnergy()
+{
+    return (float) ((double) _energy / 3.6e6);
+}
+
+//Returns the measured time since the start in hours.
+float PowerCurve::getHours()
+{
+    return (float) ((double) _time / 3.6e6);
+}
+
+//Returns the energy as a share of what the rated power (W) would have delivered in the measured time, 0 before the
+//first step.
+float PowerCurve::getCapacityFactor(float ratedPower)
+{
+    if (_time == 0 || ratedPower <= 0)
+    {
+        return 0;
+    }
+    return (float) ((double) _energy / ((double) ratedPower * (double) _time));
+}
+
+//Continues the curve saved by save(checkpoint), returns false if the bins differ from the saved ones.
+bool PowerCurve::load(Checkpoint &checkpoint)
+{
+    uint8_t bins;
+    PowerCurveBin bin[POWER_CURVE_BINS];
+    uint64_t energy;
+    uint64_t time;
+    if (!checkpoint.read(&bins, sizeof(bins)) || bins != POWER_CURVE_BINS || !checkpoint.read(bin, sizeof(bin)) ||
+        !checkpoint.read(&energy, sizeof(energy)) || !checkpoint.read(&time, sizeof(time)))
+    {
+        return false;
+    }
+    memcpy(_bin, bin, sizeof(_bin));
+    _energy = energy;
+    _time = time;
+    return true;
+}
+
+//Appends the curve to a snapshot that was started by the caller.
+bool PowerCurve::save(Checkpoint &checkpoint)
+{
+    uint8_t bins = POWER_CURVE_BINS;
+    return checkpoint.write(&bins, sizeof(bins)) && checkpoint.write(_bin, sizeof(_bin)) &&
+           checkpoint.write(&_energy, sizeof(_energy)) && checkpoint.write(&_time, sizeof(_time));
+}
+
+//Returns the bin of a wind speed in 0.1 km/h, rounded to the nearest multiple of 0.5 m/s.
+unsigned char PowerCurve::bin(int windSpeedX10)
+{
+    if (windSpeedX10 < 0)
+    {
+        return 0;
+    }
+    int bin = (windSpeedX10 + POWER_CURVE_BIN_WIDTH / 2) / POWER_CURVE_BIN_WIDTH;
+    return bin < POWER_CURVE_BINS ? bin : POWER_CURVE_BINS - 1;
+}
+
+//Returns the wind speed in m/s the bin is centred on.
+float PowerCurve::binSpeed(unsigned char bin)
+{
+    return bin * 0.5f;
+}
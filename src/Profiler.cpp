@@ -0,0 +1,179 @@
+/**********************************************************
+** @file		Profiler.cpp
+**
+** Section, loop and latency statistics, see Profiler.h
+**
+
+*/
+
+#include "Profiler.h"
+
+#ifdef PROFILING
+
+const char *const *Profiler::_names = nullptr;
+unsigned char Profiler::_count = 0;
+uint32_t Profiler::_overhead = 0;
+ProfileStats Profiler::_stats[PROFILER_SECTIONS];
+unsigned long Profiler::_histogram[PROFILER_HISTOGRAM_BINS];
+uint32_t Profiler::_lastLoop = 0;
+bool Profiler::_looped = false;
+volatile unsigned long Profiler::_latencyCount = 0;
+volatile uint32_t Profiler::_latencyMax = 0;
+volatile uint64_t Profiler::_latencyTotal = 0;
+
+//Sets the names of the sections, section i is names[i]. Measures the cost of an empty scope, which is subtracted from
+//every measurement.
+void Profiler::begin(const char *const *names, unsigned char count)
+{
+    _names = names;
+    _count = count < PROFILER_SECTIONS ? count : PROFILER_SECTIONS;
+    _overhead = 0;
+    uint32_t least = 0xFFFFFFFFUL;
+    for (unsigned char i = 0; i < 8; i++)
+    {
+        uint32_t start = cycles();
+        uint32_t cost = cycles() - start;
+        if (cost < least)
+        {
+            least = cost;
+        }
+    }
+    _overhead = least;
+    reset();
+}
+
+//Clears all statistics.
+void Profiler::reset()
+{
+    for (unsigned char i = 0; i < PROFILER_SECTIONS; i++)
+    {
+        _stats[i].count = 0;
+        _stats[i].min = 0xFFFFFFFFUL;
+        _stats[i].max = 0;
+        _stats[i].total = 0;
+    }
+    for (unsigned char i = 0; i < PROFILER_HISTOGRAM_BINS; i++)
+    {
+        _histogram[i] = 0;
+    }
+    _looped = false;
+    noInterrupts();
+    _latencyCount = 0;
+    _latencyMax = 0;
+    _latencyTotal = 0;
+    interrupts();
+}
+
+//Adds one measurement of a section.
+void Profiler::add(unsigned char section, uint32_t cycles)
+{
+    if (section >= _count)
+    {
+        return;
+    }
+    cycles = cycles > _overhead ? cycles - _overhead : 0;
+    ProfileStats &stats = _stats[section];
+    stats.count++;
+    stats.total += cycles;
+    if (cycles < stats.min)
+    {
+        stats.min = cycles;
+    }
+    if (cycles > stats.max)
+    {
+        stats.max = cycles;
+    }
+}
+
+//Adds the time since the last call to the loop period histogram.
+void Profiler::loop()
+{
+    uint32_t now = cycles();
+    if (_looped)
+    {
+        uint32_t us = (now - _lastLoop) / (F_CPU / 1000000UL);
+        unsigned char bin = 0;
+        while (us > 1 && bin < PROFILER_HISTOGRAM_BINS - 1)
+        {
+            us >>= 1;
+            bin++;
+        }
+        _histogram[bin]++;
+    }
+    _lastLoop = now;
+    _looped = true;
+}
+
+//Adds a latency measured by an interrupt.
+void Profiler::latency(uint32_t cycles)
+{
+    _latencyCount++;
+    _latencyTotal += cycles;
+    if (cycles > _latencyMax)
+    {
+        _latencyMax = cycles;
+    }
+}
+
+//Returns the statistics of a section.
+const ProfileStats &Profiler::getStats(unsigned char section)
+{
+    return _stats[section < PROFILER_SECTIONS ? section : 0];
+}
+
+//Formats line number line of the report into out, returns false after the last line. The lines are CSV:
+//  prof,<section>,<count>,<min>,<mean>,<max>         cycles per section
+//  prof,loop<first bin>,<count>,<count>,...          loop period histogram
+//  prof,latency,<count>,<mean>,<max>                 cycles from the anemometer edge to its ISR
+bool Profiler::report(unsigned char line, RecordFormatter &out)
+{
+    out.clear();
+    out.appendString("prof,");
+    if (line < _count)
+    {
+        const ProfileStats &stats = _stats[line];
+        out.appendString(_names[line]);
+        out.appendChar(',');
+        out.appendUInt(stats.count);
+        out.appendChar(',');
+        out.appendUInt(stats.count > 0 ? stats.min : 0);
+        out.appendChar(',');
+        out.appendUInt(stats.count > 0 ? (unsigned long) (stats.total / stats.count) : 0);
+        out.appendChar(',');
+        out.appendUInt(stats.max);
+        return true;
+    }
+    line -= _count;
+    if (line < PROFILER_HISTOGRAM_BINS / PROFILER_BINS_PER_LINE)
+    {
+        unsigned char first = line * PROFILER_BINS_PER_LINE;
+        out.appendString("loop");
+        out.appendUInt(first);
+        for (unsigned char i = first; i < first + PROFILER_BINS_PER_LINE; i++)
+        {
+            out.appendChar(',');
+            out.appendUInt(_histogram[i]);
+        }
+        return true;
+    }
+    line -= PROFILER_HISTOGRAM_BINS / PROFILER_BINS_PER_LINE;
+    if (line == 0)
+    {
+        noInterrupts();
+        unsigned long count = _latencyCount;
+        uint64_t total = _latencyTotal;
+        uint32_t maximum = _latencyMax;
+        interrupts();
+        out.appendString("latency,");
+        out.appendUInt(count);
+        out.appendChar(',');
+        out.appendUInt(count > 0 ? (unsigned long) (total / count) : 0);
+        out.appendChar(',');
+        out.appendUInt(maximum);
+        return true;
+    }
+    out.clear();
+    return false;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/**********************************************************
+** @file		RecordFormatter.cpp
+**
+** Heap-free record formatting, see RecordFormatter.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "RecordFormatter.h"
+
+// Powers of ten for the fixed-point emitter, the same precision limit as Arduino's print (max. 9 digits)
+static const unsigned long POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+
+RecordFormatter::RecordFormatter()
+{
+    clear();
+}
+
+//Empties the buffer for the next record.
+void RecordFormatter::clear()
+{
+    _length = 0;
+    _overflow = false;
+    _buffer[0] = '\0';
+}
+
+//Appends a single character.
+void RecordFormatter::appendChar(char c)
+{
+    if (_length >= RECORD_MAX_LENGTH)
+    {
+        _overflow = true;
+        return;
+    }
+    _buffer[_length++] = c;
+    _buffer[_length] = '\0';
+}
+
+//Appends a zero terminated string.
+void RecordFormatter::appendString(const char *s)
+{
+    while (*s != '\0')
+    {
+        appendChar(*s++);
+    }
+}
+
+//Appends a signed integer in decimal.
+void RecordFormatter::appendInt(long value)
+{
+    if (value < 0)
+    {
+        appendChar('-');
+        appendUInt(0UL - (unsigned long) value);
+    }
+    else
+    {
+        appendUInt((unsigned long) value);
+    }
+}
+
+//Appends an unsigned integer in decimal, at most 10 digits.
+void RecordFormatter::appendUInt(unsigned long value)
+{
+    char digits[10];
+    unsigned char n = 0;
+    do
+    {
+        digits[n++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (n > 0)
+    {
+        appendChar(digits[--n]);
+    }
+}
+
+//Appends a float with a fixed number of decimals (max. 8), rounded like String(double) does.
+void RecordFormatter::appendFixed(float value, unsigned char decimals)
+{
+    if (decimals > 8)
+    {
+        decimals = 8;
+    }
+    if (isnan(value))
+    {
+        appendString("nan");
+        return;
+    }
+    if (value < 0)
+    {
+        appendChar('-');
+        value = -value;
+    }
+    // Larger values would overflow the 32 bit integer part.
+    if (value > 4294967040.0f / POW10[decimals])
+    {
+        appendString("ovf");
+        return;
+    }
+
+    unsigned long scaled = (unsigned long) (value * POW10[decimals] + 0.5f);
+    appendUInt(scaled / POW10[decimals]);
+    if (decimals > 0)
+    {
+        unsigned long fraction = scaled % POW10[decimals];
+        appendChar('.');
+        for (unsigned char i = decimals; i > 0; i--)
+        {
+            appendChar((char) ('0' + (fraction / POW10[i - 1]) % 10));
+        }
+    }
+}
+
+//Returns the formatted record.
+const char *RecordFormatter::c_str()
+{
+    return _buffer;
+}
+
+//Returns the length of the record without the terminating zero.
+unsigned int RecordFormatter::length()
+{
+    return _length;
+}
+
+//Returns true if characters were dropped because the record was longer than RECORD_MAX_LENGTH.
+bool RecordFormatter::overflowed()
+{
+    return _overflow;
+}
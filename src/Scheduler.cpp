@@ -0,0 +1,203 @@
+/**********************************************************
+** @file		Scheduler.cpp
+**
+** Cooperative scheduler with a timer tick, see Scheduler.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "Platform.h"
+#include "Scheduler.h"
+
+#define TICK_RATE 1000
+
+// Milliseconds counted by the TC4 interrupt
+static volatile unsigned long _ticks = 0;
+
+
+Scheduler::Scheduler()
+{
+    _count = 0;
+    _idleSleep = false;
+    _woken = false;
+    _sleeps = 0;
+    _sleepTime = 0;
+}
+
+//Starts the tick timer. Deadlines of tasks added before are relative to this point.
+void Scheduler::begin()
+{
+#ifdef PLATFORM_SAMD21
+    // TC4 counts GCLK0 / 64 and wraps at CC0, one interrupt per millisecond.
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TC4_TC5;
+    while (GCLK->STATUS.bit.SYNCBUSY);
+    PM->APBCMASK.reg |= PM_APBCMASK_TC4;
+
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC4->COUNT16.CTRLA.bit.SWRST);
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV64;
+    TC4->COUNT16.CC[0].reg = F_CPU / 64 / TICK_RATE - 1;
+    while (TC4->COUNT16.STATUS.bit.SYNCBUSY);
+    TC4->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+    NVIC_SetPriority(TC4_IRQn, 2);
+    NVIC_EnableIRQ(TC4_IRQn);
+    TC4->COUNT16.CTRLA.bit.ENABLE = 1;
+    while (TC4->COUNT16.STATUS.bit.SYNCBUSY);
+#endif
+    unsigned long start = now();
+    for (unsigned char i = 0; i < _count; i++)
+    {
+        _tasks[i].timer.shift(start);
+    }
+}
+
+//Registers a task that runs every period ms, the first time offset ms after begin(). Returns the task id or -1 if
+//there is no room left.
+int Scheduler::addTask(const char *name, TaskFunction function, unsigned long period, unsigned long offset)
+{
+    if (_count >= SCHEDULER_MAX_TASKS || period == 0)
+    {
+        return -1;
+    }
+    Task &task = _tasks[_count];
+    task.name = name;
+    task.function = function;
+    task.timer = PeriodicTimer(period);
+    task.timer.start(0, offset);
+    task.runs = 0;
+    task.wakes = 0;
+    task.maxLate = 0;
+    return _count++;
+}
+
+//Runs every task that is due and sleeps if none was. Call this from loop() as often as possible.
+void Scheduler::run()
+{
+    bool woken = _woken;
+    bool ran = false;
+    _woken = false;
+    for (unsigned char i = 0; i < _count; i++)
+    {
+        Task &task = _tasks[i];
+        if (!task.timer.expired(now()))
+        {
+            continue;
+        }
+        if (task.timer.getLate() > task.maxLate)
+        {
+            task.maxLate = task.timer.getLate();
+        }
+        task.runs++;
+        if (woken)
+        {
+            task.wakes++;
+        }
+        ran = true;
+        task.function();
+    }
+    if (!ran && _idleSleep)
+    {
+        _sleep();
+    }
+}
+
+//Lets run() sleep until the next interrupt when no task is due.
+void Scheduler::setIdleSleep(bool enable)
+{
+#ifdef PLATFORM_SAMD21
+    _idleSleep = enable;
+    if (enable)
+    {
+        // IDLE0 stops only the CPU clock, the AHB and APB clocks of DMAC, ADC and timers keep running.
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        PM->SLEEP.reg = PM_SLEEP_IDLE_CPU;
+    }
+#else
+    (void) enable;
+#endif
+}
+
+//Returns the current tick in ms.
+unsigned long Scheduler::now()
+{
+#ifdef PLATFORM_SAMD21
+    return _ticks;
+#else
+    return millis();
+#endif
+}
+
+//Returns the number of registered tasks.
+unsigned char Scheduler::taskCount()
+{
+    return _count;
+}
+
+//Returns the statistics of a task.
+const Task &Scheduler::getTask(unsigned char id)
+{
+    return _tasks[id];
+}
+
+//Returns how often the CPU slept.
+unsigned long Scheduler::getSleeps()
+{
+    return _sleeps;
+}
+
+//Returns the time (us) the CPU slept, the share of the run time is roughly the saved CPU current.
+unsigned long Scheduler::getSleepTime()
+{
+    return _sleepTime;
+}
+
+//Returns true if a task is due.
+bool Scheduler::_due()
+{
+    unsigned long tick = now();
+    for (unsigned char i = 0; i < _count; i++)
+    {
+        if (timeReached(tick, _tasks[i].timer.getDeadline()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//Sleeps until the next interrupt. The interrupts are masked while checking for due tasks, a tick that happens after
+//the check is pending and ends the WFI right away instead of being missed.
+void Scheduler::_sleep()
+{
+#ifdef PLATFORM_SAMD21
+    unsigned long start = micros();
+    __disable_irq();
+    if (!_due())
+    {
+        __DSB();
+        __WFI();
+        _sleeps++;
+        _woken = true;
+    }
+    __enable_irq();
+    if (_woken)
+    {
+        _sleepTime += micros() - start;
+    }
+#endif
+}
+
+//Advances the time base, called from the timer interrupt.
+void Scheduler::tick()
+{
+    _ticks++;
+}
+
+#ifdef PLATFORM_SAMD21
+void TC4_Handler(void)
+{
+    TC4->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+    Scheduler::tick();
+}
+#endif
@@ -0,0 +1,52 @@
+/**********************************************************
+** @file		SdCard.cpp
+**
+** The SD-Card of the board, see SdCard.h
+**
+
+*/
+
+#include "SdCard.h"
+
+SdFat sd;
+
+volatile unsigned char SdCardLock::_users = 0;
+void (*volatile SdCardLock::_deferred)() = nullptr;
+
+SdCardLock::SdCardLock()
+{
+    _users++;
+}
+
+//Runs the task an interrupt deferred when the outermost lock ends. An interrupt in between leaves _users as it
+//found it, so the count needs no protection.
+SdCardLock::~SdCardLock()
+{
+    _users--;
+    if (_users == 0 && _deferred != nullptr)
+    {
+        void (*task)() = _deferred;
+        _deferred = nullptr;
+        task();
+    }
+}
+
+//Returns true while code on the card holds a lock.
+bool SdCardLock::locked()
+{
+    return _users > 0;
+}
+
+//Runs task now if the card is free, otherwise when the outermost lock ends. Call it from an interrupt, a task that
+//is still waiting is replaced.
+void SdCardLock::whenFree(void (*task)())
+{
+    if (_users > 0)
+    {
+        _deferred = task;
+    }
+    else
+    {
+        task();
+    }
+}
@@ -0,0 +1,260 @@
+/**********************************************************
+** @file		SdDmaWriter.cpp
+**
+** Sector writes through the DMAC and the SERCOM of the
+** SD-Card, see SdDmaWriter.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "Platform.h"
+#include "SdDmaWriter.h"
+#include "SdCard.h"
+#include "Deadline.h"
+
+#ifdef PLATFORM_SAMD21
+#include "DmaController.h"
+#endif
+
+// Tokens and data response of the SD SPI protocol
+#define SD_TOKEN_WRITE_MULTIPLE 0xFC
+#define SD_DATA_RESPONSE_MASK 0x1F
+#define SD_DATA_ACCEPTED 0x05
+
+
+SdDmaWriter::SdDmaWriter()
+{
+    _enabled = false;
+    _state = WRITER_IDLE;
+    _failed = false;
+    _sectors = 0;
+    _errors = 0;
+    _data = nullptr;
+    _since = 0;
+    _polls = 0;
+}
+
+//Claims the DMA channel on the SAMD21, other platforms hand the sectors to SdFat. Call it after sd.begin().
+bool SdDmaWriter::begin()
+{
+#ifdef PLATFORM_SAMD21
+    DmaController::begin();
+    // Completion is polled, so the transfer also finishes inside the brown-out interrupt.
+    DmaController::configure(DMA_CHANNEL_SD, SD_CARD_DMAC_ID_TX, nullptr);
+    DmacDescriptor *descriptor = DmaController::descriptor(DMA_CHANNEL_SD);
+    descriptor->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BLOCKACT_NOACT | DMAC_BTCTRL_BEATSIZE_BYTE |
+                             DMAC_BTCTRL_SRCINC;
+    descriptor->BTCNT.reg = SD_DMA_SECTOR_SIZE;
+    descriptor->DSTADDR.reg = (uint32_t) &SD_CARD_SERCOM->SPI.DATA.reg;
+    descriptor->DESCADDR.reg = 0;
+#endif
+    _enabled = true;
+    return true;
+}
+
+//Opens a multi block write at sector, ends a read or write SdFat left open first.
+bool SdDmaWriter::start(uint32_t sector)
+{
+    if (!_enabled || _state != WRITER_IDLE)
+    {
+        return false;
+    }
+    _failed = false;
+    if (!sd.card()->syncDevice() || !sd.card()->writeStart(sector))
+    {
+        _failed = true;
+        return false;
+    }
+    _state = WRITER_READY;
+    return true;
+}
+
+//Returns true when the card takes the next sector. Finishes a completed transfer and polls the busy card with one
+//byte, so it returns within a few microseconds. Fails the sector if the card doesn't confirm it in time.
+bool SdDmaWriter::ready()
+{
+    if (_state == WRITER_SENDING && !_sending())
+    {
+        if (!_finishTransfer())
+        {
+            return false;
+        }
+        _state = WRITER_BUSY;
+    }
+    if (_state == WRITER_BUSY && !_cardBusy())
+    {
+        _state = WRITER_READY;
+    }
+    if (_state != WRITER_READY && _state != WRITER_IDLE &&
+        (++_polls >= SD_DMA_TIMEOUT_POLLS || timeSince(millis(), _since) > SD_DMA_TIMEOUT))
+    {
+        _timeout();
+    }
+    return _state == WRITER_READY;
+}
+
+//Starts the transfer of one sector, data has to stay unchanged until ready() returns true again. Returns false if
+//the card isn't ready.
+bool SdDmaWriter::write(const uint8_t *data)
+{
+    if (!ready())
+    {
+        return false;
+    }
+    _since = millis();
+    _polls = 0;
+#ifdef PLATFORM_SAMD21
+    _transfer(SD_TOKEN_WRITE_MULTIPLE);
+    // The last beat was received before the token was, so the receiver starts empty.
+    DmacDescriptor *descriptor = DmaController::descriptor(DMA_CHANNEL_SD);
+    descriptor->SRCADDR.reg = (uint32_t) (data + SD_DMA_SECTOR_SIZE);
+    _state = WRITER_SENDING;
+    DmaController::enable(DMA_CHANNEL_SD);
+#else
+    // Sent by _finishTransfer() with the next ready()
+    _data = data;
+    _state = WRITER_SENDING;
+#endif
+    return true;
+}
+
+//Waits for the last sector and ends the multi block write, SdFat can use the card again. Returns false if a sector
+//was rejected.
+bool SdDmaWriter::stop()
+{
+    if (_state == WRITER_IDLE)
+    {
+        return !_failed;
+    }
+    while (_state != WRITER_IDLE && !ready())
+    {
+    }
+    if (_state != WRITER_IDLE)
+    {
+        _state = WRITER_IDLE;
+        if (!sd.card()->writeStop())
+        {
+            _failed = true;
+        }
+    }
+    return !_failed;
+}
+
+//Returns true between start() and stop().
+bool SdDmaWriter::active()
+{
+    return _state != WRITER_IDLE;
+}
+
+//Returns true if the card rejected a sector or the write couldn't be opened or closed.
+bool SdDmaWriter::failed()
+{
+    return _failed;
+}
+
+//Returns the number of sectors the card accepted.
+unsigned long SdDmaWriter::getSectors()
+{
+    return _sectors;
+}
+
+//Returns the number of sectors the card rejected or didn't confirm in time.
+unsigned long SdDmaWriter::getErrors()
+{
+    return _errors;
+}
+
+//Sends the CRC after the DMA transfer and reads the data response, other platforms send the whole sector here. A
+//rejected sector ends the multi block write with the stop token.
+bool SdDmaWriter::_finishTransfer()
+{
+#ifdef PLATFORM_SAMD21
+    // The DMAC is done when the last byte is in the shifter, wait until it is out and drop what was received.
+    unsigned int polls = 0;
+    while (!SD_CARD_SERCOM->SPI.INTFLAG.bit.TXC && ++polls < SD_DMA_SPI_POLLS)
+    {
+    }
+    while (SD_CARD_SERCOM->SPI.INTFLAG.bit.RXC)
+    {
+        (void) SD_CARD_SERCOM->SPI.DATA.reg;
+    }
+    SD_CARD_SERCOM->SPI.STATUS.reg = SERCOM_SPI_STATUS_BUFOVF;
+    _transfer(0xFF);
+    _transfer(0xFF);
+    // A lost byte reads as 0, which is no data response
+    bool accepted = polls < SD_DMA_SPI_POLLS && (_transfer(0xFF) & SD_DATA_RESPONSE_MASK) == SD_DATA_ACCEPTED;
+#else
+    // SdFat sends the token, the sector and the CRC and reads the data response, it doesn't wait for the programming.
+    bool accepted = sd.card()->writeData(_data);
+#endif
+    if (!accepted)
+    {
+        _errors++;
+        _failed = true;
+        _state = WRITER_IDLE;
+        sd.card()->writeStop();
+        return false;
+    }
+    _sectors++;
+    return true;
+}
+
+//Gives up on a sector the card didn't confirm in time. The stop token isn't sent, SdFat would wait for the card once
+//more, the next start() ends the write with its own timeout.
+void SdDmaWriter::_timeout()
+{
+#ifdef PLATFORM_SAMD21
+    DmaController::disable(DMA_CHANNEL_SD);
+#endif
+    _errors++;
+    _failed = true;
+    _state = WRITER_IDLE;
+}
+
+//Returns true while the DMAC still transfers the sector.
+bool SdDmaWriter::_sending()
+{
+#ifdef PLATFORM_SAMD21
+    return DmaController::busy(DMA_CHANNEL_SD);
+#else
+    return false;
+#endif
+}
+
+//Returns true while the card programs the last sector, polls it with one byte.
+bool SdDmaWriter::_cardBusy()
+{
+#ifdef PLATFORM_SAMD21
+    return _transfer(0xFF) != 0xFF;
+#else
+    return sd.card()->isBusy();
+#endif
+}
+
+//Sends one byte over the SPI bus of the card and returns the received one, 0 if the SERCOM doesn't move it.
+uint8_t SdDmaWriter::_transfer(uint8_t data)
+{
+#ifdef PLATFORM_SAMD21
+    unsigned int polls = 0;
+    while (!SD_CARD_SERCOM->SPI.INTFLAG.bit.DRE)
+    {
+        if (++polls >= SD_DMA_SPI_POLLS)
+        {
+            return 0;
+        }
+    }
+    SD_CARD_SERCOM->SPI.DATA.reg = data;
+    while (!SD_CARD_SERCOM->SPI.INTFLAG.bit.RXC)
+    {
+        if (++polls >= SD_DMA_SPI_POLLS)
+        {
+            return 0;
+        }
+    }
+    return (uint8_t) SD_CARD_SERCOM->SPI.DATA.reg;
+#else
+    (void) data;
+    return 0xFF;
+#endif
+}
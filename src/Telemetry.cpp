@@ -0,0 +1,128 @@
+/**********************************************************
+** @file		Telemetry.cpp
+**
+** COBS framed telemetry with a TX ring buffer, see
+** Telemetry.h
+**
+
+*/
+
+#include "Telemetry.h"
+#include "Crc16.h"
+
+Telemetry::Telemetry()
+{
+    _head = 0;
+    _tail = 0;
+    _sequence = 0;
+    _sent = 0;
+    _dropped = 0;
+}
+
+//Opens Serial, the baud rate only matters for a real UART.
+void Telemetry::begin(unsigned long baud)
+{
+    Serial.begin(baud);
+}
+
+//Queues one packet, returns false if it was dropped because the buffer is full or the port is closed.
+bool Telemetry::send(uint8_t type, const void *payload, unsigned int len)
+{
+    if (len > TELEMETRY_MAX_PAYLOAD)
+    {
+        return false;
+    }
+    uint8_t frame[sizeof(TelemetryHeader) + TELEMETRY_MAX_PAYLOAD + 2];
+    TelemetryHeader header;
+    header.type = type;
+    header.sequence = _sequence++;
+    header.time = millis();
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), payload, len);
+    unsigned int size = sizeof(header) + len;
+    uint16_t crc = crc16(frame, size);
+    frame[size++] = (uint8_t) crc;
+    frame[size++] = (uint8_t) (crc >> 8);
+
+    uint8_t encoded[TELEMETRY_MAX_FRAME];
+    unsigned int n = encode(frame, size, encoded);
+    if (!Serial.dtr() || _free() < n)
+    {
+        _dropped++;
+        return false;
+    }
+    for (unsigned int i = 0; i < n; i++)
+    {
+        _buffer[_head] = encoded[i];
+        _head = (_head + 1) % TELEMETRY_BUFFER_SIZE;
+    }
+    _sent++;
+    return true;
+}
+
+//Writes as much of the buffer as Serial takes without blocking. Call it often, from loop().
+void Telemetry::update()
+{
+    if (!Serial.dtr())
+    {
+        // Nobody listens, the queued frames would only be stale when the port opens.
+        _tail = _head;
+        return;
+    }
+    while (_tail != _head)
+    {
+        unsigned int pending = _head > _tail ? _head - _tail : TELEMETRY_BUFFER_SIZE - _tail;
+        int room = Serial.availableForWrite();
+        if (room <= 0)
+        {
+            return;
+        }
+        unsigned int n = pending < (unsigned int) room ? pending : (unsigned int) room;
+        n = Serial.write(&_buffer[_tail], n);
+        if (n == 0)
+        {
+            return;
+        }
+        _tail = (_tail + n) % TELEMETRY_BUFFER_SIZE;
+    }
+}
+
+//Returns the number of queued frames.
+unsigned long Telemetry::getSent()
+{
+    return _sent;
+}
+
+//Returns the number of frames that did not fit into the buffer.
+unsigned long Telemetry::getDropped()
+{
+    return _dropped;
+}
+
+//COBS encodes len bytes (at most 254) into out and appends the 0x00 delimiter, returns the length of the frame.
+unsigned int Telemetry::encode(const uint8_t *data, unsigned int len, uint8_t *out)
+{
+    unsigned int code = 0;      // Position of the current code byte
+    unsigned int n = 1;
+    for (unsigned int i = 0; i < len; i++)
+    {
+        if (data[i] == 0)
+        {
+            out[code] = (uint8_t) (n - code);
+            code = n++;
+        }
+        else
+        {
+            out[n++] = data[i];
+        }
+    }
+    out[code] = (uint8_t) (n - code);
+    out[n++] = 0;
+    return n;
+}
+
+//Returns the free space of the buffer, one byte is kept free to tell full from empty.
+unsigned int Telemetry::_free()
+{
+    return (_tail + TELEMETRY_BUFFER_SIZE - _head - 1) % TELEMETRY_BUFFER_SIZE;
+}
@@ -0,0 +1,164 @@
+/**********************************************************
+** @file		VoltageSensor.cpp
+**
+** Filtered turbine voltage measurement, see VoltageSensor.h.
+**
+
+*/
+
+#include "Arduino.h"
+#include "VoltageSensor.h"
+
+// Standard error of the median relative to the mean for normal distributed noise, sqrt(pi / 2)
+#define MEDIAN_EFFICIENCY 1.2533f
+
+
+VoltageSensor::VoltageSensor()
+{
+    _filter = VOLTAGE_FILTER_MEAN;
+    _count = 0;
+    _dropped = 0;
+    _value = 0;
+    _noise = 0;
+}
+
+//Sets how the samples are reduced to one value.
+void VoltageSensor::setFilter(VoltageFilter filter)
+{
+    _filter = filter;
+}
+
+//Returns the filter in use.
+VoltageFilter VoltageSensor::getFilter()
+{
+    return _filter;
+}
+
+//Collects one raw sample for the next measurement.
+void VoltageSensor::add(unsigned int raw)
+{
+    if (_count >= VOLTAGE_SENSOR_SAMPLES)
+    {
+        _dropped++;
+        return;
+    }
+    _sample[_count++] = raw;
+}
+
+//Returns the number of samples collected since the last measurement.
+unsigned int VoltageSensor::count()
+{
+    return _count;
+}
+
+//Filters the collected samples into a new value and noise estimate and starts collecting again. Returns false and
+//keeps the last value if there were no samples.
+bool VoltageSensor::measure()
+{
+    if (_count == 0)
+    {
+        return false;
+    }
+    float mean = _mean(0, _count);
+    float variance = 0;
+    for (unsigned int i = 0; i < _count; i++)
+    {
+        float d = _sample[i] - mean;
+        variance += d * d;
+    }
+    float error = _count > 1 ? sqrtf(variance / (_count - 1) / _count) : 0;
+
+    switch (_filter)
+    {
+    case VOLTAGE_FILTER_MEDIAN:
+        _value = _median();
+        _noise = error * MEDIAN_EFFICIENCY;
+        break;
+    case VOLTAGE_FILTER_RIPPLE:
+        //The spread still contains the ripple, so this overestimates the noise of the value.
+        _value = _ripple(mean);
+        _noise = error;
+        break;
+    default:
+        _value = mean;
+        _noise = error;
+        break;
+    }
+    _count = 0;
+    return true;
+}
+
+//Returns the filtered raw value of the last measurement.
+float VoltageSensor::getValue()
+{
+    return _value;
+}
+
+//Returns the estimated standard error of the value, in raw ADC counts.
+float VoltageSensor::getNoise()
+{
+    return _noise;
+}
+
+//Returns the number of samples that did not fit into a measurement.
+unsigned long VoltageSensor::getDropped()
+{
+    return _dropped;
+}
+
+//Mean of the samples from (inclusive) to (exclusive).
+float VoltageSensor::_mean(unsigned int from, unsigned int to)
+{
+    unsigned long sum = 0;
+    for (unsigned int i = from; i < to; i++)
+    {
+        sum += _sample[i];
+    }
+    return (float) sum / (to - from);
+}
+
+//Median of the samples, sorts a copy with insertion sort (few samples, mostly close together).
+float VoltageSensor::_median()
+{
+    uint16_t sorted[VOLTAGE_SENSOR_SAMPLES];
+    for (unsigned int i = 0; i < _count; i++)
+    {
+        uint16_t value = _sample[i];
+        unsigned int j = i;
+        while (j > 0 && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    if (_count % 2)
+    {
+        return sorted[_count / 2];
+    }
+    return (sorted[_count / 2 - 1] + sorted[_count / 2]) / 2.0f;
+}
+
+//Mean over the whole ripple periods between the first and the last rising crossing of the mean. Falls back to the
+//plain mean if less than one period was sampled.
+float VoltageSensor::_ripple(float mean)
+{
+    int first = -1;
+    int last = -1;
+    for (unsigned int i = 1; i < _count; i++)
+    {
+        if (_sample[i - 1] < mean && _sample[i] >= mean)
+        {
+            if (first < 0)
+            {
+                first = i;
+            }
+            last = i;
+        }
+    }
+    if (first < 0 || last == first)
+    {
+        return mean;
+    }
+    return _mean(first, last);
+}
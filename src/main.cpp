@@ -1,17 +1,38 @@
 #include <Arduino.h>
-#include <SD.h>
+#include <time.h>
+#include <SdCard.h>
 #include <RTCZero.h>
+#include <Platform.h>
 #include <ADSWeather.h>
-#include <cmath>
-#include <bitset>
+#include <DataLogger.h>
+#include <RecordFormatter.h>
+#include <LogFormat.h>
+#include <Scheduler.h>
+#include <AdcSampler.h>
+#include <LoadCascade.h>
+#include <Mppt.h>
+#include <LoadCache.h>
+#include <VoltageSensor.h>
+#include <CascadeSwitch.h>
+#include <Profiler.h>
+#include <Telemetry.h>
+#include <Aggregator.h>
+#include <Checkpoint.h>
+#include <PowerCurve.h>
 
 // Activate Serial Output over USB
 // #define DEBUGGING
+// Stream every MPPT step and wind calculation as binary frames over USB Serial (see TelemetryFormat.h), read them
+// with tools/telemetry.py. Text from DEBUGGING or the profiler in between is skipped by the tool.
+// #define TELEMETRY
+#define TELEMETRY_BAUD 1000000
+// The profiler of the tasks is switched on with the build flag -D PROFILING in platformio.ini (see Profiler.h)
 
 //Ax Pins for using the Wind Measurement, Digtal Pins for controlling the MOSFETS (via the Logic Level Shifter)
 #define ANEMOMETER_PIN A0
 #define VANE_PIN A1
 #define MEASUREMENT_PIN A2
+#define RAIN_PIN 5
 #define MOSFET1 0
 #define MOSFET2 1
 #define MOSFET3 2
@@ -21,29 +42,184 @@
 #define MOSFET7 8
 #define MOSFET8 9
 
+// Rain gauge connected to RAIN_PIN, the rain of every interval is logged, the CSV log also gets the rain of the last
+// hour and day once per hour
+#define RAIN_GAUGE
+// Count the anemometer pulses with the event system and TC3 instead of an interrupt per pulse. Only for contacts
+// without bounce (e.g. a hall sensor): the counter has no DEBOUNCE_TIME, reed bounce would raise speed and gusts.
+// #define ANEMOMETER_HW_COUNTER
+// Calculate low wind speeds from the time between the pulses (0.1 km/h resolution), counting is used at high speeds
+#define ANEMOMETER_PERIOD_MODE
+
+// Switch the MOSFETs that turn off before the ones that turn on, otherwise all change with one port write
+// #define MOSFET_BREAK_BEFORE_MAKE
+
+// Strategy of the MPPT: PerturbObserve, AdaptiveStep or IncrementalConductance (see Mppt.h)
+#define MPPT_STRATEGY PerturbObserve
+// Jump to a state estimated from the wind speed when it changes a lot
+// #define MPPT_WIND_GUESS
+// Learn the best State per wind speed and jump to it when the wind changes (see LoadCache.h)
+#define MPPT_LOAD_CACHE
+// File and interval (ms) the learned States are saved in
+#define LOAD_CACHE_FILE "loadcach.bin"
+#define LOAD_CACHE_SAVE_INTERVAL 600000
+// Keep State, load cache, aggregation, power curve and time in a flash snapshot and continue from it after a reset
+#define CHECKPOINT
+// Timeframe (ms) between two snapshots. Each erases one of 8 slots, so a flash row is erased every 4 hours and the
+// 25000 guaranteed cycles last more than 10 years.
+#define CHECKPOINT_INTERVAL 1800000
+// Layout of the snapshot, increase it when its content changes
+#define CHECKPOINT_LAYOUT 2
+
 // Possible Options depending where the Jumper is placed 1; .27; .132; .055
 #define VOLTAGE_DIVIDER 1
+// Reference voltage and highest reading of the ADC with 12 bit resolution
+#define ADC_REFERENCE 3.3f
+#define ADC_MAX 4095
+
+// Sleep between the tasks, the CPU wakes on the scheduler tick and the sensor interrupts
+#define LOW_POWER_IDLE
 
 // Timeframe (ms) for Wind-sensor calculation and writing to the SD-Card
 #define CALC_INTERVAL_SENSOR 1000
 // Timeframe (ms) for the Hill-Climbing Algorithm thus the change of resistance
 #define CALC_INTERVAL_RESISTOR 100
+// Average the vane samples as unit vectors (1 degree steps, steadiness) instead of the weighted 5 densest bins
+#define VANE_VECTOR_AVERAGING
+// Timeframe (ms) between two samples of the wind vane, 50 samples are averaged per wind calculation
+#define VANE_SAMPLE_INTERVAL 20
+// Sample vane and turbine voltage in the background (timer + DMA) instead of calling analogRead()
+#define ADC_BACKGROUND_SAMPLING
+// Sample pairs per second of the background sampling, every VANE_DECIMATION-th vane sample is used
+#define ADC_SAMPLE_RATE 250
+// Every background sample is the hardware average of 2^ADC_AVERAGING conversions (0..4)
+#define ADC_AVERAGING 4
+// Filter of the voltage samples per MPPT step: VOLTAGE_FILTER_MEAN, _MEDIAN or _RIPPLE (see VoltageSensor.h)
+#define VOLTAGE_FILTER VOLTAGE_FILTER_RIPPLE
+// analogRead() calls per MPPT step without background sampling
+#define VOLTAGE_OVERSAMPLING 16
+// Use the noise of the voltage measurement as deadband of the MPPT
+#define MPPT_NOISE_DEADBAND
+#define VANE_DECIMATION (ADC_SAMPLE_RATE * VANE_SAMPLE_INTERVAL / 1000)
+// Timeframe (ms) for checking the flush policy of the datalog, every check also moves the direct writes on by a sector
+#define LOG_CHECK_INTERVAL 20
+// Write the buffered log to the SD-Card after this many records or milliseconds, whatever comes first
+#define LOG_FLUSH_RECORDS 30
+#define LOG_FLUSH_INTERVAL 30000
+// Send the sectors of the log to the SD-Card by DMA and never wait for the card, a full buffer drops records instead
+// (see DataLogger.h). Needs a log file in one piece, a fragmented card falls back to SdFat.
+#define LOG_DIRECT_WRITES
+// Write packed binary records (see LogFormat.h) instead of CSV lines, convert them with tools/log2csv.cpp
+// #define LOG_BINARY
+#ifdef LOG_BINARY
+#define LOG_EXTENSION "bin"
+#else
+#define LOG_EXTENSION "txt"
+#endif
+// Every boot, every day and every LOG_FILE_SIZE bytes start a new log file YYMM/YYMMDDnn.txt (or .bin) with the
+// index YYMMDDnn.idx beside it, cut a time range out of it with tools/logslice.cpp. The size is allocated in one piece
+// when the file is created, a day is about 5.6 MB of CSV rows or 1.7 MB of binary records.
+#define LOG_FILE_SIZE 8388608UL
+#define LOG_FILES_PER_DAY 100
+// Name of the open log file, the file a reset left open is cut back to its index at the next boot
+#define LOG_CURRENT_FILE "curlog.txt"
+#define LOG_NAME_LENGTH 18
+// Write summaries of wind and power over these periods (s) into the CSV log, e.g. 1, 60, 600 (see Aggregator.h)
+#define LOG_AGGREGATE_TIERS 60, 600
+// Keep the row of every second besides the summaries, the binary log always has the rows and no summaries
+#define LOG_RAW_ROWS
+// Measure the power curve in 0.5 m/s bins and the harvested energy (see PowerCurve.h), write it into the CSV log
+#define POWER_CURVE
+#define POWER_CURVE_LOG_INTERVAL 3600000
+// Rated power (W) of the turbine for the capacity factor, set it to the nameplate value
+#define TURBINE_RATED_POWER 10.0f
+// Timeframe (ms) for checking Serial for a 'p', which prints the profile, and for writing it into the CSV log
+#define PROFILE_CHECK_INTERVAL 100
+#define PROFILE_LOG_INTERVAL 3600000
+
+#ifdef PROFILING
+// Sections of the profiler, in the order of PROFILE_NAMES
+enum {
+    PROFILE_VANE,
+    PROFILE_WIND,
+    PROFILE_MPPT,
+    PROFILE_RECORD,
+    PROFILE_SD,
+    PROFILE_CACHE,
+    PROFILE_CHECKPOINT,
+    PROFILE_SECTIONS
+};
+const char *const PROFILE_NAMES[PROFILE_SECTIONS] = {"vane", "wind", "mppt", "record", "sd", "cache", "checkpoint"};
+#endif
+
+// Runs the periodic tasks of the sketch from a timer tick
+Scheduler scheduler;
 
-// Variables for the Timeframe Calculations
-unsigned long nextCalcSensor;
-unsigned long nextCalcResistance;
-unsigned long timer;
+// Background ADC and the voltage samples collected since the last MPPT step
+AdcSampler adcSampler;
+VoltageSensor voltageSensor;
+float voltage_noise;
+unsigned int vane_decimation;
 
-// Variables for comparing and saving generated power
-double old_power;
-double new_power;
+// Last generated power
+float new_power;
 
 // Variable to map from a State to the current resistance and to determine which MOSFETs are on
-// rising_res_cycle to determine if the Hill-Climb is climbing or descending
+// mppt decides about the next State, it keeps track if the Hill-Climb is climbing or descending
 //  MOSFETPINS for correct Mapping to Outputs
 int state;
-bool rising_res_cycle;
+MPPT_STRATEGY mppt;
+// Best State per wind speed learned by the MPPT
+LoadCache loadCache;
 const char MOSFETPINS[8] = {MOSFET1, MOSFET2, MOSFET3, MOSFET4, MOSFET5, MOSFET6, MOSFET7, MOSFET8};
+// Writes the MOSFETs of a State through the port registers
+CascadeSwitch cascadeSwitch;
+
+// Buffered writer for the datalog, keeps the file open
+DataLogger dataLogger;
+bool sd_ready;
+// Day and number of the open log file
+int log_day;
+int log_number;
+// Static buffer the CSV line is formatted into, no String temporaries on the heap
+RecordFormatter record;
+
+#ifdef LOG_AGGREGATE_TIERS
+// Statistics of the tiers, fed every second and every MPPT step
+const unsigned int AGGREGATE_TIERS[] = {LOG_AGGREGATE_TIERS};
+Aggregator aggregator;
+#endif
+
+#ifdef POWER_CURVE
+// Power, State and energy per wind speed bin, fed every MPPT step
+PowerCurve powerCurve;
+#ifdef TELEMETRY
+// Bin of the power curve sent with the next wind calculation
+unsigned char power_curve_bin;
+#endif
+#endif
+
+#ifdef RAIN_GAUGE
+// Set by wind_calc_task() when an hour closed, sensor_log_task() logs its rain
+bool rain_hour_closed;
+#endif
+
+#ifdef CHECKPOINT
+// Snapshots in flash, the newest is restored in setup()
+Checkpoint checkpoint;
+
+// Start of the snapshot, the load cache, the running aggregation periods and the power curve follow
+struct __attribute__((packed)) StationCheckpoint {
+    uint32_t epoch;     // RTC at the time of the snapshot
+    uint8_t state;
+    uint8_t risingRes;  // Search direction of the MPPT
+};
+#endif
+
+#ifdef TELEMETRY
+// Non-blocking sender of the telemetry frames
+Telemetry telemetry;
+#endif
 
 // Time object for using the clock
 RTCZero rtc;
@@ -56,172 +232,799 @@ const byte day = 5;
 const byte month = 3;
 const byte year = 22;
 
-double calculate_power(double voltage, int state_i);
+float calculate_power(float voltage, int state_i);
 
-int count_up(int state_i);
+void switch_transistors(int state_i);
 
-int count_down(int state_i);
+float read_voltage();
 
-void switch_transistors(int state_i);
+int read_voltage_raw();
+
+void vane_sample_task();
+
+void wind_calc_task();
+
+void mppt_task();
+
+void sensor_log_task();
+
+void log_flush_task();
+
+void load_cache_save_task();
+
+void checkpoint_task();
+
+bool rtc_running();
+
+void checkpoint_restore(bool clock);
+
+void power_curve_log_task();
+
+void profile_serial_task();
+
+void profile_log_task();
+
+void mppt_wind_update(int windSpeedX10);
+
+void format_record(int windSpeedX10, int windGustX10, long windDirection, float power, int state_i, float voltage,
+                   float rain);
+
+void format_summary(const AggregateSummary &summary);
+
+bool log_open(bool boot);
+
+void log_file_name(char *name, int number, const char *extension);
+
+void format_log_stats();
+
+void format_rain();
+
+void format_power_curve(unsigned char bin, const PowerCurveBin &entry);
+
+void format_energy();
+
+void log_header();
+
+void log_binary(int windSpeedX10, int windGustX10, long windDirection, float power, int state_i, int voltageRaw,
+                unsigned int rainTips);
 
 // Initialize the Class for the Weather Station
+#ifdef RAIN_GAUGE
+ADSWeather adsWeather(RAIN_PIN, VANE_PIN, ANEMOMETER_PIN);
+#else
 ADSWeather adsWeather(VANE_PIN, ANEMOMETER_PIN);
+#endif
 
 void setup() {
     // Use a Higher Resolution for the ADCs (8 would be standard)
     analogReadResolution(12);
-    // Interrupt for Wind speed Measurement
-    attachInterrupt(digitalPinToInterrupt(ANEMOMETER_PIN), adsWeather.countAnemometer,
-                    FALLING); //.countAnemometer is the ISR for the anemometer.
+    adsWeather.setVaneResolution(12);
+#ifdef VANE_VECTOR_AVERAGING
+    adsWeather.setVaneAveraging(VANE_AVERAGING_VECTOR);
+#endif
+#ifdef ADC_BACKGROUND_SAMPLING
+    // Falls back to analogRead() if the pins can't be scanned by DMA.
+    adcSampler.begin(VANE_PIN, MEASUREMENT_PIN, ADC_SAMPLE_RATE, ADC_AVERAGING);
+#endif
+    voltageSensor.setFilter(VOLTAGE_FILTER);
+#ifdef RAIN_GAUGE
+    // Before the hardware counter, attachInterrupt() sets the clock of the EIC.
+    adsWeather.attachRainGauge(FALLING);
+#endif
+    // Hardware counter or Interrupt for Wind speed Measurement
+#ifdef ANEMOMETER_HW_COUNTER
+    if (!adsWeather.useHardwareCounter())
+#endif
+    {
+        adsWeather.attachAnemometer(FALLING); // Every station has its own ISR for the anemometer.
+    }
+#ifdef ANEMOMETER_PERIOD_MODE
+    adsWeather.setPeriodMode(true);
+#endif
     // Look if the SD-Card is reachable
-    if (!SD.begin(SDCARD_SS_PIN)) {
+    if (!sd.begin(SdSpiConfig(SDCARD_SS_PIN, DEDICATED_SPI, SD_SCK_MHZ(SD_CARD_SPI_MHZ)))) {
         pinMode(1, OUTPUT);
         digitalWrite(1, HIGH);
     } else {
-        if (SD.exists("datalog.txt")) {
-            File dataFile = SD.open("datalog.txt", FILE_WRITE);
-            dataFile.println("New Initialization");
-            dataFile.close();
-        }
+        sd_ready = true;
+#ifdef MPPT_LOAD_CACHE
+        loadCache.load(LOAD_CACHE_FILE);
+#endif
     }
     // Initialize Output Pins
-    pinMode(MOSFET1, OUTPUT);
-    pinMode(MOSFET2, OUTPUT);
-    pinMode(MOSFET3, OUTPUT);
-    pinMode(MOSFET4, OUTPUT);
-    pinMode(MOSFET5, OUTPUT);
-    pinMode(MOSFET6, OUTPUT);
-    pinMode(MOSFET7, OUTPUT);
-    pinMode(MOSFET8, OUTPUT);
+#ifdef MOSFET_BREAK_BEFORE_MAKE
+    cascadeSwitch.begin(MOSFETPINS, CASCADE_SWITCH_BREAK_BEFORE_MAKE);
+#else
+    cascadeSwitch.begin(MOSFETPINS, CASCADE_SWITCH_ATOMIC);
+#endif
     pinMode(MEASUREMENT_PIN, INPUT);
     // Starting value for the Hill Climb, (255 equals lowest possible resistance, thus we try to climb)
     state = 255;
-    rising_res_cycle = true;
-    // initialize RTC, set Time and Date
+    mppt.begin(state, true);
+    // initialize RTC, set Time and Date unless the clock kept running through the reset
+    bool clock_kept = rtc_running();
     rtc.begin();
-    rtc.setTime(hours, minutes, seconds);
-    rtc.setDate(day, month, year);
-    // Calculate the next time to write to the SD-Card and calculate Wind-Speed
-    nextCalcSensor = millis() + CALC_INTERVAL_SENSOR;
+    if (!clock_kept) {
+        rtc.setTime(hours, minutes, seconds);
+        rtc.setDate(day, month, year);
+    }
+    // Register the periodic tasks, earlier tasks have priority if several are due at the same time.
+    scheduler.addTask("vane", vane_sample_task, VANE_SAMPLE_INTERVAL);
+    scheduler.addTask("wind", wind_calc_task, CALC_INTERVAL_SENSOR, CALC_INTERVAL_SENSOR);
+    scheduler.addTask("mppt", mppt_task, CALC_INTERVAL_RESISTOR);
+    scheduler.addTask("log", sensor_log_task, CALC_INTERVAL_SENSOR, CALC_INTERVAL_SENSOR);
+    scheduler.addTask("flush", log_flush_task, LOG_CHECK_INTERVAL);
+#ifdef MPPT_LOAD_CACHE
+    scheduler.addTask("cache", load_cache_save_task, LOAD_CACHE_SAVE_INTERVAL, LOAD_CACHE_SAVE_INTERVAL);
+#endif
+#ifdef CHECKPOINT
+    scheduler.addTask("checkpoint", checkpoint_task, CHECKPOINT_INTERVAL, CHECKPOINT_INTERVAL);
+#endif
+#ifdef POWER_CURVE
+    scheduler.addTask("curve", power_curve_log_task, POWER_CURVE_LOG_INTERVAL, POWER_CURVE_LOG_INTERVAL);
+#endif
+#ifdef LOW_POWER_IDLE
+    scheduler.setIdleSleep(true);
+#endif
+    scheduler.begin();
+#ifdef LOG_AGGREGATE_TIERS
+    for (unsigned int tier : AGGREGATE_TIERS) {
+        aggregator.addTier(tier);
+    }
+#endif
+#ifdef CHECKPOINT
+    // Continue from the last snapshot, its time is only used if the clock was lost.
+    checkpoint_restore(!clock_kept);
+#else
+    (void) clock_kept;
+#endif
+    // The name of the log file comes from the clock, so it is opened once the time is known.
+#ifdef LOG_DIRECT_WRITES
+    dataLogger.setDirectWrites(true);
+#endif
+    if (sd_ready && log_open(true)) {
+        dataLogger.enableBrownoutFlush();
+    }
 
-#ifdef DEBUGGING
+#ifdef PROFILING
+    Profiler::begin(PROFILE_NAMES, PROFILE_SECTIONS);
+    scheduler.addTask("profile", profile_serial_task, PROFILE_CHECK_INTERVAL);
+    scheduler.addTask("proflog", profile_log_task, PROFILE_LOG_INTERVAL, PROFILE_LOG_INTERVAL);
+#endif
+
+#if defined(DEBUGGING) || defined(PROFILING)
     Serial.begin(9600);
 #endif
+#ifdef TELEMETRY
+    telemetry.begin(TELEMETRY_BAUD);
+#endif
 }
 
 void loop() {
-    timer = millis();
-
-    long windDirection;
-    long windSpeed;
-    int windGust;
-
-    String dataString = ""; // For Outputting
-
-    // Update Sensor Values, call as often as possible.
-    adsWeather.update();
-
-    if (timer > nextCalcResistance) {
-        // Calculate the next time to change the Resistor Cascade.
-        nextCalcResistance = timer + CALC_INTERVAL_RESISTOR;
-        // Calculate the current generated Power, with the current state and the new measured voltage.
-        double volt = analogRead(MEASUREMENT_PIN) * 3.3 / 4095;
-        new_power = calculate_power(volt, state);
-
-        // Hill-Climbing Decision, if the previous climb/fall was useful continue, else turn in the other direction.
-        if (new_power > old_power) {
-            if (rising_res_cycle) {
-                state = count_down(state);
-            } else {
-                state = count_up(state);
-            }
-        } else if (new_power < old_power) {
-            if (rising_res_cycle) {
-                state = count_up(state);
-            } else {
-                state = count_down(state);
-            }
-            rising_res_cycle = (!rising_res_cycle);
+    // Run whatever task is due, sleep until the next interrupt otherwise.
+    PROFILE_LOOP();
+#ifdef TELEMETRY
+    // Hand the queued frames to USB, never waits for the host.
+    telemetry.update();
+#endif
+    scheduler.run();
+}
+
+void vane_sample_task() {
+    /** Sample the wind vane at a fixed rate. With background sampling the completed DMA block is handed to the
+     * weather station and the voltage samples are collected for the next MPPT step. **/
+    PROFILE_SCOPE(PROFILE_VANE);
+    if (!adcSampler.running()) {
+        adsWeather.sampleVane();
+        return;
+    }
+    unsigned int vane[ADC_SAMPLER_BLOCK];
+    unsigned int voltage[ADC_SAMPLER_BLOCK];
+    unsigned int n = adcSampler.read(vane, voltage);
+    for (unsigned int i = 0; i < n; i++) {
+        if (++vane_decimation >= VANE_DECIMATION) {
+            vane_decimation = 0;
+            adsWeather.addVaneSample(vane[i]);
         }
+        voltageSensor.add(voltage[i]);
+    }
+}
 
-        // Switch the MOSFETs according to the previous made decision.
+void wind_calc_task() {
+    /** Calculate wind speed and direction from the pulses and vane samples of the last interval. **/
+    PROFILE_SCOPE(PROFILE_WIND);
+#ifdef RAIN_GAUGE
+    // Before calculate(), the tips of this interval count for the hour that just began
+    if (adsWeather.setRainClock(rtc.getHours(), rtc.getDay())) {
+        rain_hour_closed = true;
+    }
+#endif
+    adsWeather.calculate();
+    mppt_wind_update(adsWeather.getWindSpeedX10());
+#ifdef LOG_AGGREGATE_TIERS
+    long dirX, dirY;
+    unsigned int dirSamples;
+    adsWeather.getWindVector(dirX, dirY, dirSamples);
+    aggregator.addSecond(rtc.getEpoch(), adsWeather.getWindSpeedX10(), adsWeather.getWindGustX10(), dirX, dirY,
+                         dirSamples, adsWeather.getRainTips());
+#endif
+#ifdef TELEMETRY
+    TelemetryWind packet;
+    packet.windSpeed = (uint16_t) adsWeather.getWindSpeedX10();
+    packet.windGust = (uint16_t) adsWeather.getWindGustX10();
+    int direction = adsWeather.getWindDirection();
+    packet.windDirection = direction < 0 ? TELEMETRY_NO_DIRECTION : (uint16_t) direction;
+    packet.rain = (uint16_t) adsWeather.getRainTips();
+    packet.state = (uint8_t) state;
+    telemetry.send(TELEMETRY_WIND, &packet, sizeof(packet));
+#ifdef POWER_CURVE
+    // One bin per second, the whole curve in POWER_CURVE_BINS seconds
+    TelemetryPowerCurve curve;
+    PowerCurveBin entry;
+    for (unsigned char i = 0; i < POWER_CURVE_BINS; i++) {
+        unsigned char bin = power_curve_bin;
+        power_curve_bin = (power_curve_bin + 1) % POWER_CURVE_BINS;
+        if (powerCurve.getBin(bin, entry)) {
+            curve.bin = bin;
+            curve.count = entry.count;
+            curve.powerMean = entry.powerMean;
+            curve.powerMax = entry.powerMax;
+            curve.stateMean = entry.stateMean;
+            curve.energy = powerCurve.getEnergy();
+            curve.capacityFactor = powerCurve.getCapacityFactor(TURBINE_RATED_POWER);
+            telemetry.send(TELEMETRY_POWER_CURVE, &curve, sizeof(curve));
+            break;
+        }
+    }
+#endif
+#endif
+}
+
+void mppt_wind_update(int windSpeedX10) {
+    /** Start the search from the learned State when the wind moved to another speed bucket, without one from the
+     * estimate for the new wind speed. **/
+#ifdef MPPT_LOAD_CACHE
+    if (loadCache.enter(windSpeedX10)) {
+        int cached = loadCache.lookup(windSpeedX10);
+        if (cached >= 0 && cached != state) {
+            mppt.jumpTo(cached);
+            state = mppt.getState();
+            switch_transistors(state);
+            return;
+        }
+    }
+#endif
+#ifdef MPPT_WIND_GUESS
+    if (mppt.windUpdate(windSpeedX10)) {
+        state = mppt.getState();
         switch_transistors(state);
-        // Save the current power for the next decision in the next iteration.
-        old_power = new_power;
-    }
-
-    if (timer > nextCalcSensor) {
-        // Calc the next time to measure again
-        nextCalcSensor = timer + CALC_INTERVAL_SENSOR;
-
-        // Get the Windinfos
-        windSpeed = adsWeather.getWindSpeed();
-        windDirection = adsWeather.getWindDirection();
-        windGust = adsWeather.getWindGust();
-        // Calculate voltage.
-        double voltage = analogRead(MEASUREMENT_PIN) * 3.3 / 4095;
-        // Generate one string to be written to SD-Card
-        dataString +=
-                String(windSpeed) + "," + String(windGust) + "," + String(windDirection) + "," + new_power +
-                "," + String(state) + "," + voltage + "," + rtc.getMonth() + "/" + rtc.getDay() + "," + rtc.getHours() +
-                ":" + rtc.getMinutes() + ":" + rtc.getSeconds();
-        // Open the File and Write to it
-        File dataFile = SD.open("datalog.txt", FILE_WRITE);
-        if (dataFile) {
-            dataFile.println(dataString);
-            dataFile.close();
+    }
+#endif
+}
+
+void mppt_task() {
+    /** One step of the MPPT (Hill-Climbing Algorithm by default). **/
+    PROFILE_SCOPE(PROFILE_MPPT);
+    // Calculate the current generated Power, with the current state and the new measured voltage.
+    float volt = read_voltage();
+    new_power = calculate_power(volt, state);
+#ifdef LOG_AGGREGATE_TIERS
+    aggregator.addPower(new_power);
+#endif
+#ifdef MPPT_LOAD_CACHE
+    loadCache.update(adsWeather.getWindSpeedX10(), state, new_power);
+#endif
+#ifdef POWER_CURVE
+    powerCurve.add(adsWeather.getWindSpeedX10(), new_power, state, CALC_INTERVAL_RESISTOR);
+#endif
+
+    // Let the MPPT strategy decide about the next State, it needs the voltage across the cascade.
+#ifdef MPPT_NOISE_DEADBAND
+    mppt.setNoise(voltage_noise / (float) VOLTAGE_DIVIDER);
+#endif
+#ifdef TELEMETRY
+    int old_state = state;
+#endif
+    state = mppt.step(new_power, volt / (float) VOLTAGE_DIVIDER);
+
+    // Switch the MOSFETs according to the previous made decision.
+    switch_transistors(state);
+#ifdef TELEMETRY
+    TelemetryMppt packet;
+    packet.state = (uint8_t) state;
+    packet.step = (int8_t) constrain(state - old_state, -128, 127);
+    packet.voltage = volt / (float) VOLTAGE_DIVIDER;
+    packet.power = new_power;
+    packet.noise = voltage_noise / (float) VOLTAGE_DIVIDER;
+    telemetry.send(TELEMETRY_MPPT, &packet, sizeof(packet));
+#endif
+}
+
+void sensor_log_task() {
+    /** Write the wind information and the current operating point to the datalog. **/
+    PROFILE_SCOPE(PROFILE_RECORD);
+    // Get the Windinfos
+    int windSpeedX10 = adsWeather.getWindSpeedX10();
+    long windDirection = adsWeather.getWindDirection();
+    int windGustX10 = adsWeather.getWindGustX10();
+    // Calculate voltage.
+    int voltageRaw = read_voltage_raw();
+    float voltage = voltageRaw * ADC_REFERENCE / ADC_MAX;
+    // The log keeps the switched MOSFETs, independent of the order of the States (see LoadCascade.h)
+    int mosfets = LoadCascade::pattern(state);
+    // Tips of the rain gauge in the last interval, 0 without gauge
+    unsigned int rainTips = adsWeather.getRainTips();
+    // Continue in the next file after midnight or when this one is full
+    if (sd_ready && (rtc.getDay() != log_day || (dataLogger.full() && log_number < LOG_FILES_PER_DAY - 1))) {
+#ifndef LOG_BINARY
+        format_log_stats();
+        dataLogger.log(record.c_str());
+#endif
+        dataLogger.close();
+        log_open(false);
+    }
+    dataLogger.mark(rtc.getEpoch());
+#if !defined(LOG_BINARY) || defined(DEBUGGING)
+    // Generate one line to be written to SD-Card
+    format_record(windSpeedX10, windGustX10, windDirection, new_power, mosfets, voltage, rainTips * RAIN_MM_PER_TIP);
+#else
+    (void) voltage;
+#endif
+    // Buffer the record, it is written to the SD-Card by log_flush_task()
+#ifdef LOG_BINARY
+    log_binary(windSpeedX10, windGustX10, windDirection, new_power, mosfets, voltageRaw, rainTips);
+#elif defined(LOG_RAW_ROWS) || !defined(LOG_AGGREGATE_TIERS)
+    dataLogger.log(record.c_str());
+#endif
+
+#ifdef DEBUGGING
+    Serial.println(record.c_str());
+#endif
+
+#if defined(LOG_AGGREGATE_TIERS) && (!defined(LOG_BINARY) || defined(DEBUGGING))
+    // The summaries of the periods that ended with this second
+    AggregateSummary summary;
+    for (unsigned char tier = 0; tier < aggregator.tiers(); tier++) {
+        if (!aggregator.getSummary(tier, summary)) {
+            continue;
         }
+        format_summary(summary);
+#ifndef LOG_BINARY
+        dataLogger.log(record.c_str());
+#endif
+#ifdef DEBUGGING
+        Serial.println(record.c_str());
+#endif
+    }
+#endif
 
+#ifdef RAIN_GAUGE
+    // The rain of the hour that closed with this second
+    if (rain_hour_closed) {
+        rain_hour_closed = false;
+#if !defined(LOG_BINARY) || defined(DEBUGGING)
+        format_rain();
+#endif
+#ifndef LOG_BINARY
+        dataLogger.log(record.c_str());
+#endif
 #ifdef DEBUGGING
-        Serial.println(dataString);
+        Serial.println(record.c_str());
 #endif
     }
+#endif
+}
+
+void load_cache_save_task() {
+    /** Save the learned States, so they survive a restart. **/
+    PROFILE_SCOPE(PROFILE_CACHE);
+    if (sd_ready && loadCache.dirty()) {
+        // The brown-out flush waits until the file is saved.
+        SdCardLock lock;
+        // SdFat can't write another file while log sectors are on their way.
+        dataLogger.release();
+        loadCache.save(LOAD_CACHE_FILE);
+    }
+}
+
+bool rtc_running() {
+    /** True if the RTC kept counting through the reset, read before rtc.begin(). RTCZero keeps its time after a
+     * watchdog, reset pin or software reset, a power-on or brown-out reset starts the clock at zero. **/
+#ifdef PLATFORM_SAMD21
+    return RTC->MODE2.CTRL.bit.ENABLE && (PM->RCAUSE.reg & (PM_RCAUSE_SYST | PM_RCAUSE_WDT | PM_RCAUSE_EXT));
+#else
+    return false;
+#endif
+}
+
+#ifdef CHECKPOINT
+void checkpoint_task() {
+    /** Write the operating point, the load cache, the running aggregation periods and the power curve into the next
+     * flash slot. The CPU stalls while the flash is erased and written, about 100 ms. **/
+    PROFILE_SCOPE(PROFILE_CHECKPOINT);
+    StationCheckpoint station;
+    station.epoch = rtc.getEpoch();
+    station.state = (uint8_t) state;
+    station.risingRes = mppt.getRisingRes();
+    checkpoint.start();
+    bool ok = checkpoint.write(&station, sizeof(station));
+#ifdef MPPT_LOAD_CACHE
+    ok = ok && loadCache.save(checkpoint);
+#endif
+#ifdef LOG_AGGREGATE_TIERS
+    ok = ok && aggregator.save(checkpoint);
+#endif
+#ifdef POWER_CURVE
+    ok = ok && powerCurve.save(checkpoint);
+#endif
+    if (ok) {
+        checkpoint.finish();
+    }
+}
+
+void checkpoint_restore(bool clock) {
+    /** Continue from the newest snapshot: its State and search direction, the load cache (newer than the one on the
+     * SD-Card), the running aggregation periods and the power curve. With clock the RTC is set to the time of the
+     * snapshot, the duration of the outage is lost. **/
+    StationCheckpoint station;
+    if (!checkpoint.begin(CHECKPOINT_LAYOUT) || !checkpoint.read(&station, sizeof(station))) {
+        return;
+    }
+    if (clock) {
+        rtc.setEpoch(station.epoch);
+    }
+    state = station.state;
+    mppt.begin(state, station.risingRes != 0);
+    switch_transistors(state);
+#ifdef MPPT_LOAD_CACHE
+    loadCache.load(checkpoint);
+#endif
+#ifdef LOG_AGGREGATE_TIERS
+    aggregator.load(checkpoint);
+#endif
+#ifdef POWER_CURVE
+    powerCurve.load(checkpoint);
+#endif
+}
+#endif
 
+void log_flush_task() {
+    /** Write full sectors to the SD-Card once the flush policy says so. **/
+    PROFILE_SCOPE(PROFILE_SD);
+    dataLogger.update();
 }
 
-double calculate_power(double voltage, int state_i) {
-    /** Calculates the power corresponding to the given voltage with the resistance given by a State. Therefore first
-     * calculates the corresponding Resistance. (a MOSFET has a Resistance of arround 20mOhms if turned on). **/
-    double resistance = 0;
-    voltage = voltage / VOLTAGE_DIVIDER;
-    std::bitset<8> bin_x(state_i);
-    // If i is one the resistance of the MOSFET is taken else the resistance of the corresponding resistor given by 2^i.
-    for (int i = 0; i < 8; i++) {
-        if (bin_x[0] == 1) {
-            resistance += 0.02;
-        } else {
-            resistance += pow(2, i);
+#ifdef POWER_CURVE
+void power_curve_log_task() {
+    /** Write the power curve and the energy into the CSV log, the binary log has no place for it. **/
+#ifndef LOG_BINARY
+    PowerCurveBin entry;
+    for (unsigned char bin = 0; bin < POWER_CURVE_BINS; bin++) {
+        if (powerCurve.getBin(bin, entry)) {
+            format_power_curve(bin, entry);
+            dataLogger.log(record.c_str());
         }
-        bin_x >>= 1;
     }
-    return (pow(voltage, 2) / resistance);
+    format_energy();
+    dataLogger.log(record.c_str());
+#endif
 }
+#endif
 
-int count_up(int state_i) {
-    /** Increase the State state_i by one as long as it's less than 255. **/
-    if (state_i == 255) {
-        return 255;
+#ifdef PROFILING
+void profile_serial_task() {
+    /** Print the profile over Serial when a 'p' was received. **/
+    bool requested = false;
+    while (Serial.available() > 0) {
+        requested |= Serial.read() == 'p';
     }
-    return (state_i + 1);
+    if (!requested) {
+        return;
+    }
+    for (unsigned char line = 0; Profiler::report(line, record); line++) {
+        Serial.println(record.c_str());
+    }
+}
+
+void profile_log_task() {
+    /** Write the profile of the last PROFILE_LOG_INTERVAL into the CSV log and start over, the binary log has no
+     * place for it. **/
+#ifndef LOG_BINARY
+    for (unsigned char line = 0; Profiler::report(line, record); line++) {
+        dataLogger.log(record.c_str());
+    }
+#endif
+    Profiler::reset();
+}
+#endif
+
+float read_voltage() {
+    /** Returns the filtered voltage at the measurement pin from the background samples since the last call, without
+     * them from VOLTAGE_OVERSAMPLING readings. The standard error of the value is kept in voltage_noise. **/
+    if (voltageSensor.count() == 0 && !adcSampler.running()) {
+        for (int i = 0; i < VOLTAGE_OVERSAMPLING; i++) {
+            voltageSensor.add(analogRead(MEASUREMENT_PIN));
+        }
+    }
+    if (!voltageSensor.measure()) {
+        // No block arrived since the last step, use the last sample.
+        voltage_noise = 0;
+        return read_voltage_raw() * ADC_REFERENCE / ADC_MAX;
+    }
+    voltage_noise = voltageSensor.getNoise() * ADC_REFERENCE / ADC_MAX;
+    return voltageSensor.getValue() * ADC_REFERENCE / ADC_MAX;
 }
 
-int count_down(int state_i) {
-    /** Decrease the State state_i by one as long as it's greater than 0. **/
-    if (state_i == 0) {
-        return 0;
+int read_voltage_raw() {
+    /** Returns the latest raw reading of the measurement pin. **/
+    if (adcSampler.running()) {
+        return adcSampler.latestVoltage();
     }
-    return (state_i - 1);
+    return analogRead(MEASUREMENT_PIN);
+}
+
+float calculate_power(float voltage, int state_i) {
+    /** Calculates the power corresponding to the given voltage with the resistance given by a State. The conductance
+     * of every State is precomputed by LoadCascade (a MOSFET has a Resistance of arround 20mOhms if turned on). **/
+    voltage = voltage / (float) VOLTAGE_DIVIDER;
+    return LoadCascade::power(voltage, state_i);
 }
 
 void switch_transistors(int state_i) {
     /** Switch the MOSFETs according to the State state_i, for state_i = 0 all MOSFETs should be off thus biggest
-     * resistance possible, for state_i = 255 all should be on thus lowest resistance possible. **/
-    std::bitset<8> bin_x(state_i);
-    for (int i = 0; i < 8; i++) {
-        if (bin_x[i] == 1) {
-            digitalWrite(MOSFETPINS[i], HIGH);
-        } else {
-            digitalWrite(MOSFETPINS[i], LOW);
+     * resistance possible, for state_i = 255 all should be on thus lowest resistance possible (binary and sorted
+     * order). LoadCascade maps the State to the MOSFETs. **/
+    cascadeSwitch.write(LoadCascade::pattern(state_i));
+}
+
+void format_record(int windSpeedX10, int windGustX10, long windDirection, float power, int state_i, float voltage,
+                   float rain) {
+    /** Formats one CSV line into the static record buffer:
+     * speed,gust,direction,power,state,voltage,month/day,hours:minutes:seconds,rain
+     * Speed and gust are written with one decimal, power, voltage and rain (mm) with two, like String(double) did. **/
+    record.clear();
+    record.appendFixed(windSpeedX10 / 10.0f, 1);
+    record.appendChar(',');
+    record.appendFixed(windGustX10 / 10.0f, 1);
+    record.appendChar(',');
+    record.appendInt(windDirection);
+    record.appendChar(',');
+    record.appendFixed(power, 2);
+    record.appendChar(',');
+    record.appendInt(state_i);
+    record.appendChar(',');
+    record.appendFixed(voltage, 2);
+    record.appendChar(',');
+    record.appendUInt(rtc.getMonth());
+    record.appendChar('/');
+    record.appendUInt(rtc.getDay());
+    record.appendChar(',');
+    record.appendUInt(rtc.getHours());
+    record.appendChar(':');
+    record.appendUInt(rtc.getMinutes());
+    record.appendChar(':');
+    record.appendUInt(rtc.getSeconds());
+    record.appendChar(',');
+    record.appendFixed(rain, 2);
+}
+
+void format_summary(const AggregateSummary &summary) {
+    /** Formats the summary of a tier into the static record buffer:
+     * agg,period,month/day,hours:minutes:seconds,samples,speed,speed sd,gust,direction,steadiness,power,power sd,
+     * power max,energy,rain
+     * Speeds in km/h, power in W, energy in Wh and rain in mm, the direction is -1 without vane samples. The first
+     * column tells it apart from the rows of every second. The time is the end of the period, not the time the row
+     * is written, which differs for a period closed late or by a jump of the clock. **/
+    time_t end = (time_t) summary.epoch;
+    struct tm date;
+    gmtime_r(&end, &date);
+    record.clear();
+    record.appendString("agg,");
+    record.appendUInt(summary.period);
+    record.appendChar(',');
+    record.appendUInt(date.tm_mon + 1);
+    record.appendChar('/');
+    record.appendUInt(date.tm_mday);
+    record.appendChar(',');
+    record.appendUInt(date.tm_hour);
+    record.appendChar(':');
+    record.appendUInt(date.tm_min);
+    record.appendChar(':');
+    record.appendUInt(date.tm_sec);
+    record.appendChar(',');
+    record.appendUInt(summary.samples);
+    record.appendChar(',');
+    record.appendFixed(summary.speedMean, 2);
+    record.appendChar(',');
+    record.appendFixed(summary.speedStdDev, 2);
+    record.appendChar(',');
+    record.appendFixed(summary.gustMax, 1);
+    record.appendChar(',');
+    record.appendInt(summary.direction);
+    record.appendChar(',');
+    record.appendFixed(summary.steadiness, 3);
+    record.appendChar(',');
+    record.appendFixed(summary.powerMean, 3);
+    record.appendChar(',');
+    record.appendFixed(summary.powerStdDev, 3);
+    record.appendChar(',');
+    record.appendFixed(summary.powerMax, 3);
+    record.appendChar(',');
+    record.appendFixed(summary.energy, 4);
+    record.appendChar(',');
+    record.appendFixed(summary.rainTips * RAIN_MM_PER_TIP, 2);
+}
+
+bool log_open(bool boot) {
+    /** Opens the next log file of today, the first free number in the directory of the month, and its index. At boot
+     * a file that was left open by a reset is cut back to its index first and a CSV log notes the new
+     * initialization, a binary log has its header at the start of every file. The brown-out flush waits until the
+     * new file is complete. **/
+    SdCardLock lock;
+    char name[LOG_NAME_LENGTH];
+    char index[LOG_NAME_LENGTH];
+    bool existed = false;
+    if (boot) {
+        FsFile current = sd.open(LOG_CURRENT_FILE, FILE_READ);
+        if (current) {
+            int len = current.read(name, LOG_NAME_LENGTH - 1);
+            current.close();
+            if (len > 4) {
+                name[len] = '\0';
+                memcpy(index, name, len + 1);
+                memcpy(index + len - 3, "idx", 3);
+                DataLogger::recover(name, index);
+                existed = true;
+            }
+        }
+    }
+
+    log_file_name(name, -1, nullptr);
+    sd.mkdir(name);
+    log_day = rtc.getDay();
+    for (log_number = 0; log_number < LOG_FILES_PER_DAY - 1; log_number++) {
+        log_file_name(name, log_number, LOG_EXTENSION);
+        if (!sd.exists(name)) {
+            break;
         }
     }
+    log_file_name(name, log_number, LOG_EXTENSION);
+    log_file_name(index, log_number, "idx");
+    if (!dataLogger.begin(name, index, LOG_FILE_SIZE)) {
+        return false;
+    }
+    dataLogger.setFlushPolicy(LOG_FLUSH_RECORDS, LOG_FLUSH_INTERVAL);
+    sd.remove(LOG_CURRENT_FILE);
+    FsFile current = sd.open(LOG_CURRENT_FILE, FILE_WRITE);
+    if (current) {
+        current.write(name, strlen(name));
+        current.close();
+    }
+
+    dataLogger.mark(rtc.getEpoch());
+#ifdef LOG_BINARY
+    (void) existed;
+    log_header();
+    dataLogger.forceFlush();
+#else
+    if (existed) {
+        dataLogger.log("New Initialization");
+        dataLogger.forceFlush();
+    }
+#endif
+    return true;
+}
+
+void log_file_name(char *name, int number, const char *extension) {
+    /** Writes the path YYMM/YYMMDDnn.extension of today into name (LOG_NAME_LENGTH bytes), with a negative number
+     * only the directory YYMM. **/
+    const unsigned int digits[4] = {rtc.getYear(), rtc.getMonth(), rtc.getDay(), (unsigned int) number};
+    char *p = name;
+    for (int i = 0; i < 2; i++, p += 2) {
+        p[0] = (char) ('0' + digits[i] / 10 % 10);
+        p[1] = (char) ('0' + digits[i] % 10);
+    }
+    if (number >= 0) {
+        *p++ = '/';
+        for (int i = 0; i < 4; i++, p += 2) {
+            p[0] = (char) ('0' + digits[i] / 10 % 10);
+            p[1] = (char) ('0' + digits[i] % 10);
+        }
+        *p++ = '.';
+        memcpy(p, extension, 3);
+        p += 3;
+    }
+    *p = '\0';
+}
+
+void format_log_stats() {
+    /** Formats the statistics of the datalog since the boot into the static record buffer, the last line of every
+     * CSV log file: sd,direct,most sectors waiting,dropped records,overruns,rejected sectors **/
+    record.clear();
+    record.appendString("sd,");
+    record.appendUInt(dataLogger.direct() ? 1 : 0);
+    record.appendChar(',');
+    record.appendUInt(dataLogger.getQueueMax());
+    record.appendChar(',');
+    record.appendUInt(dataLogger.getDropped());
+    record.appendChar(',');
+    record.appendUInt(dataLogger.getOverruns());
+    record.appendChar(',');
+    record.appendUInt(dataLogger.getWriteErrors());
+}
+
+void format_rain() {
+    /** Formats the rain of the hour that just closed and of the previous day into the static record buffer:
+     * rain,month/day,hours,last hour,last day
+     * Rain in mm, hours is the hour that began. The previous day changes with the first row after midnight. **/
+    record.clear();
+    record.appendString("rain,");
+    record.appendUInt(rtc.getMonth());
+    record.appendChar('/');
+    record.appendUInt(rtc.getDay());
+    record.appendChar(',');
+    record.appendUInt(rtc.getHours());
+    record.appendChar(',');
+    record.appendFixed(adsWeather.getRainLastHour(), 2);
+    record.appendChar(',');
+    record.appendFixed(adsWeather.getRainLastDay(), 2);
+}
+
+#ifdef POWER_CURVE
+void format_power_curve(unsigned char bin, const PowerCurveBin &entry) {
+    /** Formats one bin of the power curve into the static record buffer:
+     * curve,wind speed (m/s),MPPT steps,mean power,max power,mean State **/
+    record.clear();
+    record.appendString("curve,");
+    record.appendFixed(PowerCurve::binSpeed(bin), 1);
+    record.appendChar(',');
+    record.appendUInt(entry.count);
+    record.appendChar(',');
+    record.appendFixed(entry.powerMean, 3);
+    record.appendChar(',');
+    record.appendFixed(entry.powerMax, 3);
+    record.appendChar(',');
+    record.appendFixed(entry.stateMean, 1);
+}
+
+void format_energy() {
+    /** Formats the energy since the start of the power curve into the static record buffer:
+     * energy,Wh,hours,capacity factor (share of TURBINE_RATED_POWER) **/
+    record.clear();
+    record.appendString("energy,");
+    record.appendFixed(powerCurve.getEnergy(), 3);
+    record.appendChar(',');
+    record.appendFixed(powerCurve.getHours(), 2);
+    record.appendChar(',');
+    record.appendFixed(powerCurve.getCapacityFactor(TURBINE_RATED_POWER), 4);
+}
+#endif
+
+void log_header() {
+    /** Writes the header of the binary log with the format version and the calibration of this build. **/
+    LogHeader header;
+    memcpy(header.magic, LOG_MAGIC, sizeof(header.magic));
+    header.version = LOG_VERSION;
+    header.recordSize = sizeof(LogRecord);
+    header.voltageDivider = VOLTAGE_DIVIDER;
+    header.adcReference = ADC_REFERENCE;
+    header.adcMax = ADC_MAX;
+    header.interval = CALC_INTERVAL_SENSOR;
+    header.rainPerTip = RAIN_MM_PER_TIP;
+    dataLogger.write(&header, sizeof(header));
+}
+
+void log_binary(int windSpeedX10, int windGustX10, long windDirection, float power, int state_i, int voltageRaw,
+                unsigned int rainTips) {
+    /** Packs one measurement into a LogRecord (19 bytes instead of about 65 for the CSV line). **/
+    LogRecord entry;
+    entry.epoch = rtc.getEpoch();
+    entry.windSpeed = (uint16_t) windSpeedX10;
+    entry.windGust = (uint16_t) windGustX10;
+    entry.windDirection = (uint16_t) windDirection;
+    entry.power = (uint32_t) (power * 1e6f + 0.5f);
+    entry.state = (uint8_t) state_i;
+    entry.voltage = (uint16_t) voltageRaw;
+    entry.rain = (uint16_t) rainTips;
+    dataLogger.write(&entry, sizeof(entry));
 }
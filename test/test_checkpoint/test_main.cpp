@@ -0,0 +1,214 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Checkpoint in the RAM area of the host: round trip, the
+** rotation through the slots, snapshots cut by a reset and
+** the limits of the data. A new Checkpoint object stands for
+** the sketch after a reset, the area keeps its content. Every
+** test uses its own layout, so it doesn't see the snapshots
+** of the others.
+**   pio test -e native -f test_checkpoint
+**
+
+*/
+
+#include <unity.h>
+#include <string.h>
+#include "Checkpoint.h"
+
+struct TestData
+{
+    uint32_t counter;
+    uint8_t fill[100];
+};
+
+static TestData makeData(uint32_t counter)
+{
+    TestData data;
+    data.counter = counter;
+    for (unsigned int i = 0; i < sizeof(data.fill); i++)
+    {
+        data.fill[i] = (uint8_t) (counter * 7 + i);
+    }
+    return data;
+}
+
+//Writes one snapshot with the given counter, returns the result of finish().
+static bool save(Checkpoint &checkpoint, uint32_t counter)
+{
+    TestData data = makeData(counter);
+    checkpoint.start();
+    return checkpoint.write(&data, sizeof(data)) && checkpoint.finish();
+}
+
+//Finds the newest snapshot after a reset and returns its counter, 0 if there is none.
+static uint32_t restore(uint16_t layout)
+{
+    Checkpoint checkpoint;
+    TestData data;
+    if (!checkpoint.begin(layout) || !checkpoint.read(&data, sizeof(data)))
+    {
+        return 0;
+    }
+    TestData expected = makeData(data.counter);
+    TEST_ASSERT_EQUAL_MEMORY(expected.fill, data.fill, sizeof(data.fill));
+    return data.counter;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_empty_area(void)
+{
+    Checkpoint checkpoint;
+    uint8_t byte;
+    TEST_ASSERT_FALSE(checkpoint.begin(100));
+    TEST_ASSERT_FALSE(checkpoint.read(&byte, 1));
+    TEST_ASSERT_EQUAL(0, checkpoint.getSequence());
+    TEST_ASSERT_FALSE(checkpoint.write(&byte, 1));
+    TEST_ASSERT_FALSE(checkpoint.finish());
+}
+
+void test_round_trip(void)
+{
+    Checkpoint checkpoint;
+    checkpoint.begin(101);
+    TEST_ASSERT_TRUE(save(checkpoint, 1));
+    TEST_ASSERT_EQUAL(1, checkpoint.getSequence());
+    TEST_ASSERT_EQUAL(1, checkpoint.getSaved());
+    TEST_ASSERT_EQUAL(1, restore(101));
+    // Other layouts don't take it
+    TEST_ASSERT_EQUAL(0, restore(102));
+}
+
+void test_pieces_read_in_order(void)
+{
+    Checkpoint checkpoint;
+    checkpoint.begin(103);
+    uint16_t a = 0x1234;
+    uint32_t b = 0xDEADBEEF;
+    uint8_t c[70];
+    memset(c, 0x5A, sizeof(c));
+    checkpoint.start();
+    TEST_ASSERT_TRUE(checkpoint.write(&a, sizeof(a)));
+    TEST_ASSERT_TRUE(checkpoint.write(&b, sizeof(b)));
+    TEST_ASSERT_TRUE(checkpoint.write(c, sizeof(c)));
+    TEST_ASSERT_TRUE(checkpoint.finish());
+
+    Checkpoint after;
+    uint16_t a2;
+    uint32_t b2;
+    uint8_t c2[70];
+    TEST_ASSERT_TRUE(after.begin(103));
+    TEST_ASSERT_TRUE(after.read(&a2, sizeof(a2)));
+    TEST_ASSERT_TRUE(after.read(&b2, sizeof(b2)));
+    TEST_ASSERT_TRUE(after.read(c2, sizeof(c2)));
+    TEST_ASSERT_EQUAL_HEX16(a, a2);
+    TEST_ASSERT_EQUAL_UINT32(b, b2);
+    TEST_ASSERT_EQUAL_MEMORY(c, c2, sizeof(c));
+    // Nothing more was written
+    TEST_ASSERT_FALSE(after.read(&a2, 1));
+}
+
+void test_slot_rotation(void)
+{
+    Checkpoint checkpoint;
+    checkpoint.begin(104);
+    for (uint32_t counter = 1; counter <= 3 * CHECKPOINT_SLOTS + 2; counter++)
+    {
+        TEST_ASSERT_TRUE(save(checkpoint, counter));
+        TEST_ASSERT_EQUAL(counter, checkpoint.getSequence());
+        TEST_ASSERT_EQUAL(counter, restore(104));
+    }
+    // The sketch continues after a reset with the sequence it had
+    Checkpoint after;
+    TEST_ASSERT_TRUE(after.begin(104));
+    TEST_ASSERT_EQUAL(3 * CHECKPOINT_SLOTS + 2, after.getSequence());
+    TEST_ASSERT_TRUE(save(after, 100));
+    TEST_ASSERT_EQUAL(3 * CHECKPOINT_SLOTS + 3, after.getSequence());
+    TEST_ASSERT_EQUAL(100, restore(104));
+}
+
+void test_torn_write(void)
+{
+    Checkpoint checkpoint;
+    checkpoint.begin(105);
+    for (uint32_t counter = 1; counter <= CHECKPOINT_SLOTS; counter++)
+    {
+        save(checkpoint, counter);
+    }
+    // Reset while the data is written: no trailer, the last complete snapshot stays the newest
+    TestData data = makeData(50);
+    checkpoint.start();
+    checkpoint.write(&data, sizeof(data));
+    TEST_ASSERT_EQUAL(CHECKPOINT_SLOTS, restore(105));
+
+    // Reset right after start(), which erased the oldest slot
+    Checkpoint after;
+    after.begin(105);
+    after.start();
+    TEST_ASSERT_EQUAL(CHECKPOINT_SLOTS, restore(105));
+
+    // The next snapshot reuses the slot and becomes the newest
+    Checkpoint again;
+    again.begin(105);
+    TEST_ASSERT_TRUE(save(again, 51));
+    TEST_ASSERT_EQUAL(51, restore(105));
+    TEST_ASSERT_EQUAL(CHECKPOINT_SLOTS + 1, again.getSequence());
+}
+
+void test_data_limit(void)
+{
+    static uint8_t data[CHECKPOINT_DATA_MAX];
+    for (unsigned int i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t) (i * 13);
+    }
+    Checkpoint checkpoint;
+    checkpoint.begin(106);
+    checkpoint.start();
+    TEST_ASSERT_TRUE(checkpoint.write(data, sizeof(data) - 1));
+    TEST_ASSERT_FALSE(checkpoint.write(data, 2));
+    TEST_ASSERT_TRUE(checkpoint.write(data, 1));
+    TEST_ASSERT_TRUE(checkpoint.finish());
+
+    Checkpoint after;
+    static uint8_t back[CHECKPOINT_DATA_MAX];
+    TEST_ASSERT_TRUE(after.begin(106));
+    TEST_ASSERT_TRUE(after.read(back, sizeof(back) - 1));
+    TEST_ASSERT_EQUAL_MEMORY(data, back, sizeof(back) - 1);
+    TEST_ASSERT_TRUE(after.read(back, 1));
+    TEST_ASSERT_EQUAL(data[0], back[0]);
+}
+
+void test_empty_snapshot(void)
+{
+    Checkpoint checkpoint;
+    checkpoint.begin(107);
+    checkpoint.start();
+    TEST_ASSERT_TRUE(checkpoint.finish());
+    Checkpoint after;
+    uint8_t byte;
+    TEST_ASSERT_TRUE(after.begin(107));
+    TEST_ASSERT_FALSE(after.read(&byte, 1));
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_area);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_pieces_read_in_order);
+    RUN_TEST(test_slot_rotation);
+    RUN_TEST(test_torn_write);
+    RUN_TEST(test_data_limit);
+    RUN_TEST(test_empty_snapshot);
+    return UNITY_END();
+}
@@ -0,0 +1,172 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Gust of ADSWeather: the rolling maximum over the gust
+** window against a plain maximum of the last speeds, with
+** falling, rising and random speeds and the full window,
+** and the lifetime maximum, which is the raw speed also in
+** WMO mode.
+**   pio test -e native -f test_gust
+**
+
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include "ADSWeather.h"
+#include "SimHal.h"
+
+#define TEST_VANE_PIN A1
+#define TEST_ANEMOMETER_PIN A0
+
+// Most anemometer pulses per interval, 15.4 ms apart, just above the debounce of the ISR. More falling speeds
+// than GUST_WINDOW_MAX.
+#define TEST_PULSES_MAX 64
+
+static ADSWeather *weather;
+static std::vector<int> speeds;
+
+void setUp(void)
+{
+    SimHal::reset();
+    weather = new ADSWeather(TEST_VANE_PIN, TEST_ANEMOMETER_PIN);
+    weather->attachAnemometer(FALLING);
+    speeds.clear();
+}
+
+void tearDown(void)
+{
+    delete weather;
+    weather = nullptr;
+}
+
+//One calculation interval of a second with the given number of anemometer pulses.
+static void interval(unsigned int pulses)
+{
+    unsigned long step = 1000000UL / (pulses + 1);
+    for (unsigned int i = 0; i < pulses; i++)
+    {
+        SimHal::advance(step);
+        SimHal::trigger(TEST_ANEMOMETER_PIN);
+    }
+    SimHal::advance(1000000UL - pulses * step);
+    weather->calculate();
+    speeds.push_back(weather->getWindSpeedX10());
+}
+
+//Highest of the last window speeds.
+static int expectedGust(unsigned int window)
+{
+    int gust = 0;
+    for (size_t i = speeds.size() > window ? speeds.size() - window : 0; i < speeds.size(); i++)
+    {
+        gust = speeds[i] > gust ? speeds[i] : gust;
+    }
+    return gust;
+}
+
+void test_speed_from_pulses(void)
+{
+    interval(10);
+    TEST_ASSERT_EQUAL(240, weather->getWindSpeedX10());
+    TEST_ASSERT_EQUAL(240, weather->getWindGustX10());
+}
+
+void test_falling_speeds_full_window(void)
+{
+    weather->setGustWindow(GUST_WINDOW_MAX);
+    // More falling intervals than the window has room for, every one is kept by the deque
+    for (unsigned int pulses = TEST_PULSES_MAX; pulses > 0; pulses--)
+    {
+        interval(pulses);
+        TEST_ASSERT_EQUAL(expectedGust(GUST_WINDOW_MAX), weather->getWindGustX10());
+    }
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        interval(TEST_PULSES_MAX - 1 - i);
+        TEST_ASSERT_EQUAL(expectedGust(GUST_WINDOW_MAX), weather->getWindGustX10());
+    }
+    for (unsigned int pulses = TEST_PULSES_MAX; pulses > 0; pulses--)
+    {
+        interval(pulses);
+        TEST_ASSERT_EQUAL(expectedGust(GUST_WINDOW_MAX), weather->getWindGustX10());
+    }
+}
+
+void test_rising_speeds(void)
+{
+    weather->setGustWindow(10);
+    for (unsigned int pulses = 0; pulses <= TEST_PULSES_MAX; pulses++)
+    {
+        interval(pulses);
+        TEST_ASSERT_EQUAL(24 * (int) pulses, weather->getWindGustX10());
+    }
+}
+
+void test_gust_leaves_window(void)
+{
+    weather->setGustWindow(3);
+    interval(20);
+    interval(5);
+    interval(5);
+    TEST_ASSERT_EQUAL(480, weather->getWindGustX10());
+    interval(5);
+    TEST_ASSERT_EQUAL(120, weather->getWindGustX10());
+    TEST_ASSERT_EQUAL(48, weather->getWindGustMax());
+}
+
+void test_wmo_max_is_raw_speed(void)
+{
+    weather->setGustWindow(10, true);
+    interval(30);
+    interval(0);
+    interval(0);
+    // The 3 s mean of the gust stays below the single fast second
+    TEST_ASSERT_EQUAL(240, weather->getWindGustX10());
+    TEST_ASSERT_EQUAL(72, weather->getWindGustMax());
+}
+
+void test_random_speeds(void)
+{
+    const unsigned int windows[] = {1, 2, 7, 30, GUST_WINDOW_MAX};
+    srand(7);
+    for (unsigned int window : windows)
+    {
+        weather->setGustWindow(window);
+        speeds.clear();
+        for (unsigned int i = 0; i < 500; i++)
+        {
+            interval(rand() % (TEST_PULSES_MAX + 1));
+            TEST_ASSERT_EQUAL(expectedGust(window), weather->getWindGustX10());
+        }
+    }
+}
+
+void test_window_is_limited(void)
+{
+    weather->setGustWindow(GUST_WINDOW_MAX + 20);
+    interval(30);
+    for (unsigned int i = 0; i < GUST_WINDOW_MAX - 1; i++)
+    {
+        interval(1);
+    }
+    TEST_ASSERT_EQUAL(720, weather->getWindGustX10());
+    interval(1);
+    TEST_ASSERT_EQUAL(24, weather->getWindGustX10());
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_speed_from_pulses);
+    RUN_TEST(test_falling_speeds_full_window);
+    RUN_TEST(test_rising_speeds);
+    RUN_TEST(test_gust_leaves_window);
+    RUN_TEST(test_wmo_max_is_raw_speed);
+    RUN_TEST(test_random_speeds);
+    RUN_TEST(test_window_is_limited);
+    return UNITY_END();
+}
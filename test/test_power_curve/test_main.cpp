@@ -0,0 +1,157 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** PowerCurve: the bin limits, the running means, energy and
+** capacity factor, and the round trip through a snapshot
+** together with the load cache and the aggregation, which
+** has to fit into one checkpoint slot.
+**   pio test -e native -f test_power_curve
+**
+
+*/
+
+#include <unity.h>
+#include "PowerCurve.h"
+#include "Checkpoint.h"
+#include "LoadCache.h"
+#include "Aggregator.h"
+
+#define TEST_LAYOUT 200
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_bin_limits(void)
+{
+    // Bin 2 holds 0.75 to 1.25 m/s, 2.7 to 4.5 km/h
+    TEST_ASSERT_EQUAL(1, PowerCurve::bin(26));
+    TEST_ASSERT_EQUAL(2, PowerCurve::bin(27));
+    TEST_ASSERT_EQUAL(2, PowerCurve::bin(44));
+    TEST_ASSERT_EQUAL(3, PowerCurve::bin(45));
+    TEST_ASSERT_EQUAL(0, PowerCurve::bin(0));
+    TEST_ASSERT_EQUAL(0, PowerCurve::bin(-5));
+    TEST_ASSERT_EQUAL(POWER_CURVE_BINS - 1, PowerCurve::bin(2000));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.0f, PowerCurve::binSpeed(2));
+}
+
+void test_bin_means(void)
+{
+    PowerCurve curve;
+    PowerCurveBin entry;
+    TEST_ASSERT_FALSE(curve.getBin(4, entry));
+    curve.add(72, 2.0f, 100, 100);
+    curve.add(72, 4.0f, 200, 100);
+    curve.add(72, 6.0f, 150, 100);
+    TEST_ASSERT_TRUE(curve.getBin(4, entry));
+    TEST_ASSERT_EQUAL(3, entry.count);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 4.0f, entry.powerMean);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 6.0f, entry.powerMax);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 150.0f, entry.stateMean);
+    TEST_ASSERT_FALSE(curve.getBin(5, entry));
+    TEST_ASSERT_FALSE(curve.getBin(POWER_CURVE_BINS, entry));
+}
+
+void test_energy_and_capacity_factor(void)
+{
+    PowerCurve curve;
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.0f, curve.getCapacityFactor(10.0f));
+    // One hour at 2.5 W in steps of 100 ms, and one hour without power
+    for (unsigned long step = 0; step < 36000; step++)
+    {
+        curve.add(90, 2.5f, 128, 100);
+        curve.add(10, -0.1f, 0, 100);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 2.5f, curve.getEnergy());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 2.0f, curve.getHours());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.125f, curve.getCapacityFactor(10.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.0f, curve.getCapacityFactor(0));
+}
+
+void test_snapshot_with_the_station(void)
+{
+    PowerCurve curve;
+    LoadCache cache;
+    Aggregator aggregator;
+    aggregator.addTier(60);
+    aggregator.addTier(600);
+    for (int speed = 0; speed < 400; speed += 7)
+    {
+        curve.add(speed, speed / 50.0f, speed % 256, 100);
+        cache.update(speed, speed % 256, speed / 50.0f);
+    }
+    for (unsigned long epoch = 1665700001UL; epoch < 1665700001UL + 90; epoch++)
+    {
+        aggregator.addPower(3.0f);
+        aggregator.addSecond(epoch, 120, 150, 1000, 0, 1, 0);
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.begin(TEST_LAYOUT);
+    checkpoint.start();
+    TEST_ASSERT_TRUE(cache.save(checkpoint));
+    TEST_ASSERT_TRUE(aggregator.save(checkpoint));
+    TEST_ASSERT_TRUE(curve.save(checkpoint));
+    TEST_ASSERT_TRUE(checkpoint.finish());
+
+    Checkpoint after;
+    PowerCurve restored;
+    LoadCache restoredCache;
+    Aggregator restoredAggregator;
+    restoredAggregator.addTier(60);
+    restoredAggregator.addTier(600);
+    TEST_ASSERT_TRUE(after.begin(TEST_LAYOUT));
+    TEST_ASSERT_TRUE(restoredCache.load(after));
+    TEST_ASSERT_TRUE(restoredAggregator.load(after));
+    TEST_ASSERT_TRUE(restored.load(after));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, curve.getEnergy(), restored.getEnergy());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, curve.getHours(), restored.getHours());
+    for (unsigned char bin = 0; bin < POWER_CURVE_BINS; bin++)
+    {
+        PowerCurveBin a;
+        PowerCurveBin b;
+        TEST_ASSERT_EQUAL(curve.getBin(bin, a), restored.getBin(bin, b));
+        if (curve.getBin(bin, a))
+        {
+            TEST_ASSERT_EQUAL_MEMORY(&a, &b, sizeof(a));
+        }
+    }
+    for (int speed = 0; speed < 400; speed += 7)
+    {
+        TEST_ASSERT_EQUAL(cache.lookup(speed), restoredCache.lookup(speed));
+    }
+    // The summary that was ready before the snapshot isn't reported again, the running period continues
+    AggregateSummary summary;
+    AggregateSummary restoredSummary;
+    TEST_ASSERT_TRUE(aggregator.getSummary(0, summary));
+    TEST_ASSERT_FALSE(restoredAggregator.getSummary(0, restoredSummary));
+    for (unsigned long epoch = 1665700001UL + 90; epoch < 1665700001UL + 180; epoch++)
+    {
+        aggregator.addPower(3.0f);
+        aggregator.addSecond(epoch, 120, 150, 1000, 0, 1, 0);
+        restoredAggregator.addPower(3.0f);
+        restoredAggregator.addSecond(epoch, 120, 150, 1000, 0, 1, 0);
+    }
+    TEST_ASSERT_TRUE(aggregator.getSummary(0, summary));
+    TEST_ASSERT_TRUE(restoredAggregator.getSummary(0, restoredSummary));
+    TEST_ASSERT_EQUAL(summary.epoch, restoredSummary.epoch);
+    TEST_ASSERT_EQUAL(summary.samples, restoredSummary.samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, summary.speedMean, restoredSummary.speedMean);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, summary.energy, restoredSummary.energy);
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_bin_limits);
+    RUN_TEST(test_bin_means);
+    RUN_TEST(test_energy_and_capacity_factor);
+    RUN_TEST(test_snapshot_with_the_station);
+    return UNITY_END();
+}
@@ -0,0 +1,91 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Rain gauge: the sums of the hour and the day, and the
+** hour the tips of the first interval of a new hour count
+** for, with setRainClock() before calculate() like the
+** sketch calls them.
+**   pio test -e native -f test_rain
+**
+
+*/
+
+#include <unity.h>
+#include "ADSWeather.h"
+#include "SimHal.h"
+
+#define TEST_RAIN_PIN 5
+#define TEST_VANE_PIN A1
+#define TEST_ANEMOMETER_PIN A0
+
+static ADSWeather *weather;
+
+void setUp(void)
+{
+    SimHal::reset();
+    SimHal::setMicros(1000000UL);
+    weather = new ADSWeather(TEST_RAIN_PIN, TEST_VANE_PIN, TEST_ANEMOMETER_PIN);
+    TEST_ASSERT_TRUE(weather->attachRainGauge(FALLING));
+}
+
+void tearDown(void)
+{
+    delete weather;
+    weather = nullptr;
+}
+
+//Tips the bucket count times within the next interval.
+static void tip(unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        SimHal::advance((RAIN_DEBOUNCE_TIME + 1) * 1000UL);
+        SimHal::trigger(TEST_RAIN_PIN);
+    }
+}
+
+//One calculation of the sketch at the given hour and day, returns true if an hour closed.
+static bool interval(unsigned char hour, unsigned char day)
+{
+    bool closed = weather->setRainClock(hour, day);
+    weather->calculate();
+    return closed;
+}
+
+void test_hour_rollover(void)
+{
+    TEST_ASSERT_FALSE(interval(10, 5));
+    tip(3);
+    TEST_ASSERT_FALSE(interval(10, 5));
+    TEST_ASSERT_EQUAL(3, weather->getRainTips());
+    // The tips before the first calculation of 11:00 count for 11:00
+    tip(2);
+    TEST_ASSERT_TRUE(interval(11, 5));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 3 * RAIN_MM_PER_TIP, weather->getRainLastHour());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 2 * RAIN_MM_PER_TIP, weather->getRainHour());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 5 * RAIN_MM_PER_TIP, weather->getRainDay());
+    TEST_ASSERT_FALSE(interval(11, 5));
+}
+
+void test_day_rollover(void)
+{
+    interval(23, 5);
+    tip(4);
+    interval(23, 5);
+    tip(1);
+    TEST_ASSERT_TRUE(interval(0, 6));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 4 * RAIN_MM_PER_TIP, weather->getRainLastDay());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 4 * RAIN_MM_PER_TIP, weather->getRainLastHour());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 1 * RAIN_MM_PER_TIP, weather->getRainDay());
+    TEST_ASSERT_EQUAL(5, weather->getRainTotalTips());
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_hour_rollover);
+    RUN_TEST(test_day_rollover);
+    return UNITY_END();
+}
@@ -0,0 +1,387 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Direct sector writes of the log against the card of
+** SimHal: SdDmaWriter with a busy card and a rejected
+** sector, a card that never gets ready, and the content of
+** the file DataLogger writes through it, with the fallback
+** to SdFat, a card too slow for the records, exFAT and the
+** index.
+**   pio test -e native -f test_sd_direct
+**
+
+*/
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "DataLogger.h"
+#include "LogFormat.h"
+#include "SdDmaWriter.h"
+#include "SimHal.h"
+
+#define TEST_LOG "test_sd.txt"
+#define TEST_INDEX "test_sd.idx"
+#define TEST_LOG_SIZE (64 * 1024UL)
+// Polls of a card that hangs, more than the timeout ever waits
+#define TEST_CARD_HANGS 0xFFFFFFFFU
+
+static std::string logged;
+
+void setUp(void)
+{
+    SimHal::reset();
+    sd.begin(SdSpiConfig(SDCARD_SS_PIN));
+    remove(TEST_LOG);
+    remove(TEST_INDEX);
+    logged.clear();
+}
+
+void tearDown(void)
+{
+    remove(TEST_LOG);
+    remove(TEST_INDEX);
+}
+
+static std::string readFile(const char *name)
+{
+    std::string content;
+    FILE *in = fopen(name, "rb");
+    if (in == nullptr)
+    {
+        return content;
+    }
+    int c;
+    while ((c = fgetc(in)) != EOF)
+    {
+        content += (char) c;
+    }
+    fclose(in);
+    return content;
+}
+
+static std::vector<LogIndexEntry> readIndex()
+{
+    std::vector<LogIndexEntry> index;
+    FILE *in = fopen(TEST_INDEX, "rb");
+    LogIndexEntry entry;
+    while (in != nullptr && fread(&entry, sizeof(entry), 1, in) == 1)
+    {
+        index.push_back(entry);
+    }
+    if (in != nullptr)
+    {
+        fclose(in);
+    }
+    return index;
+}
+
+//Logs records of random length for seconds of simulated time, update() every 20 ms like the sketch. Keeps what
+//was accepted in logged.
+static void logRecords(DataLogger &logger, unsigned int seconds, unsigned int perSecond)
+{
+    char line[80];
+    for (unsigned int s = 0; s < seconds; s++)
+    {
+        logger.mark(1665700000UL + s);
+        for (unsigned int r = 0; r < perSecond; r++)
+        {
+            int n = snprintf(line, sizeof(line), "%u,%u,%0*d", s, r, rand() % 40, 0);
+            if (logger.log(line))
+            {
+                logged += std::string(line, n) + "\r\n";
+            }
+        }
+        for (unsigned int tick = 0; tick < 50; tick++)
+        {
+            SimHal::advance(20000);
+            logger.update();
+        }
+    }
+}
+
+void test_writer_busy_card(void)
+{
+    uint8_t sector[SD_DMA_SECTOR_SIZE];
+    SimHal::setCardContiguous(true);
+    SimHal::setCardBusy(3);
+    FsFile file = sd.open(TEST_LOG, FILE_WRITE);
+    TEST_ASSERT_TRUE(file.preAllocate(4 * SD_DMA_SECTOR_SIZE));
+    uint32_t first;
+    uint32_t last;
+    TEST_ASSERT_TRUE(file.contiguousRange(&first, &last));
+    TEST_ASSERT_EQUAL(first + 3, last);
+
+    SdDmaWriter writer;
+    TEST_ASSERT_TRUE(writer.begin());
+    TEST_ASSERT_TRUE(writer.start(first));
+    TEST_ASSERT_TRUE(writer.active());
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        memset(sector, 'a' + i, sizeof(sector));
+        TEST_ASSERT_TRUE(writer.write(sector));
+        // The card is busy for three polls after the sector, the first one comes with the end of the transfer
+        unsigned int polls = 0;
+        while (!writer.ready())
+        {
+            polls++;
+        }
+        TEST_ASSERT_EQUAL(3, polls);
+    }
+    TEST_ASSERT_TRUE(writer.stop());
+    TEST_ASSERT_FALSE(writer.active());
+    TEST_ASSERT_EQUAL(4, writer.getSectors());
+    file.close();
+
+    std::string content = readFile(TEST_LOG);
+    TEST_ASSERT_EQUAL(4 * SD_DMA_SECTOR_SIZE, content.size());
+    TEST_ASSERT_EQUAL('a', content[0]);
+    TEST_ASSERT_EQUAL('d', content[3 * SD_DMA_SECTOR_SIZE + 100]);
+}
+
+void test_writer_rejected_sector(void)
+{
+    uint8_t sector[SD_DMA_SECTOR_SIZE];
+    memset(sector, 'x', sizeof(sector));
+    SimHal::setCardContiguous(true);
+    FsFile file = sd.open(TEST_LOG, FILE_WRITE);
+    TEST_ASSERT_TRUE(file.preAllocate(4 * SD_DMA_SECTOR_SIZE));
+    uint32_t first;
+    uint32_t last;
+    file.contiguousRange(&first, &last);
+
+    SdDmaWriter writer;
+    writer.begin();
+    SimHal::rejectCardWrite(1);
+    TEST_ASSERT_TRUE(writer.start(first));
+    TEST_ASSERT_TRUE(writer.write(sector));
+    TEST_ASSERT_TRUE(writer.ready());
+    TEST_ASSERT_TRUE(writer.write(sector));
+    TEST_ASSERT_FALSE(writer.ready());
+    TEST_ASSERT_TRUE(writer.failed());
+    TEST_ASSERT_FALSE(writer.active());
+    TEST_ASSERT_EQUAL(1, writer.getSectors());
+    TEST_ASSERT_EQUAL(1, writer.getErrors());
+    TEST_ASSERT_FALSE(writer.stop());
+    // The next write starts over
+    TEST_ASSERT_TRUE(writer.start(first + 1));
+    TEST_ASSERT_FALSE(writer.failed());
+    TEST_ASSERT_TRUE(writer.stop());
+    file.close();
+}
+
+void test_writer_card_hangs(void)
+{
+    uint8_t sector[SD_DMA_SECTOR_SIZE];
+    memset(sector, 'h', sizeof(sector));
+    SimHal::setCardContiguous(true);
+    FsFile file = sd.open(TEST_LOG, FILE_WRITE);
+    TEST_ASSERT_TRUE(file.preAllocate(4 * SD_DMA_SECTOR_SIZE));
+    uint32_t first;
+    uint32_t last;
+    file.contiguousRange(&first, &last);
+
+    SdDmaWriter writer;
+    writer.begin();
+    TEST_ASSERT_TRUE(writer.start(first));
+    TEST_ASSERT_TRUE(writer.write(sector));
+    SimHal::setCardBusy(TEST_CARD_HANGS);
+    // The clock stands still like inside an interrupt, the count of the polls ends the wait
+    unsigned long polls = 1;
+    while (!writer.ready() && !writer.failed())
+    {
+        polls++;
+    }
+    TEST_ASSERT_EQUAL(SD_DMA_TIMEOUT_POLLS, polls);
+    TEST_ASSERT_FALSE(writer.active());
+    TEST_ASSERT_EQUAL(1, writer.getErrors());
+    TEST_ASSERT_FALSE(writer.stop());
+
+    // With a running clock the time ends it
+    TEST_ASSERT_TRUE(writer.start(first + 1));
+    SimHal::setCardBusy(0);
+    TEST_ASSERT_TRUE(writer.write(sector));
+    SimHal::setCardBusy(TEST_CARD_HANGS);
+    TEST_ASSERT_FALSE(writer.ready());
+    TEST_ASSERT_TRUE(writer.active());
+    SimHal::advance((SD_DMA_TIMEOUT + 1) * 1000UL);
+    TEST_ASSERT_FALSE(writer.ready());
+    TEST_ASSERT_TRUE(writer.failed());
+    TEST_ASSERT_EQUAL(2, writer.getErrors());
+    file.close();
+}
+
+void test_logger_direct(void)
+{
+    srand(1);
+    SimHal::setCardContiguous(true);
+    SimHal::setCardBusy(2);
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    TEST_ASSERT_TRUE(logger.direct());
+    // The file is allocated in full until close()
+    TEST_ASSERT_EQUAL(TEST_LOG_SIZE, readFile(TEST_LOG).size());
+    logRecords(logger, 60, 5);
+    TEST_ASSERT_TRUE(logger.direct());
+    logger.close();
+
+    TEST_ASSERT_GREATER_THAN(0, SimHal::cardWrites());
+    TEST_ASSERT_EQUAL(0, logger.getDropped());
+    TEST_ASSERT_EQUAL(0, logger.getWriteErrors());
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+
+    std::vector<LogIndexEntry> index = readIndex();
+    TEST_ASSERT_GREATER_THAN(1, index.size());
+    for (size_t i = 1; i < index.size(); i++)
+    {
+        TEST_ASSERT_TRUE(index[i].offset > index[i - 1].offset);
+        TEST_ASSERT_TRUE(index[i].epoch >= index[i - 1].epoch);
+    }
+    TEST_ASSERT_EQUAL(logged.size(), index.back().offset);
+}
+
+void test_logger_falls_back_after_rejected_sector(void)
+{
+    srand(2);
+    SimHal::setCardContiguous(true);
+    SimHal::setCardBusy(1);
+    SimHal::rejectCardWrite(5);
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    logRecords(logger, 60, 5);
+    TEST_ASSERT_FALSE(logger.direct());
+    logger.close();
+
+    TEST_ASSERT_EQUAL(1, logger.getWriteErrors());
+    TEST_ASSERT_EQUAL(5, SimHal::cardWrites());
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+}
+
+void test_logger_falls_back_when_card_hangs(void)
+{
+    srand(6);
+    SimHal::setCardContiguous(true);
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    logRecords(logger, 10, 5);
+    SimHal::setCardBusy(TEST_CARD_HANGS);
+    logRecords(logger, 10, 5);
+    // forceFlush() waits for the card, also from the brown-out interrupt, and has to return
+    logger.forceFlush();
+    TEST_ASSERT_FALSE(logger.direct());
+    logger.close();
+
+    TEST_ASSERT_EQUAL(1, logger.getWriteErrors());
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+}
+
+void test_logger_drops_on_slow_card(void)
+{
+    srand(3);
+    SimHal::setCardContiguous(true);
+    // 240 ms per sector with the 20 ms updates, within the timeout but slower than the records come
+    SimHal::setCardBusy(12);
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    logRecords(logger, 30, 100);
+    logger.close();
+
+    TEST_ASSERT_GREATER_THAN(0, logger.getDropped());
+    TEST_ASSERT_EQUAL(0, logger.getWriteErrors());
+    TEST_ASSERT_EQUAL(LOG_BUFFER_SECTORS, logger.getQueueMax());
+    // Nothing that was accepted is lost
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+}
+
+void test_logger_without_contiguous_file(void)
+{
+    srand(4);
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    TEST_ASSERT_FALSE(logger.direct());
+    logRecords(logger, 20, 5);
+    logger.close();
+    TEST_ASSERT_EQUAL(0, SimHal::cardWrites());
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+}
+
+void test_logger_on_exfat(void)
+{
+    srand(7);
+    SimHal::setCardContiguous(true);
+    SimHal::setCardExFat(true);
+    // The raw sectors of an allocated file don't count on exFAT
+    uint8_t sector[SD_DMA_SECTOR_SIZE];
+    memset(sector, 'e', sizeof(sector));
+    FsFile file = sd.open(TEST_LOG, FILE_WRITE);
+    TEST_ASSERT_TRUE(file.preAllocate(4 * SD_DMA_SECTOR_SIZE));
+    uint32_t first;
+    uint32_t last;
+    TEST_ASSERT_TRUE(file.contiguousRange(&first, &last));
+    SdDmaWriter writer;
+    writer.begin();
+    TEST_ASSERT_TRUE(writer.start(first));
+    TEST_ASSERT_TRUE(writer.write(sector));
+    TEST_ASSERT_TRUE(writer.stop());
+    TEST_ASSERT_FALSE(file.truncate(SD_DMA_SECTOR_SIZE));
+    file.close();
+    TEST_ASSERT_EQUAL(0, readFile(TEST_LOG).size());
+    remove(TEST_LOG);
+
+    // So the logger leaves the file to SdFat
+    DataLogger logger;
+    logger.setDirectWrites(true);
+    TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+    TEST_ASSERT_FALSE(logger.direct());
+    unsigned long writes = SimHal::cardWrites();
+    logRecords(logger, 20, 5);
+    logger.close();
+    TEST_ASSERT_EQUAL(writes, SimHal::cardWrites());
+    TEST_ASSERT_TRUE(readFile(TEST_LOG) == logged);
+    TEST_ASSERT_EQUAL(logged.size(), readIndex().back().offset);
+}
+
+void test_recover_unclosed_file(void)
+{
+    srand(5);
+    SimHal::setCardContiguous(true);
+    {
+        DataLogger logger;
+        logger.setDirectWrites(true);
+        TEST_ASSERT_TRUE(logger.begin(TEST_LOG, TEST_INDEX, TEST_LOG_SIZE));
+        logRecords(logger, 20, 5);
+        logger.release();
+        // Reset without close(): the file still has the allocated size
+    }
+    TEST_ASSERT_EQUAL(TEST_LOG_SIZE, readFile(TEST_LOG).size());
+    TEST_ASSERT_TRUE(DataLogger::recover(TEST_LOG, TEST_INDEX));
+    std::string content = readFile(TEST_LOG);
+    std::vector<LogIndexEntry> index = readIndex();
+    TEST_ASSERT_EQUAL(index.back().offset, content.size());
+    TEST_ASSERT_TRUE(logged.compare(0, content.size(), content) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_writer_busy_card);
+    RUN_TEST(test_writer_rejected_sector);
+    RUN_TEST(test_writer_card_hangs);
+    RUN_TEST(test_logger_direct);
+    RUN_TEST(test_logger_falls_back_after_rejected_sector);
+    RUN_TEST(test_logger_falls_back_when_card_hangs);
+    RUN_TEST(test_logger_drops_on_slow_card);
+    RUN_TEST(test_logger_without_contiguous_file);
+    RUN_TEST(test_logger_on_exfat);
+    RUN_TEST(test_recover_unclosed_file);
+    return UNITY_END();
+}
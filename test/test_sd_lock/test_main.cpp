@@ -0,0 +1,80 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** SdCardLock: the work of an interrupt that needs the card
+** runs at once while it is free and at the end of the
+** outermost lock otherwise, exactly once.
+**   pio test -e native -f test_sd_lock
+**
+
+*/
+
+#include <unity.h>
+#include "SdCard.h"
+
+static unsigned int runs;
+static bool lockedWhileRunning;
+
+static void task()
+{
+    runs++;
+    lockedWhileRunning = SdCardLock::locked();
+}
+
+void setUp(void)
+{
+    runs = 0;
+    lockedWhileRunning = false;
+}
+
+void tearDown(void)
+{
+}
+
+void test_free_card_runs_at_once(void)
+{
+    TEST_ASSERT_FALSE(SdCardLock::locked());
+    SdCardLock::whenFree(task);
+    TEST_ASSERT_EQUAL(1, runs);
+}
+
+void test_deferred_to_outermost_lock(void)
+{
+    {
+        SdCardLock outer;
+        {
+            SdCardLock inner;
+            SdCardLock::whenFree(task);
+            TEST_ASSERT_TRUE(SdCardLock::locked());
+        }
+        // The inner lock ended, the card is still in use
+        TEST_ASSERT_EQUAL(0, runs);
+    }
+    TEST_ASSERT_EQUAL(1, runs);
+    TEST_ASSERT_FALSE(lockedWhileRunning);
+    TEST_ASSERT_FALSE(SdCardLock::locked());
+}
+
+void test_deferred_runs_once(void)
+{
+    {
+        SdCardLock lock;
+        SdCardLock::whenFree(task);
+        SdCardLock::whenFree(task);
+    }
+    {
+        SdCardLock lock;
+    }
+    TEST_ASSERT_EQUAL(1, runs);
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_free_card_runs_at_once);
+    RUN_TEST(test_deferred_to_outermost_lock);
+    RUN_TEST(test_deferred_runs_once);
+    return UNITY_END();
+}
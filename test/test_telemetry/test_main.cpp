@@ -0,0 +1,172 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Telemetry frames: COBS encoding against a decoder like the
+** one of tools/telemetry.py, the CRC16 check value and its
+** chaining, and the drops of a full TX buffer.
+**   pio test -e native -f test_telemetry
+**
+
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Crc16.h"
+#include "Telemetry.h"
+#include "SimHal.h"
+
+void setUp(void)
+{
+    SimHal::reset();
+}
+
+void tearDown(void)
+{
+}
+
+//Decodes one COBS frame up to its delimiter, returns the length of the data or -1 if the frame is broken.
+static int decode(const uint8_t *frame, unsigned int len, uint8_t *out)
+{
+    unsigned int i = 0;
+    int n = 0;
+    while (i < len && frame[i] != 0)
+    {
+        uint8_t code = frame[i++];
+        for (uint8_t j = 1; j < code; j++)
+        {
+            if (i >= len || frame[i] == 0)
+            {
+                return -1;
+            }
+            out[n++] = frame[i++];
+        }
+        if (code < 0xFF && i < len && frame[i] != 0)
+        {
+            out[n++] = 0;
+        }
+    }
+    return i == len - 1 ? n : -1;
+}
+
+//Encodes and decodes data, the frame has no zero before its delimiter.
+static void roundTrip(const uint8_t *data, unsigned int len)
+{
+    uint8_t frame[300];
+    uint8_t decoded[300];
+    unsigned int n = Telemetry::encode(data, len, frame);
+    TEST_ASSERT_EQUAL(len + 2, n);
+    TEST_ASSERT_EQUAL(0, frame[n - 1]);
+    for (unsigned int i = 0; i < n - 1; i++)
+    {
+        TEST_ASSERT_TRUE(frame[i] != 0);
+    }
+    TEST_ASSERT_EQUAL((int) len, decode(frame, n, decoded));
+    TEST_ASSERT_EQUAL_MEMORY(data, decoded, len);
+}
+
+void test_cobs_examples(void)
+{
+    const uint8_t zero[] = {0x00};
+    const uint8_t zeros[] = {0x00, 0x00};
+    const uint8_t mixed[] = {0x11, 0x22, 0x00, 0x33};
+    uint8_t frame[8];
+    TEST_ASSERT_EQUAL(3, Telemetry::encode(zero, sizeof(zero), frame));
+    TEST_ASSERT_EQUAL_MEMORY("\x01\x01\x00", frame, 3);
+    TEST_ASSERT_EQUAL(4, Telemetry::encode(zeros, sizeof(zeros), frame));
+    TEST_ASSERT_EQUAL_MEMORY("\x01\x01\x01\x00", frame, 4);
+    TEST_ASSERT_EQUAL(6, Telemetry::encode(mixed, sizeof(mixed), frame));
+    TEST_ASSERT_EQUAL_MEMORY("\x03\x11\x22\x02\x33\x00", frame, 6);
+    TEST_ASSERT_EQUAL(2, Telemetry::encode(nullptr, 0, frame));
+    TEST_ASSERT_EQUAL_MEMORY("\x01\x00", frame, 2);
+}
+
+void test_cobs_round_trip(void)
+{
+    uint8_t data[254];
+    srand(3);
+    for (unsigned int len = 0; len <= sizeof(data); len++)
+    {
+        for (unsigned int i = 0; i < len; i++)
+        {
+            // Many zeros, and runs without any
+            data[i] = rand() % 4 == 0 ? 0 : (uint8_t) (1 + rand() % 255);
+        }
+        roundTrip(data, len);
+        memset(data, 0, len);
+        roundTrip(data, len);
+        memset(data, 0xFF, len);
+        roundTrip(data, len);
+    }
+}
+
+void test_crc16(void)
+{
+    const char *check = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(check, 9));
+    TEST_ASSERT_EQUAL_HEX16(CRC16_START, crc16(check, 0));
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16(check + 4, 5, crc16(check, 4)));
+}
+
+void test_frame_round_trip(void)
+{
+    // The frame of send(): header, payload and the CRC of both, low byte first
+    TelemetryWind wind = {123, 456, 270, 2, 200};
+    TelemetryHeader header = {TELEMETRY_WIND, 7, 123456};
+    uint8_t data[sizeof(header) + sizeof(wind) + 2];
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), &wind, sizeof(wind));
+    uint16_t crc = crc16(data, sizeof(header) + sizeof(wind));
+    data[sizeof(data) - 2] = (uint8_t) crc;
+    data[sizeof(data) - 1] = (uint8_t) (crc >> 8);
+
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    uint8_t decoded[TELEMETRY_MAX_FRAME];
+    unsigned int n = Telemetry::encode(data, sizeof(data), frame);
+    TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_MAX_FRAME, n);
+    int len = decode(frame, n, decoded);
+    TEST_ASSERT_EQUAL((int) sizeof(data), len);
+    TEST_ASSERT_EQUAL_HEX16(crc, decoded[len - 2] | (decoded[len - 1] << 8));
+    TEST_ASSERT_EQUAL_HEX16(crc, crc16(decoded, len - 2));
+    TelemetryWind back;
+    memcpy(&back, decoded + sizeof(header), sizeof(back));
+    TEST_ASSERT_EQUAL(456, back.windGust);
+    TEST_ASSERT_EQUAL(270, back.windDirection);
+}
+
+void test_full_buffer_drops(void)
+{
+    Telemetry telemetry;
+    TelemetryMppt mppt = {128, 1, 12.5f, 3.2f, 0.01f};
+    unsigned int frames = 0;
+    while (telemetry.send(TELEMETRY_MPPT, &mppt, sizeof(mppt)))
+    {
+        frames++;
+    }
+    TEST_ASSERT_GREATER_THAN(0, frames);
+    TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_BUFFER_SIZE / (sizeof(TelemetryHeader) + sizeof(mppt) + 4), frames);
+    TEST_ASSERT_EQUAL(frames, telemetry.getSent());
+    TEST_ASSERT_EQUAL(1, telemetry.getDropped());
+    TEST_ASSERT_FALSE(telemetry.send(TELEMETRY_MPPT, &mppt, TELEMETRY_MAX_PAYLOAD + 1));
+
+    // The host takes the queued frames, there is room again
+    while (telemetry.getSent() == frames)
+    {
+        telemetry.update();
+        telemetry.send(TELEMETRY_MPPT, &mppt, sizeof(mppt));
+    }
+    TEST_ASSERT_EQUAL(frames + 1, telemetry.getSent());
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_cobs_examples);
+    RUN_TEST(test_cobs_round_trip);
+    RUN_TEST(test_crc16);
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_full_buffer_drops);
+    return UNITY_END();
+}
@@ -0,0 +1,92 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** TraceReader: the lines of a datalog.txt with and without
+** the rain column, and the lines that have to be skipped.
+**   pio test -e native -f test_trace
+**
+
+*/
+
+#include <unity.h>
+#include "TraceReader.h"
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_parse_with_rain(void)
+{
+    TraceRecord record;
+    TEST_ASSERT_TRUE(TraceReader::parse("12.1,15.1,90,0.09,128,3.37,3/5,0:0:0,0.28", record));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.1f, record.windSpeed);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 15.1f, record.windGust);
+    TEST_ASSERT_EQUAL(90, record.windDirection);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.09f, record.power);
+    TEST_ASSERT_EQUAL(128, record.pattern);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 3.37f, record.voltage);
+    TEST_ASSERT_EQUAL(3, record.month);
+    TEST_ASSERT_EQUAL(5, record.day);
+    TEST_ASSERT_EQUAL(0, record.hours);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.28f, record.rain);
+}
+
+void test_parse_without_rain(void)
+{
+    TraceRecord record;
+    TEST_ASSERT_TRUE(TraceReader::parse("13.4,16.4,91,0.11,255,3.72,10/14,23:59:58", record));
+    TEST_ASSERT_EQUAL(255, record.pattern);
+    TEST_ASSERT_EQUAL(10, record.month);
+    TEST_ASSERT_EQUAL(14, record.day);
+    TEST_ASSERT_EQUAL(23, record.hours);
+    TEST_ASSERT_EQUAL(59, record.minutes);
+    TEST_ASSERT_EQUAL(58, record.seconds);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, record.rain);
+}
+
+void test_skip_other_lines(void)
+{
+    TraceRecord record;
+    TEST_ASSERT_FALSE(TraceReader::parse("New Initialization", record));
+    TEST_ASSERT_FALSE(TraceReader::parse("", record));
+    TEST_ASSERT_FALSE(TraceReader::parse("12.1,15.1,90", record));
+}
+
+void test_read_file(void)
+{
+    const char *name = "test_trace.txt";
+    FILE *out = fopen(name, "w");
+    TEST_ASSERT_NOT_NULL(out);
+    fputs("New Initialization\n12.1,15.1,90,0.09,128,3.37,3/5,0:0:0,0.28\n"
+          "13.4,16.4,91,0.11,128,3.72,3/5,0:0:1,0.00\n", out);
+    fclose(out);
+
+    TraceReader reader;
+    TraceRecord record;
+    TEST_ASSERT_TRUE(reader.open(name));
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_EQUAL(0, record.seconds);
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_EQUAL(1, record.seconds);
+    TEST_ASSERT_FALSE(reader.next(record));
+    TEST_ASSERT_EQUAL(2, reader.getRecords());
+    TEST_ASSERT_EQUAL(1, reader.getSkipped());
+    reader.close();
+    remove(name);
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_with_rain);
+    RUN_TEST(test_parse_without_rain);
+    RUN_TEST(test_skip_other_lines);
+    RUN_TEST(test_read_file);
+    return UNITY_END();
+}
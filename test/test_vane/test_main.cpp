@@ -0,0 +1,170 @@
+/**********************************************************
+** @file		test_main.cpp
+**
+** Vector averaging of the vane: the wrap at North, samples
+** that cancel out, steadiness and deviation, and the window
+** of the last 50 samples.
+**   pio test -e native -f test_vane
+**
+
+*/
+
+#include <unity.h>
+#include <math.h>
+#include "ADSWeather.h"
+#include "SimHal.h"
+
+#define TEST_VANE_PIN A1
+#define TEST_ANEMOMETER_PIN A0
+// Vane samples the station keeps
+#define TEST_VANE_SAMPLES 50
+
+static ADSWeather *weather;
+
+void setUp(void)
+{
+    SimHal::reset();
+    weather = new ADSWeather(TEST_VANE_PIN, TEST_ANEMOMETER_PIN);
+    weather->setVaneResolution(12);
+    weather->setVaneAveraging(VANE_AVERAGING_VECTOR);
+}
+
+void tearDown(void)
+{
+    delete weather;
+    weather = nullptr;
+}
+
+//12 bit reading of the vane in a bin (22.5 degree steps from North).
+static unsigned int vaneRaw(unsigned char bin)
+{
+    for (int i = 0; i < VANE_POSITIONS; i++)
+    {
+        if (VANE_BIN[i] == bin)
+        {
+            return (unsigned int) (4095UL * VANE_RESISTANCE[i] / (VANE_RESISTANCE[i] + VANE_PULLUP));
+        }
+    }
+    return 0;
+}
+
+static void addSamples(unsigned char bin, unsigned int count)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        weather->addVaneSample(vaneRaw(bin));
+    }
+}
+
+void test_decode_every_bin(void)
+{
+    for (unsigned char bin = 0; bin < VANE_POSITIONS; bin++)
+    {
+        TEST_ASSERT_EQUAL(bin, weather->decodeVane(vaneRaw(bin)));
+    }
+}
+
+void test_single_bin(void)
+{
+    addSamples(4, 10);
+    TEST_ASSERT_EQUAL(90, weather->getWindDirection());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.0f, weather->getWindSteadiness());
+    TEST_ASSERT_EQUAL(0, weather->getWindDirDeviation());
+    long x;
+    long y;
+    unsigned int samples;
+    weather->getWindVector(x, y, samples);
+    TEST_ASSERT_EQUAL(10, samples);
+    TEST_ASSERT_INT_WITHIN(10, 0, x);
+    TEST_ASSERT_INT_WITHIN(10, 10L * VANE_VECTOR_ONE, y);
+}
+
+void test_wrap_at_north(void)
+{
+    // 337.5 and 22.5 degrees: North, where the consensus of neighbouring bins and a plain mean (180) differ
+    for (unsigned int i = 0; i < 20; i++)
+    {
+        addSamples(15, 1);
+        addSamples(1, 1);
+    }
+    TEST_ASSERT_EQUAL(0, weather->getWindDirection());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, cosf(22.5f * (float) M_PI / 180), weather->getWindSteadiness());
+
+    addSamples(15, 2);
+    int direction = weather->getWindDirection();
+    TEST_ASSERT_TRUE(direction > 350 && direction < 360);
+}
+
+void test_opposite_samples_cancel(void)
+{
+    addSamples(2, 10);
+    weather->calculate();
+    TEST_ASSERT_EQUAL(45, weather->getWindDirection());
+    addSamples(10, 10);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, weather->getWindSteadiness());
+    TEST_ASSERT_EQUAL(180, weather->getWindDirDeviation());
+    // No direction in the samples, the last calculated one stays
+    TEST_ASSERT_EQUAL(45, weather->getWindDirection());
+    addSamples(10, 1);
+    TEST_ASSERT_EQUAL(225, weather->getWindDirection());
+}
+
+void test_spread_and_deviation(void)
+{
+    // Three neighbouring bins around East, the mean stays on the middle one
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        addSamples(3, 1);
+        addSamples(4, 2);
+        addSamples(5, 1);
+    }
+    TEST_ASSERT_EQUAL(90, weather->getWindDirection());
+    float steadiness = weather->getWindSteadiness();
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, (2 + 2 * cosf(22.5f * (float) M_PI / 180)) / 4, steadiness);
+    int deviation = (int) lroundf(sqrtf(-2 * logf(steadiness)) * 180 / (float) M_PI);
+    TEST_ASSERT_EQUAL(deviation, weather->getWindDirDeviation());
+    TEST_ASSERT_TRUE(deviation > 10 && deviation < 25);
+}
+
+void test_window_of_last_samples(void)
+{
+    addSamples(0, TEST_VANE_SAMPLES);
+    TEST_ASSERT_EQUAL(0, weather->getWindDirection());
+    // Half replaced by South: the vectors cancel
+    addSamples(8, TEST_VANE_SAMPLES / 2);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.0f, weather->getWindSteadiness());
+    addSamples(8, TEST_VANE_SAMPLES / 2);
+    TEST_ASSERT_EQUAL(180, weather->getWindDirection());
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.0f, weather->getWindSteadiness());
+    long x;
+    long y;
+    unsigned int samples;
+    weather->getWindVector(x, y, samples);
+    TEST_ASSERT_EQUAL(TEST_VANE_SAMPLES, samples);
+    TEST_ASSERT_INT_WITHIN(10, -(long) TEST_VANE_SAMPLES * VANE_VECTOR_ONE, x);
+}
+
+void test_every_bin_direction(void)
+{
+    for (unsigned char bin = 0; bin < VANE_POSITIONS; bin++)
+    {
+        addSamples(bin, TEST_VANE_SAMPLES);
+        // The fixed point vectors put the half degrees on either side
+        TEST_ASSERT_INT_WITHIN(1, (int) (bin * 22.5f), weather->getWindDirection());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    UNITY_BEGIN();
+    RUN_TEST(test_decode_every_bin);
+    RUN_TEST(test_single_bin);
+    RUN_TEST(test_wrap_at_north);
+    RUN_TEST(test_opposite_samples_cancel);
+    RUN_TEST(test_spread_and_deviation);
+    RUN_TEST(test_window_of_last_samples);
+    RUN_TEST(test_every_bin_direction);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+/**********************************************************
+** @file		log2csv.cpp
+**
+** Host tool that converts a binary datalog (datalog.bin) to
+** CSV. Build and run on the PC with
+**   g++ -std=c++11 -Iinclude tools/log2csv.cpp -o log2csv
+**   ./log2csv datalog.bin > datalog.csv
+** Every header in the file (one per file, older files that
+** weren't rotated have one per boot) is printed as a
+** comment line and its calibration is used for the records
+** that follow it. Files of version 1 are read as well, their
+** rain column stays empty.
+**
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "LogFormat.h"
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s datalog.bin\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == nullptr)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    LogHeader header;
+    bool haveHeader = false;
+    unsigned long records = 0;
+    unsigned char magic[4];
+
+    printf("epoch,date,time,speed,gust,direction,power,state,voltage,rain\n");
+    while (fread(magic, 1, sizeof(magic), in) == sizeof(magic))
+    {
+        if (memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0)
+        {
+            // Read up to the version first, the size of the rest depends on it.
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, magic, sizeof(magic));
+            if (fread(&header.version, 1, sizeof(header.version), in) != sizeof(header.version))
+            {
+                break;
+            }
+            size_t headerSize = header.version == 1 ? LOG_HEADER_SIZE_V1 : sizeof(header);
+            size_t recordSize = header.version == 1 ? LOG_RECORD_SIZE_V1 : sizeof(LogRecord);
+            size_t rest = headerSize - sizeof(magic) - sizeof(header.version);
+            if (fread((char *) &header + sizeof(magic) + sizeof(header.version), 1, rest, in) != rest)
+            {
+                break;
+            }
+            if (header.version < 1 || header.version > LOG_VERSION || header.recordSize != recordSize)
+            {
+                fprintf(stderr, "unsupported log version %u (record size %u)\n", header.version, header.recordSize);
+                fclose(in);
+                return 1;
+            }
+            haveHeader = true;
+            printf("# New Initialization, version %u, divider %g, reference %gV, adc max %u, interval %ums",
+                   header.version, header.voltageDivider, header.adcReference, header.adcMax, header.interval);
+            if (header.version >= 2)
+            {
+                printf(", %gmm per tip", header.rainPerTip);
+            }
+            printf("\n");
+            continue;
+        }
+        if (!haveHeader)
+        {
+            fprintf(stderr, "file does not start with a header\n");
+            fclose(in);
+            return 1;
+        }
+
+        LogRecord record;
+        memset(&record, 0, sizeof(record));
+        memcpy(&record, magic, sizeof(magic));
+        if (fread((char *) &record + sizeof(magic), 1, header.recordSize - sizeof(magic), in) !=
+            header.recordSize - sizeof(magic))
+        {
+            fprintf(stderr, "truncated record after %lu records\n", records);
+            break;
+        }
+
+        time_t epoch = (time_t) record.epoch;
+        struct tm *t = gmtime(&epoch);
+        double voltage = record.voltage * header.adcReference / header.adcMax;
+        printf("%lu,%04d-%02d-%02d,%02d:%02d:%02d,%.1f,%.1f,%u,%.6f,%u,%.3f,",
+               (unsigned long) record.epoch, t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
+               t->tm_hour, t->tm_min, t->tm_sec, record.windSpeed / 10.0, record.windGust / 10.0,
+               record.windDirection, record.power / 1e6, record.state, voltage);
+        if (header.version >= 2)
+        {
+            printf("%.2f", record.rain * header.rainPerTip);
+        }
+        printf("\n");
+        records++;
+    }
+
+    fclose(in);
+    fprintf(stderr, "%lu records\n", records);
+    return 0;
+}
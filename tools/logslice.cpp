@@ -0,0 +1,203 @@
+/**********************************************************
+** @file		logslice.cpp
+**
+** Host tool that cuts a time range out of a log file of the
+** SD-Card with the help of its index (see LogIndexEntry in
+** LogFormat.h), only the flushes around the range are read.
+** Build and run on the PC with
+**   g++ -std=c++11 -Iinclude tools/logslice.cpp -o logslice
+**   ./logslice 2210/22101400.txt 2022-10-14T06:00:00 2022-10-14T07:30:00 > morning.txt
+**   ./logslice 2210/22101400.bin 1665727200 | ./log2csv /dev/stdin
+** FROM and TO are RTC time (UTC as set by the sketch), as
+** seconds since 1970 or YYYY-MM-DDTHH:MM:SS, both optional.
+** A CSV log is cut at the lines around the flushes, so a few
+** rows before FROM and after TO can come along. A binary log
+** is written with its header and exactly the records from
+** FROM up to TO. Without an index the whole file is read.
+**
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include "LogFormat.h"
+
+//Parses seconds since 1970 or YYYY-MM-DDTHH:MM:SS, returns false if it is neither.
+static bool parseTime(const char *text, unsigned long &epoch)
+{
+    char *end;
+    epoch = strtoul(text, &end, 10);
+    if (*end == '\0' && end != text)
+    {
+        return true;
+    }
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    if (sscanf(text, "%d-%d-%dT%d:%d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min, &t.tm_sec) != 6)
+    {
+        return false;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    epoch = (unsigned long) timegm(&t);
+    return true;
+}
+
+//Reads the index beside the log, name.idx instead of name.txt or name.bin.
+static std::vector<LogIndexEntry> readIndex(const char *fileName)
+{
+    std::vector<LogIndexEntry> index;
+    std::string name(fileName);
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos || name.find('/', dot) != std::string::npos)
+    {
+        return index;
+    }
+    FILE *in = fopen((name.substr(0, dot) + ".idx").c_str(), "rb");
+    if (in == nullptr)
+    {
+        return index;
+    }
+    LogIndexEntry entry;
+    while (fread(&entry, sizeof(entry), 1, in) == 1)
+    {
+        index.push_back(entry);
+    }
+    fclose(in);
+    return index;
+}
+
+//Copies the bytes from start to end, extended to whole lines.
+static void sliceText(FILE *in, long start, long end)
+{
+    if (start > 0)
+    {
+        // Start after the line the offset cuts, unless it is the start of a line already.
+        fseek(in, start - 1, SEEK_SET);
+        int c = fgetc(in);
+        while (c != '\n' && c != EOF)
+        {
+            c = fgetc(in);
+            start++;
+        }
+    }
+    fseek(in, start, SEEK_SET);
+    long pos = start;
+    int c;
+    while ((c = fgetc(in)) != EOF)
+    {
+        putchar(c);
+        pos++;
+        if (pos >= end && c == '\n')
+        {
+            break;
+        }
+    }
+}
+
+//Writes the header and the records from start to end whose time is in the range. The file has to start with the
+//header and not contain another one, which is true for the rotated files.
+static bool sliceBinary(FILE *in, long start, long end, unsigned long from, unsigned long to)
+{
+    LogHeader header;
+    memset(&header, 0, sizeof(header));
+    if (fread(&header, 1, 6, in) != 6 || memcmp(header.magic, LOG_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "file does not start with a header\n");
+        return false;
+    }
+    long headerSize = header.version == 1 ? LOG_HEADER_SIZE_V1 : sizeof(header);
+    fseek(in, 0, SEEK_SET);
+    if (fread(&header, 1, headerSize, in) != (size_t) headerSize || header.recordSize < sizeof(uint32_t))
+    {
+        fprintf(stderr, "truncated header\n");
+        return false;
+    }
+    fwrite(&header, 1, headerSize, stdout);
+
+    // First record that starts at or after start
+    long first = start > headerSize ? (start - headerSize + header.recordSize - 1) / header.recordSize : 0;
+    long pos = headerSize + first * header.recordSize;
+    fseek(in, pos, SEEK_SET);
+    unsigned char record[256];
+    unsigned long records = 0;
+    while (pos + header.recordSize <= end && header.recordSize <= sizeof(record) &&
+           fread(record, 1, header.recordSize, in) == header.recordSize)
+    {
+        uint32_t epoch;
+        memcpy(&epoch, record, sizeof(epoch));
+        if (epoch >= from && epoch <= to)
+        {
+            fwrite(record, 1, header.recordSize, stdout);
+            records++;
+        }
+        pos += header.recordSize;
+    }
+    fprintf(stderr, "%lu records\n", records);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long from = 0;
+    unsigned long to = 0xFFFFFFFFUL;
+    if (argc < 2 || argc > 4 || (argc > 2 && !parseTime(argv[2], from)) || (argc > 3 && !parseTime(argv[3], to)))
+    {
+        fprintf(stderr, "usage: %s FILE [FROM [TO]]  (epoch or YYYY-MM-DDTHH:MM:SS)\n", argv[0]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (in == nullptr)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(in, 0, SEEK_END);
+    long size = ftell(in);
+
+    // All records before the offset of the last entry older than FROM are older, and all records up to TO are
+    // complete before the offset that follows the first entry newer than TO.
+    std::vector<LogIndexEntry> index = readIndex(argv[1]);
+    if (index.empty())
+    {
+        fprintf(stderr, "no index, reading the whole file\n");
+    }
+    long start = 0;
+    long end = size;
+    for (size_t i = 0; i < index.size(); i++)
+    {
+        if (index[i].epoch < from)
+        {
+            start = index[i].offset;
+        }
+        if (index[i].epoch > to)
+        {
+            end = i + 1 < index.size() ? (long) index[i + 1].offset : size;
+            break;
+        }
+    }
+    if (end > size)
+    {
+        end = size;
+    }
+
+    fseek(in, 0, SEEK_SET);
+    unsigned char magic[4];
+    bool binary = fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, LOG_MAGIC, 4) == 0;
+    fseek(in, 0, SEEK_SET);
+    bool ok = true;
+    if (binary)
+    {
+        ok = sliceBinary(in, start, end, from, to);
+    }
+    else if (start < end)
+    {
+        sliceText(in, start, end);
+    }
+    fclose(in);
+    return ok ? 0 : 1;
+}
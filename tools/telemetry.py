@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""Reads the binary telemetry of the sketch (see include/TelemetryFormat.h).
+
+Frames are COBS encoded and end with a zero byte, every frame carries a
+CRC-16/CCITT-FALSE of header and payload. Text lines of DEBUGGING or the
+profiler in between fail the CRC and are skipped.
+
+    python3 tools/telemetry.py --port /dev/ttyACM0 --csv run.csv --plot
+    python3 tools/telemetry.py --port COM5 --record run.bin
+    python3 tools/telemetry.py --file run.bin --csv run.csv
+
+--port needs pyserial, --plot matplotlib. --record keeps the raw stream so it
+can be decoded again later with --file.
+"""
+
+import argparse
+import collections
+import csv
+import struct
+import sys
+import time
+
+TELEMETRY_MPPT = 1
+TELEMETRY_WIND = 2
+TELEMETRY_POWER_CURVE = 3
+# wind_direction without a direction, it is written as -1 like in the CSV log
+TELEMETRY_NO_DIRECTION = 0xFFFF
+
+HEADER = struct.Struct("<BBI")
+PAYLOADS = {
+    TELEMETRY_MPPT: ("mppt", struct.Struct("<Bbfff"), ("state", "step", "voltage", "power", "noise")),
+    TELEMETRY_WIND: ("wind", struct.Struct("<HHHHB"), ("wind_speed", "wind_gust", "wind_direction", "rain",
+                                                      "state")),
+    TELEMETRY_POWER_CURVE: ("curve", struct.Struct("<BIfffff"), ("bin", "count", "power_mean", "power_max",
+                                                                 "state_mean", "energy", "capacity_factor")),
+}
+COLUMNS = ["type", "sequence", "time", "state", "step", "voltage", "power", "noise", "wind_speed", "wind_gust",
+           "wind_direction", "rain", "bin_speed", "count", "power_mean", "power_max", "state_mean", "energy",
+           "capacity_factor"]
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE like crc16() in include/Crc16.h."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    """Decodes one COBS frame without the delimiter, returns None if it is malformed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def unpack(frame):
+    """Returns header and payload of a frame if it decodes and the CRC matches, otherwise None."""
+    raw = cobs_decode(frame)
+    if raw is None or len(raw) < HEADER.size + 2 or crc16(raw[:-2]) != struct.unpack("<H", raw[-2:])[0]:
+        return None
+    return raw
+
+
+class Decoder:
+    """Splits a byte stream into frames and decodes them into dicts."""
+
+    def __init__(self):
+        self.pending = bytearray()
+        self.frames = 0
+        self.errors = 0
+        self.lost = 0
+        self.sequence = None
+
+    def feed(self, data):
+        self.pending += data
+        while True:
+            end = self.pending.find(b"\0")
+            if end < 0:
+                return
+            frame = bytes(self.pending[:end])
+            del self.pending[:end + 1]
+            if frame:
+                packet = self.decode(frame)
+                if packet is not None:
+                    yield packet
+
+    def decode(self, frame):
+        raw = unpack(frame)
+        start = frame.find(b"\n")
+        while raw is None and start >= 0:
+            # A text line without delimiter in front of the frame, the CRC decides where the frame starts.
+            raw = unpack(frame[start + 1:])
+            start = frame.find(b"\n", start + 1)
+        if raw is None:
+            self.errors += 1
+            return None
+        kind, sequence, millis = HEADER.unpack_from(raw)
+        if self.sequence is not None:
+            self.lost += (sequence - self.sequence - 1) & 0xFF
+        self.sequence = sequence
+        self.frames += 1
+        if kind not in PAYLOADS:
+            return None
+        name, layout, fields = PAYLOADS[kind]
+        payload = raw[HEADER.size:-2]
+        if len(payload) < layout.size:
+            self.errors += 1
+            return None
+        # Fields appended by newer firmware are ignored.
+        packet = dict(zip(fields, layout.unpack_from(payload)))
+        packet.update(type=name, sequence=sequence, time=millis / 1000.0)
+        if name == "mppt":
+            for field in ("voltage", "power", "noise"):
+                packet[field] = round(packet[field], 4)
+        elif name == "wind":
+            packet["wind_speed"] /= 10.0
+            packet["wind_gust"] /= 10.0
+            if packet["wind_direction"] == TELEMETRY_NO_DIRECTION:
+                packet["wind_direction"] = -1
+        else:
+            packet["bin_speed"] = packet["bin"] * 0.5
+            for field in ("power_mean", "power_max", "energy", "capacity_factor"):
+                packet[field] = round(packet[field], 4)
+            packet["state_mean"] = round(packet["state_mean"], 1)
+        return packet
+
+
+class Plot:
+    """Live plot of power and State of the last seconds."""
+
+    def __init__(self, seconds):
+        import matplotlib.pyplot as plt
+        self.plt = plt
+        self.seconds = seconds
+        self.power = collections.deque()
+        self.state = collections.deque()
+        self.wind = collections.deque()
+        plt.ion()
+        self.figure, (self.top, self.middle, self.bottom) = plt.subplots(3, 1, sharex=True)
+        self.last = 0
+
+    def add(self, packet):
+        t = packet["time"]
+        if packet["type"] == "mppt":
+            self.power.append((t, packet["power"]))
+            self.state.append((t, packet["state"]))
+        elif packet["type"] == "wind":
+            self.wind.append((t, packet["wind_speed"]))
+        for series in (self.power, self.state, self.wind):
+            while series and series[0][0] < t - self.seconds:
+                series.popleft()
+        if time.monotonic() - self.last > 0.2:
+            self.last = time.monotonic()
+            self.draw()
+
+    def draw(self):
+        for axis, series, label in ((self.top, self.power, "power (W)"), (self.middle, self.state, "state"),
+                                    (self.bottom, self.wind, "wind (km/h)")):
+            axis.clear()
+            if series:
+                axis.plot(*zip(*series))
+            axis.set_ylabel(label)
+        self.bottom.set_xlabel("time (s)")
+        self.plt.pause(0.001)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the board")
+    source.add_argument("--file", help="raw stream recorded with --record")
+    parser.add_argument("--csv", help="write the packets as CSV, - for stdout")
+    parser.add_argument("--record", help="keep the raw stream in this file")
+    parser.add_argument("--plot", action="store_true", help="live plot of power, State and wind")
+    parser.add_argument("--window", type=float, default=60, help="seconds shown by --plot (60)")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, 1000000, timeout=0.1)
+        read = lambda: stream.read(4096)
+    else:
+        stream = open(args.file, "rb")
+        read = lambda: stream.read(4096) or None
+
+    out = None
+    writer = None
+    if args.csv:
+        out = sys.stdout if args.csv == "-" else open(args.csv, "w", newline="")
+        writer = csv.DictWriter(out, COLUMNS, extrasaction="ignore")
+        writer.writeheader()
+    record = open(args.record, "wb") if args.record else None
+    plot = Plot(args.window) if args.plot else None
+
+    decoder = Decoder()
+    try:
+        while True:
+            data = read()
+            if data is None:
+                break
+            if record:
+                record.write(data)
+            for packet in decoder.feed(data):
+                if writer:
+                    writer.writerow(packet)
+                if plot:
+                    plot.add(packet)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if out and out is not sys.stdout:
+            out.close()
+        if record:
+            record.close()
+    print("%d frames, %d lost, %d damaged" % (decoder.frames, decoder.lost, decoder.errors), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()